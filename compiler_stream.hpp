@@ -3,7 +3,16 @@
 
 #include <vector>
 #include <future>
+#include <functional>
+#include <algorithm>
 #include <type_traits>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <optional>
+#include <exception>
+#include <condition_variable>
+#include "utlang_thread_pool.hpp"
 // #include <concepts> // std::invokable
 
 namespace utlang{
@@ -14,6 +23,7 @@ namespace utlang{
     Created by one process with object_stream<T>{} << t1 << t2 << ...
     transformed/created by another process with objs.tranform() or objs.tranform_and_combine()
     returns stored values (and waits completion) with .get()
+    all work runs on the shared thread_pool::instance(), never on threads of its own
 */
 
 template <class T>
@@ -65,7 +75,7 @@ class object_pipeline{
 
     
     object_pipeline &operator<<(T const &obj) /*requires(std::is_copy_constructible_v<T>)*/ {
-        stream.push_back(std::async(identity<decltype(obj)>, obj));
+        stream.push_back(ready_future(obj));
         return *this;
     }
 
@@ -77,7 +87,7 @@ class object_pipeline{
     // }
 
     object_pipeline &operator<<(T &&obj){
-        stream.push_back(std::async(identity<decltype(std::move(obj))>, std::move(obj)));
+        stream.push_back(ready_future(std::move(obj)));
         return *this;
     }
 
@@ -86,9 +96,8 @@ class object_pipeline{
     auto transform(F const &f){
         using result_object_type = std::invoke_result_t<F, T>;
         auto result_stream = object_pipeline<result_object_type>{};
-
-        for (auto &obj: *this)
-            result_stream.stream.push_back(std::async([](auto const &f, auto &&obj){return std::invoke(f, std::move(obj).get());}, f, std::move(obj)));
+        result_stream.stream.reserve(stream.size());
+        submit_batches(f, result_stream);
         return result_stream;
     }
 
@@ -100,10 +109,10 @@ class object_pipeline{
         // auto gg = object_stream<object_stream<int>>{};
         auto result_stream = result_stream_type{};
 
-        for (auto &obj: *this)
-            intermediate_stream.stream.push_back(std::async([](auto const &f, auto &&obj){return std::invoke(f, std::move(obj).get());}, f, std::move(obj)));
+        submit_batches(f, intermediate_stream);
+        auto &pool = thread_pool::instance();
         for (auto &substream: intermediate_stream)
-            for (auto &obj: std::move(substream).get())
+            for (auto &obj: pool.get(substream))
                 result_stream.stream.push_back(std::move(obj));
             // result_stream.stream.insert(result_stream.end(), substream.get().begin(), substream.get().end());
         return result_stream;
@@ -112,16 +121,247 @@ class object_pipeline{
     std::vector<T> get(){
         auto result = std::vector<T>{};
         result.reserve(stream.size());
+        auto &pool = thread_pool::instance();
         for (auto &obj: *this){
             if (obj.valid())[[likely]]
-                result.push_back(obj.get());
+                result.push_back(pool.get(obj));
             else
                 throw std::future_error(std::future_errc::no_state);
         }
         return result;
     }
+
+    private:
+
+    template<class U>
+    static std::future<std::remove_cvref_t<U>> ready_future(U &&obj){
+        auto promise = std::promise<std::remove_cvref_t<U>>{};
+        promise.set_value(std::forward<U>(obj));
+        return promise.get_future();
+    }
+
+    /*
+        Applies f to every element, writing the results to result_stream in order
+        Elements are handed to the pool in batches (a task per element costs more than tokenising it);
+        the calling thread waits for the inputs itself, so pool tasks never block on each other
+    */
+    template<class F, class R>
+    void submit_batches(F const &f, object_pipeline<R> &result_stream){
+        struct batch_item{
+            T input;
+            std::promise<R> output;
+        };
+
+        auto &pool = thread_pool::instance();
+        auto const batch_size = std::clamp<std::size_t>(stream.size() / (pool.worker_count() * 8), 1, 256);
+        auto batch = std::vector<batch_item>{};
+
+        auto flush = [&]{
+            pool.submit([f = std::decay_t<F>(f), batch = std::move(batch)]() mutable{
+                for (auto &item: batch){
+                    try{
+                        item.output.set_value(std::invoke(f, std::move(item.input)));
+                    }catch(...){
+                        item.output.set_exception(std::current_exception());
+                    }
+                }
+            });
+            batch.clear();
+        };
+
+        for (auto &obj: *this){
+            auto output = std::promise<R>{};
+            result_stream.stream.push_back(output.get_future());
+            batch.push_back(batch_item{pool.get(obj), std::move(output)});
+            if (batch.size() == batch_size)
+                flush();
+        }
+        if (not batch.empty())
+            flush();
+    }
+};
+
+
+
+/*
+    A FIFO of at most `capacity` objects shared by one producer and one consumer
+    push() blocks while the queue is full, pop() blocks while it is empty
+    Either side can close() it: pop() then drains the remaining objects and returns nothing,
+    push() on a closed queue returns false
+    A producer can also fail(), passing its exception to the consumer
+*/
+template <class T>
+class bounded_queue{
+    public:
+
+    explicit bounded_queue(std::size_t capacity): capacity(std::max<std::size_t>(capacity, 1)) {}
+
+    bool push(T obj){
+        auto lock = std::unique_lock{mutex};
+        not_full.wait(lock, [this]{return closed or objects.size() < capacity;});
+        if (closed)
+            return false;
+        objects.push_back(std::move(obj));
+        not_empty.notify_one();
+        return true;
+    }
+
+    std::optional<T> pop(){
+        auto lock = std::unique_lock{mutex};
+        not_empty.wait(lock, [this]{return closed or not objects.empty();});
+        if (objects.empty()){
+            if (error)
+                std::rethrow_exception(error);
+            return std::nullopt;
+        }
+        auto obj = std::move(objects.front());
+        objects.pop_front();
+        not_full.notify_one();
+        return obj;
+    }
+
+    void close(){
+        auto lock = std::lock_guard{mutex};
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    void fail(std::exception_ptr producer_error){
+        auto lock = std::lock_guard{mutex};
+        error = producer_error;
+        closed = true;
+        not_full.notify_all();
+        not_empty.notify_all();
+    }
+
+    private:
+
+    std::size_t const capacity;
+    std::deque<T> objects;
+    bool closed = false;
+    std::exception_ptr error;
+    std::mutex mutex;
+    std::condition_variable not_full;
+    std::condition_variable not_empty;
 };
 
+// thrown inside a producer when its consumer has gone away
+class stream_closed{};
+
+/*
+    A lazily produced stream of objects of type T
+    Every stage runs on its own thread and hands its output to the next stage through a bounded_queue,
+    so downstream stages start on the first objects while upstream ones are still producing,
+    and no more than ~capacity objects per stage are alive at any time
+    Created with streaming_pipeline<T>{producer} where producer(emit) calls emit(t1), emit(t2), ...
+    transformed by another stage with objs.transform() or objs.transform_and_combine() (f(obj, emit))
+    consumed on the calling thread with .for_each() or .get()
+*/
+template <class T>
+class streaming_pipeline{
+    // objects travel in batches, one lock per batch instead of one per object
+    using batch_type = std::vector<T>;
+
+    public:
+
+    static constexpr std::size_t default_capacity = 4096;
+
+    class emitter{
+        public:
+
+        emitter(bounded_queue<batch_type> &queue, std::size_t batch_size): queue(queue), batch_size(batch_size) {
+            batch.reserve(batch_size);
+        }
+
+        void operator()(T obj){
+            batch.push_back(std::move(obj));
+            if (batch.size() == batch_size)
+                flush();
+        }
+
+        void flush(){
+            if (batch.empty())
+                return;
+            if (not queue.push(std::move(batch)))
+                throw stream_closed{};
+            batch = batch_type{};
+            batch.reserve(batch_size);
+        }
+
+        private:
+
+        bounded_queue<batch_type> &queue;
+        std::size_t const batch_size;
+        batch_type batch;
+    };
+
+    template<class P>
+    requires (std::is_invocable_v<P, emitter&>)
+    explicit streaming_pipeline(P producer, std::size_t capacity = default_capacity):
+        batch_size(std::clamp<std::size_t>(capacity / 4, 1, 64)),
+        queue(std::make_unique<bounded_queue<batch_type>>((capacity + batch_size - 1) / batch_size)){
+        stage = std::jthread([producer = std::move(producer), &queue = *queue, batch_size = batch_size]() mutable{
+            try{
+                auto emit = emitter{queue, batch_size};
+                std::invoke(producer, emit);
+                emit.flush();
+                queue.close();
+            }catch(stream_closed const &){
+                // the consumer no longer wants anything
+            }catch(...){
+                queue.fail(std::current_exception());
+            }
+        });
+    }
+
+    streaming_pipeline(streaming_pipeline const &) = delete;
+    streaming_pipeline(streaming_pipeline &&) = default;
+    streaming_pipeline &operator=(streaming_pipeline const &) = delete;
+    streaming_pipeline &operator=(streaming_pipeline &&) = delete;
+
+    ~streaming_pipeline(){
+        if (queue)
+            queue->close(); // releases a producer blocked on a full queue; stage joins afterwards
+    }
+
+    template<class F>
+    requires (std::is_invocable_v<F&, T>)
+    void for_each(F f) &&{
+        while (auto batch = queue->pop())
+            for (auto &obj: *batch)
+                std::invoke(f, std::move(obj));
+    }
+
+    template<class U, class F>
+    requires (std::is_invocable_v<F&, T, typename streaming_pipeline<U>::emitter&>)
+    streaming_pipeline<U> transform_and_combine(F f, std::size_t capacity = default_capacity) &&{
+        return streaming_pipeline<U>{[upstream = std::move(*this), f = std::move(f)](auto &emit) mutable{
+            std::move(upstream).for_each([&](T obj){std::invoke(f, std::move(obj), emit);});
+        }, capacity};
+    }
+
+    template<class F>
+    requires (std::is_invocable_v<F&, T>)
+    auto transform(F f, std::size_t capacity = default_capacity) &&{
+        using result_object_type = std::invoke_result_t<F&, T>;
+        return std::move(*this).template transform_and_combine<result_object_type>([f = std::move(f)](T obj, auto &emit) mutable{
+            emit(std::invoke(f, std::move(obj)));
+        }, capacity);
+    }
+
+    std::vector<T> get() &&{
+        auto result = std::vector<T>{};
+        std::move(*this).for_each([&](T obj){result.push_back(std::move(obj));});
+        return result;
+    }
+
+    private:
+
+    std::size_t batch_size;
+    std::unique_ptr<bounded_queue<batch_type>> queue;
+    std::jthread stage;
+};
 
 }
 
@@ -1,10 +1,23 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <chrono>
 #include <thread>
+#include <string_view>
+#include <filesystem>
+#include <random>
+#include <fstream>
+#include <optional>
+#include <system_error>
+#include <sys/resource.h>
 #include "compiler_stream.hpp"
 #include "utlang_parser.hpp"
+#include "utlang_simd_scan.hpp"
+#include "utlang_source_buffer.hpp"
+#include "utlang_driver.hpp"
+#include "utlang_syntax_tree_builder.hpp"
+#include "utlang_evaluator.hpp"
+#include "utlang_type_checker.hpp"
+#include "utlang_incremental.hpp"
+#include "utlang_binary_ast.hpp"
 
 std::string token_to_string(utlang::tokenisation::token const &t){
     static constexpr std::array token_fields = {
@@ -31,23 +44,30 @@ std::string token_to_string(utlang::tokenisation::token const &t){
         std::make_pair(&utlang::tokenisation::token::is_statement_separator, "is_statement_separator")
     };
 
-    std::string token_debug_form = "(\"" + t.token_value + "\"";
+    std::string token_debug_form = "(\"" + std::string(t.token_value()) + "\"";
     for (auto [field, text]: token_fields)
-        if (t.*field)
+        if ((t.*field)())
             token_debug_form += std::string(", ") + text;
     token_debug_form += ")";
     return token_debug_form;
 }
 
-std::string file_to_string(std::ifstream &file){
-    std::ostringstream string_stream;
-    string_stream << file.rdbuf();
-    return string_stream.str();
+using utlang::driver::tokeniser_type;
+
+std::vector<utlang::tokenisation::token> tokenise_streaming(std::string_view input_text){
+    return utlang::tokenisation::tokenise_streaming(input_text);
+}
+
+std::vector<utlang::tokenisation::token> tokenise_parallel(std::string_view input_text){
+    return utlang::tokenisation::tokenise_parallel(input_text);
 }
 
-std::vector<std::string> tokenise_file(std::ifstream &file){
-    std::string file_content = file_to_string(file);
-    auto const token_stream = utlang::tokenisation::tokenise(file_content);
+std::vector<utlang::tokenisation::token> tokenise_single_pass(std::string_view input_text){
+    return utlang::tokenisation::tokenise_single_pass(input_text);
+}
+
+std::vector<std::string> tokenise_file(utlang::source_buffer const &file, tokeniser_type tokeniser){
+    auto const token_stream = tokeniser(file.text());
     std::vector<std::string> token_debug_info_stream;
     for (auto const &t: token_stream)
         token_debug_info_stream.emplace_back(token_to_string(t));
@@ -76,9 +96,439 @@ auto get_list(int n){
     return int_list;
 }
 
-int main(){
-    std::ifstream file("clean_test.utlang");
-    for (auto td: tokenise_file(file))
+// tokenises the file (repeated up to at least scale_to_mib MiB) `repeat` times and reports the throughput
+void benchmark_tokenise(utlang::source_buffer const &file, tokeniser_type tokeniser, int repeat, std::size_t scale_to_mib){
+    auto file_content = file.text();
+    auto scaled_content = std::string{};
+    if (not file_content.empty() and file_content.size() < scale_to_mib * 1024 * 1024){
+        auto const copies = scale_to_mib * 1024 * 1024 / file_content.size() + 1;
+        scaled_content.reserve(file_content.size() * copies);
+        for (std::size_t i = 0; i < copies; ++i)
+            scaled_content += file_content;
+        file_content = scaled_content;
+    }
+    std::size_t token_count = 0;
+    auto const start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < repeat; ++i)
+        token_count += tokeniser(file_content).size();
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+
+    auto const megabytes = static_cast<double>(file_content.size()) * repeat / (1024 * 1024);
+    std::cout << "tokenised " << megabytes << " MiB (" << token_count << " tokens) in " << elapsed.count() << " s: "
+              << megabytes / elapsed.count() << " MiB/s, " << token_count / elapsed.count() << " tokens/s, "
+              << utlang::thread_pool::instance().worker_count() << " worker(s), " << utlang::simd::kernels().name << " kernels\n";
+}
+
+// a program of at least token_target tokens: small functions with matches and blocks, and deeply nested applications
+std::string synthetic_program(std::size_t token_target){
+    auto program = std::string{};
+    std::size_t tokens = 0;
+    for (std::size_t i = 0; tokens < token_target; ++i){
+        auto const number = std::to_string(i);
+        program += "let f";
+        program += number;
+        program += ": Int -> List Int = \\x -> match x {\n"
+                   "    case S (S y): Tail (f";
+        program += number;
+        program += " y) (Tail x Stop);\n"
+                   "    case _: {val z: Int = S (S Zero); Tail z Stop;};\n"
+                   "};\n";
+        tokens += 55;
+        if (i % 16 == 0){
+            constexpr std::size_t depth = 256;
+            program += "val d";
+            program += number;
+            program += ": Int = ";
+            for (std::size_t j = 0; j < depth; ++j)
+                program += "S (";
+            program += "Zero";
+            program.append(depth, ')');
+            program += ";\n";
+            tokens += depth * 3 + 7;
+        }
+    }
+    return program;
+}
+
+// parses a synthetic program of about token_target tokens `repeat` times and reports the throughput
+void benchmark_parse(std::size_t token_target, int repeat){
+    auto const program = synthetic_program(token_target);
+    auto const tokens = utlang::tokenisation::tokenise(program);
+    std::size_t statements = 0;
+    auto const start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < repeat; ++i)
+        statements += utlang::syntax::build_AST(tokens).code.statement_list.size();
+    std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+
+    auto const token_count = static_cast<double>(tokens.size()) * repeat;
+    std::cout << "parsed " << tokens.size() << " tokens (" << statements / repeat << " statements) " << repeat << " time(s) in " << elapsed.count() << " s: "
+              << token_count / elapsed.count() << " tokens/s, " << elapsed.count() / token_count * 1e9 << " ns/token\n";
+}
+
+void print_heap_statistics(std::ostream &output, std::string_view indent, utlang::evaluation::heap_statistics const &statistics){
+    output << indent << "heap: " << statistics.allocations << " allocations (" << statistics.allocated_bytes / 1024 << " KiB), old generation "
+           << statistics.old_bytes / 1024 << " KiB (" << statistics.peak_old_bytes / 1024 << " KiB at most)\n"
+           << indent << "  " << statistics.minor_collections << " minor collections: " << statistics.promoted_bytes / 1024 << " KiB promoted, pauses "
+           << statistics.minor_pause_seconds * 1e3 << " ms in all, " << statistics.longest_minor_pause_seconds * 1e3 << " ms the longest\n"
+           << indent << "  " << statistics.major_collections << " major collections: " << statistics.compacted_bytes / 1024 << " KiB freed, pauses "
+           << statistics.major_pause_seconds * 1e3 << " ms in all, " << statistics.longest_major_pause_seconds * 1e3 << " ms the longest\n";
+}
+
+void print_type_errors(std::ostream &output, utlang::source_buffer const &file, std::vector<utlang::tokenisation::token> const &tokens, std::vector<utlang::typing::type_error> const &errors){
+    for (auto const &error: errors)
+        output << file.name() << ':' << utlang::typing::line_and_column(tokens, file.text(), error.position) << ": type error: " << error.message << '\n';
+}
+
+// prints the type of every top-level definition
+int check_file(utlang::source_buffer const &file, tokeniser_type tokeniser){
+    auto const tokens = tokeniser(file.text());
+    auto const program = utlang::syntax::build_AST(tokens);
+    auto const result = utlang::typing::check_types(program);
+    for (auto const &definition: result.definitions)
+        std::cout << definition.name << ": " << definition.type << '\n';
+    print_type_errors(std::cerr, file, tokens, result.errors);
+    return result.errors.empty() ? 0 : 1;
+}
+
+// evaluates every definition of the file; type errors are reported, the evaluator finds out the rest by itself
+int run_file(utlang::source_buffer const &file, tokeniser_type tokeniser, utlang::evaluation::options evaluation_options, bool heap_statistics){
+    auto const tokens = tokeniser(file.text());
+    auto const program = utlang::syntax::build_AST(tokens);
+    print_type_errors(std::cerr, file, tokens, utlang::typing::check_types(program).errors);
+    auto evaluator = utlang::evaluation::evaluator{program, utlang::symbol_table::global(), evaluation_options};
+    for (auto const &diagnostic: evaluator.check_matches())
+        std::cerr << diagnostic.definition << ": warning: " << diagnostic.message << '\n';
+    auto const failed = evaluator.run(std::cout);
+    if (heap_statistics)
+        print_heap_statistics(std::cerr, "", evaluator.heap_stats());
+    return failed == 0 ? 0 : 1;
+}
+
+// writes the image of the tokens and the tree of the file (see utlang_binary_ast.hpp)
+int emit_binary(utlang::source_buffer const &file, tokeniser_type tokeniser, std::string const &output_name){
+    auto const tokens = tokeniser(file.text());
+    auto const image = utlang::binary::write_program(utlang::syntax::build_AST(tokens), tokens, file.text());
+    auto output = std::ofstream(output_name, std::ios::binary | std::ios::trunc);
+    output.write(image.data(), static_cast<std::streamsize>(image.size()));
+    output.close();
+    if (not output){
+        std::cerr << "cannot write " << output_name << '\n';
+        return 1;
+    }
+    std::cout << "wrote " << image.size() << " bytes (" << tokens.size() << " tokens, " << file.text().size() << " bytes of text) to " << output_name << '\n';
+    return 0;
+}
+
+std::string binary_type_to_string(utlang::binary::Type type){
+    return std::visit([](auto const node){
+        using node_type = std::remove_const_t<decltype(node)>;
+        if constexpr (std::is_same_v<node_type, utlang::binary::Simple_Type>)
+            return node.name().to_string();
+        else if constexpr (std::is_same_v<node_type, utlang::binary::Function_Type>)
+            return "(" + binary_type_to_string(node.argument_type()) + " -> " + binary_type_to_string(node.result_type()) + ")";
+        else{
+            auto text = std::string{};
+            for (auto const argument: node.types())
+                text += (text.empty() ? "" : " ") + binary_type_to_string(argument);
+            return "(" + text + ")";
+        }
+    }, type.type());
+}
+
+// the declarations of the block, read from the image where it lies
+void print_binary_declarations(utlang::binary::Block block, std::string const &prefix){
+    for (auto const statement: block.statement_list())
+        std::visit([&prefix](auto const node){
+            using node_type = std::remove_const_t<decltype(node)>;
+            if constexpr (std::is_same_v<node_type, utlang::binary::Variable_definition>){
+                std::cout << "val " << prefix << node.name().name().to_string();
+                if (auto const type = node.type())
+                    std::cout << ": " << binary_type_to_string(*type);
+                std::cout << '\n';
+            }else if constexpr (std::is_same_v<node_type, utlang::binary::Type_definition>){
+                std::cout << "type " << prefix << node.type().name().to_string();
+                for (auto const parameter: node.parameter_types())
+                    std::cout << ' ' << parameter.name().to_string();
+                auto separator = " = ";
+                for (auto const constructor: node.constructors()){
+                    std::cout << std::exchange(separator, " | ") << constructor.name().name().to_string();
+                    for (auto const field: constructor.field_types())
+                        std::cout << ' ' << binary_type_to_string(field);
+                }
+                std::cout << '\n';
+            }else if constexpr (std::is_same_v<node_type, utlang::binary::Namespace_definition>)
+                print_binary_declarations(node.content(), prefix + std::string(node.name()) + "::");
+            else if constexpr (std::is_same_v<node_type, utlang::binary::Import_declaration>)
+                std::cout << "import " << node.module().to_string() << '\n';
+        }, statement.st());
+}
+
+// prints why the file cannot be read, as the batch driver does
+std::optional<utlang::source_buffer> open_source(std::string const &file_name){
+    try{
+        return utlang::source_buffer{file_name};
+    }catch(std::system_error const &error){
+        std::cerr << file_name << ": " << error.code().message() << '\n';
+        return std::nullopt;
+    }
+}
+
+// maps an image written by --emit-binary, checks it and prints its declarations without building a tree
+int inspect_binary(std::string const &image_name){
+    auto const opened = open_source(image_name);
+    if (not opened)
+        return 1;
+    auto const &file = *opened;
+    auto const start = std::chrono::steady_clock::now();
+    try{
+        auto const image = utlang::binary::program_view{file.text()};
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+        print_binary_declarations(image.code(), "");
+        std::cerr << image.image_size() << " bytes" << (file.is_memory_mapped() ? " (mapped)" : "") << ": " << image.node_count() << " nodes, "
+                  << image.string_count() << " strings, " << image.token_count() << " tokens, " << image.statement_count() << " statements; checked in "
+                  << elapsed.count() * 1000 << " ms\n";
+    }catch(utlang::binary::format_error const &error){
+        std::cerr << image_name << ": " << error.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
+
+// applies `count` random edits to the file incrementally, each one compared with lexing and parsing the whole new text, and reports both times
+int fuzz_edits(utlang::source_buffer const &file, std::size_t count, std::uint64_t seed){
+    static constexpr std::array snippets = {" ", "\n", "x", "Foo", ";", "(", ")", "{", "}", "/*", "*/", "//", "->", ":", "=", "|", "\\", "match", "case", "_", "let y = x;"};
+    auto random = std::mt19937_64{seed};
+    auto below = [&random](std::size_t n){return std::uniform_int_distribution<std::size_t>{0, n - 1}(random);};
+    auto document = utlang::incremental::document{std::string(file.text())};
+    auto undo = std::vector<std::pair<utlang::incremental::text_edit, std::string>>{}; // the edits that take the text back, the last one first
+    std::size_t mismatches = 0, valid = 0, rebuilds = 0;
+    std::chrono::duration<double> incremental_time{}, rebuild_time{}, full_time{};
+    for (std::size_t i = 0; i < count; ++i){
+        auto const text = document.text();
+        auto inserted = std::string{};
+        auto edit = utlang::incremental::text_edit{};
+        if (not undo.empty() and (not document.valid() or below(4) == 0)){ // most random edits are syntax errors, which are taken back
+            edit = undo.back().first;
+            inserted = std::move(undo.back().second);
+            undo.pop_back();
+        }else{
+            edit.offset = below(text.size() + 1);
+            edit.removed_length = below(std::min<std::size_t>(text.size() - edit.offset, 8) + 1);
+            if (below(4) == 0 and not text.empty()){
+                auto const from = below(text.size());
+                inserted = text.substr(from, below(std::min<std::size_t>(text.size() - from, 64)) + 1);
+            }else
+                inserted = snippets[below(snippets.size())];
+            undo.emplace_back(utlang::incremental::text_edit{edit.offset, inserted.size(), {}}, std::string(text.substr(edit.offset, edit.removed_length)));
+        }
+        edit.inserted = inserted;
+
+        auto start = std::chrono::steady_clock::now();
+        document.apply(edit);
+        (document.last_edit().rebuilt ? rebuild_time : incremental_time) += std::chrono::steady_clock::now() - start;
+        rebuilds += document.last_edit().rebuilt;
+
+        start = std::chrono::steady_clock::now();
+        auto tokens = std::vector<utlang::tokenisation::token>{};
+        auto tree = std::optional<utlang::syntax::Program_AST>{};
+        try{
+            tokens = utlang::tokenisation::tokenise(document.text());
+            tree = utlang::syntax::build_AST(tokens);
+        }catch(int){}
+        full_time += std::chrono::steady_clock::now() - start;
+
+        auto same = document.valid() == tree.has_value();
+        if (same and tree){
+            ++valid;
+            same = std::ranges::equal(document.tokens(), tokens, [](auto const &a, auto const &b){
+                return a.token_value().data() == b.token_value().data() and a.token_value().size() == b.token_value().size() and a.kind_set() == b.kind_set();
+            }) and utlang::incremental::same_tree(document.program(), *tree);
+        }
+        if (not same){
+            ++mismatches;
+            std::cerr << "edit " << i << " (" << edit.offset << ", " << edit.removed_length << ", \"" << inserted << "\") differs from a full rebuild\n";
+        }
+    }
+    std::cout << count << " edits (" << valid << " valid, " << rebuilds << " rebuilt as a whole), " << mismatches << " mismatch(es); "
+              << incremental_time.count() / std::max<std::size_t>(count - rebuilds, 1) * 1e6 << " us/edit incrementally, "
+              << rebuild_time.count() / std::max<std::size_t>(rebuilds, 1) * 1e6 << " us/edit rebuilt, " << full_time.count() / count * 1e6 << " us/edit from scratch\n";
+    return mismatches == 0 ? 0 : 1;
+}
+
+// recursive programs over Peano naturals and lists, evaluated by walking the tree and by the bytecode machine
+void benchmark_evaluate(std::size_t n, utlang::evaluation::options evaluation_options){
+    auto program = std::string{
+        "type Nat = Z | S Nat;\n"
+        "type List = Nil | Cons Nat List;\n"
+        "let add: Nat -> Nat -> Nat = \\a -> \\b -> match a {case Z: b; case S p: S (add p b);};\n"
+        "let mul: Nat -> Nat -> Nat = \\a -> \\b -> match a {case Z: Z; case S p: add b (mul p b);};\n"
+        "let range: Nat -> List = \\k -> match k {case Z: Nil; case S p: Cons k (range p);};\n"
+        "let sum: List -> Nat -> Nat = \\l -> \\total -> match l {case Nil: total; case Cons x rest: sum rest (add x total);};\n"
+        "val n: Nat = "};
+    for (std::size_t i = 0; i < n; ++i)
+        program += "S (";
+    program += "Z";
+    program.append(n, ')');
+    program += ";\nval square: Nat = mul n n;\nval triangle: Nat = sum (range n) Z;\n";
+
+    auto const tokens = utlang::tokenisation::tokenise(program);
+    auto const tree = utlang::syntax::build_AST(tokens);
+    for (auto const engine: {utlang::evaluation::engine_type::tree_walking, utlang::evaluation::engine_type::bytecode}){
+        evaluation_options.engine = engine;
+        for (auto const name: {"square", "triangle"}){
+            auto evaluator = utlang::evaluation::evaluator{tree, utlang::symbol_table::global(), evaluation_options};
+            evaluator.evaluate("n");
+            auto const start = std::chrono::steady_clock::now();
+            auto const result = evaluator.evaluate(name);
+            std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+            auto const printed = evaluator.to_string(result);
+            auto usage = rusage{};
+            getrusage(RUSAGE_SELF, &usage);
+            std::cout << (engine == utlang::evaluation::engine_type::bytecode ? "bytecode " : "tree     ") << name << "(" << n << ") = "
+                      << (printed.size() > 40 ? printed.substr(0, 40) + "..." : printed) << " in " << elapsed.count() << " s, "
+                      << usage.ru_maxrss / 1024 << " MiB peak, " << evaluator.unique_values() << " unique values"
+                      << (evaluation_options.native_naturals ? " (native naturals)" : " (constructor chains)") << '\n';
+            print_heap_statistics(std::cout, "    ", evaluator.heap_stats());
+        }
+    }
+}
+
+int main(int argc, char **argv){
+    // usage: executable.exe [--threads N] [--simd avx2|sse2|scalar] [--streaming | --parallel | --single-pass] [--bench-tokenise REPEAT [--scale-to MIB]] [file | -]
+    //        executable.exe --bench-parse TOKENS [--repeat N]   (parses a synthetic program)
+    //        executable.exe --run [--engine ast|bytecode] [--no-native-naturals] [--no-hash-consing] [--heap-stats] [file]   (evaluates every definition)
+    //        executable.exe --check [file]   (infers and prints the type of every definition)
+    //        executable.exe --fuzz-edits N [--seed S] [file]   (random incremental edits, each compared with a full rebuild)
+    //        executable.exe --emit-binary OUTPUT [file]   (writes the image of the tokens and the tree)
+    //        executable.exe --inspect-binary IMAGE   (prints the declarations in an image, read where it is mapped)
+    //        executable.exe --bench-eval N [--no-native-naturals] [--no-hash-consing] (n * n and 1 + ... + n in Peano arithmetic, with both engines)
+    //        executable.exe [options] [--jobs N] [--cache DIR [--cache-size MIB]] [--module-path DIR]... [--emit-interfaces DIR] file|directory|@response_file...
+    //            (compiles all of them and the modules they import, prints a summary)
+    std::string file_name = "clean_test.utlang";
+    auto inputs = std::vector<std::string>{};
+    std::size_t jobs = std::thread::hardware_concurrency();
+    std::string cache_directory;
+    std::uintmax_t cache_size_mib = 256;
+    auto modules = utlang::driver::module_settings{};
+    tokeniser_type tokeniser = utlang::tokenisation::tokenise;
+    int benchmark_repeat = 0;
+    std::size_t benchmark_scale_to_mib = 0;
+    std::size_t parse_benchmark_tokens = 0;
+    int parse_benchmark_repeat = 1;
+    bool run = false;
+    bool check = false;
+    bool heap_statistics = false;
+    std::size_t fuzz_edit_count = 0;
+    std::uint64_t fuzz_seed = 1;
+    std::string binary_output, binary_input;
+    std::size_t evaluation_benchmark_n = 0;
+    auto evaluation_options = utlang::evaluation::options{};
+    for (int i = 1; i < argc; ++i){
+        auto const argument = std::string_view{argv[i]};
+        if (argument == "--threads" and i + 1 < argc)
+            utlang::thread_pool::set_default_worker_count(std::stoul(argv[++i]));
+        else if (argument == "--simd" and i + 1 < argc){
+            if (not utlang::simd::select_kernels(argv[++i]))
+                std::cerr << "kernels " << argv[i] << " are not available, using " << utlang::simd::kernels().name << '\n';
+        }else if (argument == "--streaming")
+            tokeniser = tokenise_streaming;
+        else if (argument == "--parallel")
+            tokeniser = tokenise_parallel;
+        else if (argument == "--single-pass")
+            tokeniser = tokenise_single_pass;
+        else if (argument == "--scale-to" and i + 1 < argc)
+            benchmark_scale_to_mib = std::stoul(argv[++i]);
+        else if (argument == "--bench-tokenise" and i + 1 < argc)
+            benchmark_repeat = std::stoi(argv[++i]);
+        else if (argument == "--bench-parse" and i + 1 < argc)
+            parse_benchmark_tokens = std::stoul(argv[++i]);
+        else if (argument == "--repeat" and i + 1 < argc)
+            parse_benchmark_repeat = std::stoi(argv[++i]);
+        else if (argument == "--run")
+            run = true;
+        else if (argument == "--check")
+            check = true;
+        else if (argument == "--fuzz-edits" and i + 1 < argc)
+            fuzz_edit_count = std::stoul(argv[++i]);
+        else if (argument == "--emit-binary" and i + 1 < argc)
+            binary_output = argv[++i];
+        else if (argument == "--inspect-binary" and i + 1 < argc)
+            binary_input = argv[++i];
+        else if (argument == "--seed" and i + 1 < argc)
+            fuzz_seed = std::stoull(argv[++i]);
+        else if (argument == "--no-native-naturals")
+            evaluation_options.native_naturals = false;
+        else if (argument == "--no-hash-consing")
+            evaluation_options.hash_consing = false;
+        else if (argument == "--heap-stats")
+            heap_statistics = true;
+        else if (argument == "--engine" and i + 1 < argc){
+            auto const engine = std::string_view{argv[++i]};
+            if (engine == "ast")
+                evaluation_options.engine = utlang::evaluation::engine_type::tree_walking;
+            else if (engine == "bytecode")
+                evaluation_options.engine = utlang::evaluation::engine_type::bytecode;
+            else{
+                std::cerr << "unknown engine " << engine << " (ast or bytecode)\n";
+                return 1;
+            }
+        }
+        else if (argument == "--bench-eval" and i + 1 < argc)
+            evaluation_benchmark_n = std::stoul(argv[++i]);
+        else if (argument == "--jobs" and i + 1 < argc)
+            jobs = std::stoul(argv[++i]);
+        else if (argument == "--cache" and i + 1 < argc)
+            cache_directory = argv[++i];
+        else if (argument == "--cache-size" and i + 1 < argc)
+            cache_size_mib = std::stoull(argv[++i]);
+        else if (argument == "--module-path" and i + 1 < argc)
+            modules.roots.emplace_back(argv[++i]);
+        else if (argument == "--emit-interfaces" and i + 1 < argc)
+            modules.interface_directory = argv[++i];
+        else
+            inputs.emplace_back(argument);
+    }
+
+    if (not binary_input.empty())
+        return inspect_binary(binary_input);
+    if (parse_benchmark_tokens > 0){
+        benchmark_parse(parse_benchmark_tokens, parse_benchmark_repeat);
+        return 0;
+    }
+    if (evaluation_benchmark_n > 0){
+        benchmark_evaluate(evaluation_benchmark_n, evaluation_options);
+        return 0;
+    }
+    if (inputs.size() > 1 or (not inputs.empty() and (not cache_directory.empty() or not modules.roots.empty() or not modules.interface_directory.empty())) or
+        (inputs.size() == 1 and (inputs.front().starts_with('@') or std::filesystem::is_directory(inputs.front())))){
+        auto cache = std::optional<utlang::cache::build_cache>{};
+        if (not cache_directory.empty())
+            cache.emplace(cache_directory, cache_size_mib * 1024 * 1024);
+        auto const start = std::chrono::steady_clock::now();
+        auto const results = utlang::driver::compile_files(utlang::driver::collect_input_files(inputs), tokeniser, jobs, cache ? &*cache : nullptr, modules);
+        std::chrono::duration<double> const elapsed = std::chrono::steady_clock::now() - start;
+        return utlang::driver::print_summary(std::cout, results, elapsed.count()) == 0 ? 0 : 1;
+    }
+    if (inputs.size() == 1)
+        file_name = inputs.front();
+
+    auto const opened = open_source(file_name);
+    if (not opened)
+        return 1;
+    auto const &file = *opened;
+    if (not binary_output.empty())
+        return emit_binary(file, tokeniser, binary_output);
+    if (fuzz_edit_count > 0)
+        return fuzz_edits(file, fuzz_edit_count, fuzz_seed);
+    if (check)
+        return check_file(file, tokeniser);
+    if (run)
+        return run_file(file, tokeniser, evaluation_options, heap_statistics);
+    if (benchmark_repeat > 0){
+        benchmark_tokenise(file, tokeniser, benchmark_repeat, benchmark_scale_to_mib);
+        return 0;
+    }
+    for (auto td: tokenise_file(file, tokeniser))
         std::cout << td << '\n';
 
     // auto il = get_list(10);
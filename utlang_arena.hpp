@@ -0,0 +1,107 @@
+#ifndef UTLANG_ARENA_HPP
+#define UTLANG_ARENA_HPP
+
+#include <span>
+#include <memory>
+#include <vector>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+namespace utlang{
+
+    /*
+        A bump allocator: objects are carved out of large blocks and all released at once with the arena
+        Destructors are never run, so only trivially destructible objects may live here
+        Not thread-safe; use one arena per thread and absorb() them afterwards
+    */
+    class arena{
+        public:
+            static constexpr std::size_t default_block_size = 64 * 1024;
+
+            explicit arena(std::size_t block_size = default_block_size): block_size(block_size) {}
+            arena(arena const &) = delete;
+            arena &operator=(arena const &) = delete;
+            arena(arena &&other) noexcept:
+                block_size(other.block_size), blocks(std::move(other.blocks)), current(std::exchange(other.current, nullptr)),
+                block_end(std::exchange(other.block_end, nullptr)), used_bytes(std::exchange(other.used_bytes, 0)) {}
+            arena &operator=(arena &&other) noexcept{
+                block_size = other.block_size;
+                blocks = std::move(other.blocks);
+                current = std::exchange(other.current, nullptr);
+                block_end = std::exchange(other.block_end, nullptr);
+                used_bytes = std::exchange(other.used_bytes, 0);
+                return *this;
+            }
+
+            void *allocate(std::size_t size, std::size_t alignment){
+                auto const padding = (alignment - reinterpret_cast<std::uintptr_t>(current) % alignment) % alignment;
+                if (current == nullptr or static_cast<std::size_t>(block_end - current) < padding + size)[[unlikely]]
+                    return allocate_in_new_block(size, alignment);
+                auto const result = current + padding;
+                current = result + size;
+                used_bytes += size;
+                return result;
+            }
+
+            template<class T, class... A>
+            T *make(A &&...args){
+                static_assert(std::is_trivially_destructible_v<T>, "arena objects are never destroyed");
+                return ::new (allocate(sizeof(T), alignof(T))) T{std::forward<A>(args)...};
+            }
+
+            // copies the objects into the arena
+            template<class T>
+            std::span<T> copy(std::span<T const> objects){
+                static_assert(std::is_trivially_destructible_v<T>, "arena objects are never destroyed");
+                if (objects.empty())
+                    return {};
+                auto const storage = static_cast<T *>(allocate(sizeof(T) * objects.size(), alignof(T)));
+                std::uninitialized_copy(objects.begin(), objects.end(), storage);
+                return {storage, objects.size()};
+            }
+
+            template<class T>
+            std::span<T> copy(std::vector<T> const &objects){
+                return copy(std::span<T const>{objects});
+            }
+
+            // takes over all blocks of the other arena; objects in it stay where they are
+            void absorb(arena &&other){
+                blocks.insert(blocks.end(), std::make_move_iterator(other.blocks.begin()), std::make_move_iterator(other.blocks.end()));
+                used_bytes += other.used_bytes;
+                other.blocks.clear();
+                other.current = other.block_end = nullptr;
+                other.used_bytes = 0;
+            }
+
+            std::size_t bytes_used() const{
+                return used_bytes;
+            }
+
+            std::size_t blocks_amount() const{
+                return blocks.size();
+            }
+
+        private:
+            void *allocate_in_new_block(std::size_t size, std::size_t alignment){
+                auto const new_block_size = std::max(block_size, size + alignment);
+                blocks.push_back(std::make_unique_for_overwrite<std::byte[]>(new_block_size));
+                current = blocks.back().get();
+                block_end = current + new_block_size;
+                return allocate(size, alignment);
+            }
+
+            std::size_t block_size;
+            std::vector<std::unique_ptr<std::byte[]>> blocks;
+            std::byte *current = nullptr;
+            std::byte *block_end = nullptr;
+            std::size_t used_bytes = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,494 @@
+#include <map>
+#include <unordered_map>
+#include "utlang_binary_ast.hpp"
+
+using namespace utlang::binary;
+namespace syntax = utlang::syntax;
+
+namespace{
+    struct image_header{
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t root;
+        std::uint32_t text_size;
+        std::uint32_t string_count;
+        std::uint32_t string_bytes_size; // without the padding to a whole word
+        std::uint32_t pool_size;         // in words
+        std::uint32_t node_count;
+        std::uint32_t token_count;
+        std::uint32_t statement_count;
+    };
+
+    constexpr char image_magic[4] = {'U', 'T', 'L', 'B'};
+    constexpr std::size_t node_size = 16;
+    constexpr std::size_t token_size = 12;
+
+    constexpr std::size_t padded(std::size_t bytes){
+        return (bytes + 3) / 4 * 4;
+    }
+
+    constexpr std::uint32_t kind_bit(node_kind kind){
+        return std::uint32_t{1} << static_cast<unsigned>(kind);
+    }
+
+    constexpr std::uint32_t expression_kinds = kind_bit(node_kind::variable) | kind_bit(node_kind::application) | kind_bit(node_kind::match) |
+                                               kind_bit(node_kind::lambda) | kind_bit(node_kind::block);
+    constexpr std::uint32_t pattern_kinds = kind_bit(node_kind::variable) | kind_bit(node_kind::pattern_application);
+    constexpr std::uint32_t type_kinds = kind_bit(node_kind::simple_type) | kind_bit(node_kind::function_type) | kind_bit(node_kind::type_application);
+    constexpr std::uint32_t statement_kinds = kind_bit(node_kind::block) | kind_bit(node_kind::type_definition) | kind_bit(node_kind::variable_definition) |
+                                              kind_bit(node_kind::namespace_definition) | kind_bit(node_kind::import_declaration) |
+                                              kind_bit(node_kind::expression_statement);
+    static_assert(static_cast<std::size_t>(node_kind::kinds_amount) <= 32);
+
+    // nodes are added children first, so that every node comes after the ones it refers to
+    class image_writer{
+        public:
+            explicit image_writer(utlang::symbol_table const &symbols): symbols(symbols) {}
+
+            std::uint32_t add(syntax::Variable const &node){
+                return make(node_kind::variable, name(node.name), node.position);
+            }
+            std::uint32_t add(syntax::Constructor const &node){
+                return make(node_kind::constructor, name(node.name), node.position);
+            }
+            std::uint32_t add(syntax::Expression const &node){
+                return std::visit([this](auto const *alternative){return add(*alternative);}, node.expr);
+            }
+            std::uint32_t add(syntax::Application const &node){
+                return make(node_kind::application, list(node.arguments));
+            }
+            std::uint32_t add(syntax::Lambda const &node){
+                auto const binder = add(node.binder);
+                return make(node_kind::lambda, binder, add(node.body), node.position);
+            }
+            std::uint32_t add(syntax::Case_pattern const &node){
+                return std::visit([this](auto const *alternative){return add(*alternative);}, node.expr);
+            }
+            std::uint32_t add(syntax::Case_pattern_application const &node){
+                auto const constructor = add(node.cons);
+                return make(node_kind::pattern_application, constructor, list(node.args));
+            }
+            std::uint32_t add(syntax::Case const &node){
+                auto const pattern = add(node.match_expr);
+                return make(node_kind::case_, pattern, add(node.result_expr));
+            }
+            std::uint32_t add(syntax::Match const &node){
+                auto const scrutinee = add(node.scrutinee);
+                return make(node_kind::match, scrutinee, list(node.cases), node.position);
+            }
+            std::uint32_t add(syntax::Type const &node){
+                return std::visit([this](auto const *alternative){return alternative ? add(*alternative) : no_node;}, node.type);
+            }
+            std::uint32_t add(syntax::Simple_Type const &node){
+                return make(node_kind::simple_type, name(node.name), node.position);
+            }
+            std::uint32_t add(syntax::Function_Type const &node){
+                auto const argument = add(node.argument_type);
+                return make(node_kind::function_type, argument, add(node.result_type));
+            }
+            std::uint32_t add(syntax::Type_Application const &node){
+                return make(node_kind::type_application, list(node.types));
+            }
+            std::uint32_t add(syntax::Statement const &node){
+                return std::visit([this](auto const *alternative){return add_statement(*alternative);}, node.st);
+            }
+            std::uint32_t add(syntax::Block const &node){
+                return make(node_kind::block, list(node.statement_list), node.position);
+            }
+            std::uint32_t add(syntax::Constructor_definition const &node){
+                auto const constructor = add(node.name);
+                return make(node_kind::constructor_definition, constructor, list(node.field_types));
+            }
+
+            std::string finish(std::uint32_t root, std::span<const utlang::tokenisation::token> tokens, std::string_view text,
+                               std::vector<std::uint32_t> const &statement_positions) const{
+                auto const header = image_header{.magic = {image_magic[0], image_magic[1], image_magic[2], image_magic[3]}, .version = format_version,
+                                                 .root = root, .text_size = static_cast<std::uint32_t>(text.size()),
+                                                 .string_count = static_cast<std::uint32_t>(string_offsets.size() - 1),
+                                                 .string_bytes_size = static_cast<std::uint32_t>(string_bytes.size()),
+                                                 .pool_size = static_cast<std::uint32_t>(pool.size()), .node_count = static_cast<std::uint32_t>(nodes.size() / 4),
+                                                 .token_count = static_cast<std::uint32_t>(tokens.size()),
+                                                 .statement_count = static_cast<std::uint32_t>(statement_positions.size())};
+                auto image = std::string{};
+                image.reserve(sizeof header + 4 * (string_offsets.size() + pool.size() + nodes.size() + 3 * tokens.size() + statement_positions.size()) +
+                              padded(string_bytes.size()));
+                image.append(reinterpret_cast<char const *>(&header), sizeof header);
+                append(image, string_offsets);
+                image += string_bytes;
+                image.append(padded(string_bytes.size()) - string_bytes.size(), '\0');
+                append(image, pool);
+                append(image, nodes);
+                auto token_words = std::vector<std::uint32_t>{};
+                token_words.reserve(3 * tokens.size());
+                for (auto const &t: tokens){
+                    token_words.push_back(static_cast<std::uint32_t>(t.token_value().data() - text.data()));
+                    token_words.push_back(static_cast<std::uint32_t>(t.token_value().size()));
+                    token_words.push_back(t.kind_set());
+                }
+                append(image, token_words);
+                append(image, statement_positions);
+                return image;
+            }
+
+        private:
+            static void append(std::string &image, std::vector<std::uint32_t> const &words){
+                image.append(reinterpret_cast<char const *>(words.data()), 4 * words.size());
+            }
+
+            std::uint32_t make(node_kind kind, std::uint32_t a = 0, std::uint32_t b = 0, std::uint32_t c = 0){
+                nodes.insert(nodes.end(), {static_cast<std::uint32_t>(kind), a, b, c});
+                return static_cast<std::uint32_t>(nodes.size() / 4 - 1);
+            }
+
+            template<class T>
+            std::uint32_t list(node_list<T> elements){
+                auto indices = std::vector<std::uint32_t>{};
+                indices.reserve(elements.size());
+                for (auto const &element: elements)
+                    indices.push_back(add(element));
+                auto const reference = static_cast<std::uint32_t>(pool.size());
+                pool.push_back(static_cast<std::uint32_t>(indices.size()));
+                pool.insert(pool.end(), indices.begin(), indices.end());
+                return reference;
+            }
+
+            std::uint32_t string(utlang::symbol_id id){
+                auto const [found, added] = strings.try_emplace(id, static_cast<std::uint32_t>(string_offsets.size() - 1));
+                if (added){
+                    string_bytes += symbols.name(id);
+                    string_offsets.push_back(static_cast<std::uint32_t>(string_bytes.size()));
+                }
+                return found->second;
+            }
+
+            // the same names are written once
+            std::uint32_t name(syntax::scoped_name_type const &scoped){
+                auto parts = std::vector<std::uint32_t>{};
+                for (auto const part: scoped.parts())
+                    parts.push_back(string(part));
+                auto const [found, added] = names.try_emplace(parts, static_cast<std::uint32_t>(pool.size()));
+                if (added){
+                    pool.push_back(static_cast<std::uint32_t>(parts.size()));
+                    pool.insert(pool.end(), parts.begin(), parts.end());
+                }
+                return found->second;
+            }
+
+            std::uint32_t add_statement(syntax::Block const &node){
+                return add(node);
+            }
+            std::uint32_t add_statement(syntax::Type_definition const &node){
+                auto const type = add(node.type);
+                auto const parameters = list(node.parameter_types);
+                return make(node_kind::type_definition, type, parameters, list(node.constructors));
+            }
+            std::uint32_t add_statement(syntax::Variable_definition const &node){
+                auto const variable = add(node.name);
+                auto const type = add(node.type);
+                return make(node_kind::variable_definition, variable, type, add(node.value));
+            }
+            std::uint32_t add_statement(syntax::Namespace_definition const &node){
+                auto const name = string(node.name);
+                return make(node_kind::namespace_definition, name, add(node.content));
+            }
+            std::uint32_t add_statement(syntax::Import_declaration const &node){
+                return make(node_kind::import_declaration, name(node.module));
+            }
+            std::uint32_t add_statement(syntax::Expression const &node){
+                return make(node_kind::expression_statement, add(node));
+            }
+
+            utlang::symbol_table const &symbols;
+            std::unordered_map<utlang::symbol_id, std::uint32_t> strings;
+            std::vector<std::uint32_t> string_offsets{0};
+            std::string string_bytes;
+            std::map<std::vector<std::uint32_t>, std::uint32_t> names;
+            std::vector<std::uint32_t> pool;
+            std::vector<std::uint32_t> nodes; // four words each
+    };
+
+    // fields are read in braced initialisers, which (unlike function arguments) are evaluated in order
+    class tree_reader{
+        public:
+            tree_reader(program_view const &program, utlang::arena &nodes, utlang::symbol_table &symbols): program(program), nodes(nodes){
+                ids.reserve(program.string_count());
+                for (std::uint32_t i = 0; i < program.string_count(); ++i)
+                    ids.push_back(symbols.intern(program.string(i)));
+            }
+
+            syntax::Block block(std::uint32_t node){
+                return syntax::Block{list(field(node, 0), &tree_reader::statement), field(node, 1)};
+            }
+
+        private:
+            std::uint32_t field(std::uint32_t node, std::size_t i) const{
+                return program.field(node, i);
+            }
+
+            template<class T>
+            node_list<T> list(std::uint32_t reference, T (tree_reader::*element)(std::uint32_t)){
+                auto const size = program.pool(reference, 0);
+                auto elements = std::vector<T>{};
+                elements.reserve(size);
+                for (std::size_t i = 0; i < size; ++i)
+                    elements.push_back((this->*element)(program.pool(reference, i + 1)));
+                return nodes.copy(elements);
+            }
+
+            syntax::scoped_name_type name(std::uint32_t reference){
+                auto parts = std::vector<utlang::symbol_id>(program.pool(reference, 0));
+                for (std::size_t i = 0; i < parts.size(); ++i)
+                    parts[i] = ids[program.pool(reference, i + 1)];
+                return syntax::scoped_name_type{parts, nodes};
+            }
+
+            syntax::Variable variable(std::uint32_t node){
+                return syntax::Variable{name(field(node, 0)), field(node, 1)};
+            }
+            syntax::Constructor constructor(std::uint32_t node){
+                return syntax::Constructor{name(field(node, 0)), field(node, 1)};
+            }
+            syntax::Simple_Type simple_type(std::uint32_t node){
+                return syntax::Simple_Type{name(field(node, 0)), field(node, 1)};
+            }
+
+            syntax::Expression expression(std::uint32_t node){
+                switch (program.kind(node)){
+                    case node_kind::variable:
+                        return syntax::Expression{nodes.make<syntax::Variable>(variable(node))};
+                    case node_kind::application:
+                        return syntax::Expression{nodes.make<syntax::Application>(list(field(node, 0), &tree_reader::expression))};
+                    case node_kind::match:
+                        return syntax::Expression{nodes.make<syntax::Match>(syntax::Match{expression(field(node, 0)), list(field(node, 1), &tree_reader::case_),
+                                                                                          field(node, 2)})};
+                    case node_kind::lambda:
+                        return syntax::Expression{nodes.make<syntax::Lambda>(syntax::Lambda{variable(field(node, 0)), expression(field(node, 1)), field(node, 2)})};
+                    default:
+                        return syntax::Expression{nodes.make<syntax::Block>(block(node))};
+                }
+            }
+
+            syntax::Case_pattern pattern(std::uint32_t node){
+                if (program.kind(node) == node_kind::variable)
+                    return syntax::Case_pattern{nodes.make<syntax::Variable>(variable(node))};
+                return syntax::Case_pattern{nodes.make<syntax::Case_pattern_application>(
+                    syntax::Case_pattern_application{constructor(field(node, 0)), list(field(node, 1), &tree_reader::pattern)})};
+            }
+
+            syntax::Case case_(std::uint32_t node){
+                return syntax::Case{pattern(field(node, 0)), expression(field(node, 1))};
+            }
+
+            syntax::Type type(std::uint32_t node){
+                switch (program.kind(node)){
+                    case node_kind::simple_type:
+                        return syntax::Type{nodes.make<syntax::Simple_Type>(simple_type(node))};
+                    case node_kind::function_type:
+                        return syntax::Type{nodes.make<syntax::Function_Type>(syntax::Function_Type{type(field(node, 0)), type(field(node, 1))})};
+                    default:
+                        return syntax::Type{nodes.make<syntax::Type_Application>(list(field(node, 0), &tree_reader::type))};
+                }
+            }
+
+            syntax::Constructor_definition constructor_definition(std::uint32_t node){
+                return syntax::Constructor_definition{constructor(field(node, 0)), list(field(node, 1), &tree_reader::type)};
+            }
+
+            syntax::Statement statement(std::uint32_t node){
+                switch (program.kind(node)){
+                    case node_kind::block:
+                        return syntax::Statement{nodes.make<syntax::Block>(block(node))};
+                    case node_kind::type_definition:
+                        return syntax::Statement{nodes.make<syntax::Type_definition>(syntax::Type_definition{
+                            simple_type(field(node, 0)), list(field(node, 1), &tree_reader::simple_type), list(field(node, 2), &tree_reader::constructor_definition)})};
+                    case node_kind::variable_definition:
+                        return syntax::Statement{nodes.make<syntax::Variable_definition>(syntax::Variable_definition{
+                            variable(field(node, 0)), field(node, 1) == no_node ? syntax::Type{static_cast<syntax::Simple_Type *>(nullptr)} : type(field(node, 1)),
+                            expression(field(node, 2))})};
+                    case node_kind::namespace_definition:
+                        return syntax::Statement{nodes.make<syntax::Namespace_definition>(syntax::Namespace_definition{ids[field(node, 0)], block(field(node, 1))})};
+                    case node_kind::import_declaration:
+                        return syntax::Statement{nodes.make<syntax::Import_declaration>(name(field(node, 0)))};
+                    default:
+                        return syntax::Statement{nodes.make<syntax::Expression>(expression(field(node, 0)))};
+                }
+            }
+
+            program_view const &program;
+            utlang::arena &nodes;
+            std::vector<utlang::symbol_id> ids;
+    };
+}
+
+namespace utlang::binary{
+
+std::string write_program(syntax::Program_AST const &program, std::span<const tokenisation::token> tokens, std::string_view text, symbol_table const &symbols){
+    if (text.size() > UINT32_MAX)
+        throw std::length_error("texts of more than 4 GiB cannot be written");
+    auto writer = image_writer{symbols};
+    auto const root = writer.add(program.code);
+    return writer.finish(root, tokens, text, program.statement_positions);
+}
+
+program_view::program_view(std::string_view image): image(image){
+    auto header = image_header{};
+    if (image.size() < sizeof header)
+        throw format_error("the image is too short");
+    std::memcpy(&header, image.data(), sizeof header);
+    if (std::memcmp(header.magic, image_magic, sizeof image_magic) != 0)
+        throw format_error("not a program image");
+    if (header.version != format_version)
+        throw format_error("program image version " + std::to_string(header.version) + ", expected " + std::to_string(format_version));
+    if (reinterpret_cast<std::uintptr_t>(image.data()) % alignof(std::uint32_t) != 0)
+        throw format_error("the image is not aligned");
+
+    // counts are 32-bit, so none of this overflows
+    auto offset = sizeof header;
+    auto next = [&offset](std::size_t count, std::size_t bytes){
+        auto const result = section{offset, count};
+        offset += padded(bytes);
+        return result;
+    };
+    strings = next(header.string_count, 4 * (std::size_t{header.string_count} + 1));
+    string_bytes = next(header.string_bytes_size, header.string_bytes_size);
+    pool_words = next(header.pool_size, 4 * std::size_t{header.pool_size});
+    nodes = next(header.node_count, node_size * header.node_count);
+    tokens = next(header.token_count, token_size * header.token_count);
+    statements = next(header.statement_count, 4 * std::size_t{header.statement_count});
+    if (offset != image.size())
+        throw format_error("the image is " + std::to_string(image.size()) + " bytes, its sections " + std::to_string(offset));
+    root = header.root;
+    source_size = header.text_size;
+    check();
+}
+
+void program_view::check() const{
+    auto fail = [](std::string const &what){
+        throw format_error("malformed program image: " + what);
+    };
+
+    if (word(strings.offset) != 0 or word(strings.offset + 4 * strings.count) != string_bytes.count)
+        fail("string table");
+    for (std::size_t i = 0; i < strings.count; ++i)
+        if (word(strings.offset + 4 * i) > word(strings.offset + 4 * i + 4))
+            fail("string table");
+
+    auto pool_entry = [&](std::uint32_t reference){
+        if (reference >= pool_words.count or pool(reference, 0) > pool_words.count - reference - 1)
+            fail("pool reference");
+        return pool(reference, 0);
+    };
+    auto check_node = [&](std::uint32_t parent, std::uint32_t node, std::uint32_t kinds){
+        if (node >= parent or (kind_bit(kind(node)) & kinds) == 0)
+            fail("node " + std::to_string(parent) + " refers to node " + std::to_string(node));
+    };
+    auto check_list = [&](std::uint32_t parent, std::uint32_t reference, std::uint32_t kinds){
+        auto const size = pool_entry(reference);
+        for (std::size_t i = 1; i <= size; ++i)
+            check_node(parent, pool(reference, i), kinds);
+    };
+    auto check_string = [&](std::uint32_t string){
+        if (string >= strings.count)
+            fail("string reference");
+    };
+    auto check_name = [&](std::uint32_t reference){
+        auto const size = pool_entry(reference);
+        if (size == 0)
+            fail("empty name");
+        for (std::size_t i = 1; i <= size; ++i)
+            check_string(pool(reference, i));
+    };
+
+    for (std::uint32_t node = 0; node < nodes.count; ++node){
+        auto const f = [&](std::size_t i){return field(node, i);};
+        switch (kind(node)){
+            case node_kind::variable:
+            case node_kind::constructor:
+            case node_kind::simple_type:
+                check_name(f(0));
+                break;
+            case node_kind::application:
+                check_list(node, f(0), expression_kinds);
+                break;
+            case node_kind::match:
+                check_node(node, f(0), expression_kinds);
+                check_list(node, f(1), kind_bit(node_kind::case_));
+                break;
+            case node_kind::lambda:
+                check_node(node, f(0), kind_bit(node_kind::variable));
+                check_node(node, f(1), expression_kinds);
+                break;
+            case node_kind::block:
+                check_list(node, f(0), statement_kinds);
+                break;
+            case node_kind::pattern_application:
+                check_node(node, f(0), kind_bit(node_kind::constructor));
+                check_list(node, f(1), pattern_kinds);
+                break;
+            case node_kind::case_:
+                check_node(node, f(0), pattern_kinds);
+                check_node(node, f(1), expression_kinds);
+                break;
+            case node_kind::function_type:
+                check_node(node, f(0), type_kinds);
+                check_node(node, f(1), type_kinds);
+                break;
+            case node_kind::type_application:
+                check_list(node, f(0), type_kinds);
+                break;
+            case node_kind::type_definition:
+                check_node(node, f(0), kind_bit(node_kind::simple_type));
+                check_list(node, f(1), kind_bit(node_kind::simple_type));
+                check_list(node, f(2), kind_bit(node_kind::constructor_definition));
+                break;
+            case node_kind::variable_definition:
+                check_node(node, f(0), kind_bit(node_kind::variable));
+                if (f(1) != no_node)
+                    check_node(node, f(1), type_kinds);
+                check_node(node, f(2), expression_kinds);
+                break;
+            case node_kind::namespace_definition:
+                check_string(f(0));
+                check_node(node, f(1), kind_bit(node_kind::block));
+                break;
+            case node_kind::import_declaration:
+                check_name(f(0));
+                break;
+            case node_kind::constructor_definition:
+                check_node(node, f(0), kind_bit(node_kind::constructor));
+                check_list(node, f(1), type_kinds);
+                break;
+            case node_kind::expression_statement:
+                check_node(node, f(0), expression_kinds);
+                break;
+            default:
+                fail("node kind " + std::to_string(static_cast<std::uint32_t>(kind(node))));
+        }
+    }
+    check_node(static_cast<std::uint32_t>(nodes.count), root, kind_bit(node_kind::block));
+
+    for (std::size_t i = 0; i < tokens.count; ++i){
+        auto const at = tokens.offset + token_size * i;
+        if (word(at) > source_size or word(at + 4) > source_size - word(at))
+            fail("token " + std::to_string(i));
+    }
+}
+
+std::string scoped_name::to_string() const{
+    auto text = std::string{(*this)[0]};
+    for (std::size_t i = 1; i < size(); ++i)
+        (text += "::") += (*this)[i];
+    return text;
+}
+
+syntax::Program_AST read_program(program_view const &program, symbol_table &symbols){
+    auto tree = syntax::Program_AST{.code = {}, .nodes = std::make_unique<arena>(), .statement_positions = {}};
+    auto reader = tree_reader{program, *tree.nodes, symbols};
+    tree.code = reader.block(program.code().index);
+    tree.statement_positions.reserve(program.statement_count());
+    for (std::size_t i = 0; i < program.statement_count(); ++i)
+        tree.statement_positions.push_back(program.statement_position(i));
+    return tree;
+}
+
+}
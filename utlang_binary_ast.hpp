@@ -0,0 +1,477 @@
+#ifndef UTLANG_BINARY_AST_HPP
+#define UTLANG_BINARY_AST_HPP
+
+#include <span>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <variant>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include "utlang_tokeniser.hpp"
+#include "utlang_syntax_tree_builder.hpp"
+#include "utlang_symbol_table.hpp"
+
+/*
+    A program as one flat image that can be mapped from a file and walked where it lies
+    Sections, all of 32-bit words: the string table (offsets, then the bytes), a pool of lists and scoped names
+    (a length followed by the elements), the node array (a kind and three fields per node), the tokens (offset, length, kinds)
+    and the first token of every top-level statement
+    Nothing in the image is a pointer: nodes refer to nodes and lists by index, so it is valid wherever it is loaded
+    Children come before their parents in the node array, which is what makes the image checkable in one linear pass:
+    program_view checks every index once when it is made, after that the views below never go out of the image
+    The views mirror the nodes of utlang_syntax_tree_builder.hpp, with member functions instead of fields
+*/
+namespace utlang::binary{
+
+    struct format_error: std::runtime_error{
+        using std::runtime_error::runtime_error;
+    };
+
+    enum class node_kind: std::uint32_t{
+        // the fields of each kind
+        variable,               // name, position
+        application,            // arguments
+        match,                  // scrutinee, cases, position
+        lambda,                 // binder, body, position
+        block,                  // statements, position
+        constructor,            // name, position
+        pattern_application,    // constructor, patterns
+        case_,                  // pattern, result
+        simple_type,            // name, position
+        function_type,          // argument, result
+        type_application,       // types
+        type_definition,        // type, parameters, constructors
+        variable_definition,    // name, type (or no_node), value
+        namespace_definition,   // name (a string), content
+        import_declaration,     // module
+        constructor_definition, // constructor, field types
+        expression_statement,   // expression
+        kinds_amount
+    };
+
+    inline constexpr std::uint32_t format_version = 1;
+    inline constexpr std::uint32_t no_node = UINT32_MAX;
+
+    // the image of a program; tokens are left out if empty, they refer to `text`
+    std::string write_program(syntax::Program_AST const &program, std::span<const tokenisation::token> tokens, std::string_view text,
+                              symbol_table const &symbols = symbol_table::global());
+
+    class program_view;
+
+    class scoped_name{
+        public:
+            scoped_name(program_view const *program, std::uint32_t reference): program(program), reference(reference) {}
+
+            std::size_t size() const;
+            std::string_view operator[](std::size_t i) const;
+            std::string to_string() const; // ns1::ns2::name
+
+        private:
+            program_view const *program;
+            std::uint32_t reference;
+    };
+
+    // a list of nodes of one kind of view
+    template<class T>
+    class node_span{
+        public:
+            class iterator{
+                public:
+                    iterator(node_span const *list, std::size_t i): list(list), i(i) {}
+                    T operator*() const{
+                        return (*list)[i];
+                    }
+                    iterator &operator++(){
+                        ++i;
+                        return *this;
+                    }
+                    friend bool operator==(iterator const &, iterator const &) = default;
+
+                private:
+                    node_span const *list;
+                    std::size_t i;
+            };
+
+            node_span(program_view const *program, std::uint32_t reference): program(program), reference(reference) {}
+
+            std::size_t size() const;
+            T operator[](std::size_t i) const;
+
+            iterator begin() const{
+                return {this, 0};
+            }
+            iterator end() const{
+                return {this, size()};
+            }
+
+        private:
+            program_view const *program;
+            std::uint32_t reference;
+    };
+
+    struct node_view{
+        program_view const *program;
+        std::uint32_t index;
+
+        node_kind kind() const;
+
+        protected:
+            std::uint32_t field(std::size_t i) const;
+    };
+
+    struct Variable;
+    struct Application;
+    struct Match;
+    struct Lambda;
+    struct Block;
+    struct Case_pattern_application;
+    struct Simple_Type;
+    struct Function_Type;
+    struct Type_Application;
+    struct Type_definition;
+    struct Variable_definition;
+    struct Namespace_definition;
+    struct Import_declaration;
+
+    struct Expression: node_view{
+        std::variant<Variable, Application, Match, Lambda, Block> expr() const;
+    };
+
+    struct Variable: node_view{
+        scoped_name name() const;
+        syntax::source_position position() const;
+    };
+
+    struct Constructor: node_view{
+        scoped_name name() const;
+        syntax::source_position position() const;
+    };
+
+    struct Application: node_view{
+        node_span<Expression> arguments() const;
+    };
+
+    struct Lambda: node_view{
+        Variable binder() const;
+        Expression body() const;
+        syntax::source_position position() const;
+    };
+
+    struct Case_pattern: node_view{
+        std::variant<Variable, Case_pattern_application> expr() const;
+    };
+
+    struct Case_pattern_application: node_view{
+        Constructor cons() const;
+        node_span<Case_pattern> args() const;
+    };
+
+    struct Case: node_view{
+        Case_pattern match_expr() const;
+        Expression result_expr() const;
+    };
+
+    struct Match: node_view{
+        Expression scrutinee() const;
+        node_span<Case> cases() const;
+        syntax::source_position position() const;
+    };
+
+    struct Type: node_view{
+        std::variant<Simple_Type, Function_Type, Type_Application> type() const;
+    };
+
+    struct Simple_Type: node_view{
+        scoped_name name() const;
+        syntax::source_position position() const;
+    };
+
+    struct Function_Type: node_view{
+        Type argument_type() const;
+        Type result_type() const;
+    };
+
+    struct Type_Application: node_view{
+        node_span<Type> types() const;
+    };
+
+    struct Statement: node_view{
+        std::variant<Block, Type_definition, Variable_definition, Namespace_definition, Import_declaration, Expression> st() const;
+    };
+
+    struct Block: node_view{
+        node_span<Statement> statement_list() const;
+        syntax::source_position position() const;
+    };
+
+    struct Constructor_definition: node_view{
+        Constructor name() const;
+        node_span<Type> field_types() const;
+    };
+
+    struct Type_definition: node_view{
+        Simple_Type type() const;
+        node_span<Simple_Type> parameter_types() const;
+        node_span<Constructor_definition> constructors() const;
+    };
+
+    struct Variable_definition: node_view{
+        Variable name() const;
+        std::optional<Type> type() const; // none when there is no annotation
+        Expression value() const;
+    };
+
+    struct Namespace_definition: node_view{
+        std::string_view name() const;
+        Block content() const;
+    };
+
+    struct Import_declaration: node_view{
+        scoped_name module() const;
+    };
+
+    class program_view{
+        public:
+            // checks the whole image; throws format_error if it is not one written by write_program()
+            // the image is not copied and must outlive the view and everything taken from it
+            explicit program_view(std::string_view image);
+
+            Block code() const{
+                return Block{{this, root}};
+            }
+
+            std::size_t statement_count() const{
+                return statements.count;
+            }
+            // like Program_AST::statement_positions
+            std::uint32_t statement_position(std::size_t i) const{
+                return word(statements.offset + 4 * i);
+            }
+
+            std::size_t token_count() const{
+                return tokens.count;
+            }
+            // the text the tokens were made from
+            std::size_t text_size() const{
+                return source_size;
+            }
+            tokenisation::token token(std::size_t i, std::string_view text) const{
+                auto const at = tokens.offset + 12 * i;
+                return tokenisation::token{text.substr(word(at), word(at + 4)), word(at + 8)};
+            }
+
+            std::size_t node_count() const{
+                return nodes.count;
+            }
+            std::size_t string_count() const{
+                return strings.count;
+            }
+            std::string_view string(std::uint32_t i) const{
+                auto const begin = word(strings.offset + 4 * i);
+                return image.substr(string_bytes.offset + begin, word(strings.offset + 4 * i + 4) - begin);
+            }
+
+            std::size_t image_size() const{
+                return image.size();
+            }
+
+            // for the views
+            node_kind kind(std::uint32_t node) const{
+                return static_cast<node_kind>(word(nodes.offset + 16 * std::size_t{node}));
+            }
+            std::uint32_t field(std::uint32_t node, std::size_t i) const{
+                return word(nodes.offset + 16 * std::size_t{node} + 4 + 4 * i);
+            }
+            // the length of the pool entry at reference, then its elements
+            std::uint32_t pool(std::uint32_t reference, std::size_t i) const{
+                return word(pool_words.offset + 4 * (std::size_t{reference} + i));
+            }
+
+        private:
+            struct section{
+                std::size_t offset = 0; // in bytes
+                std::size_t count = 0;  // of entries
+            };
+
+            std::uint32_t word(std::size_t offset) const{
+                auto value = std::uint32_t{};
+                std::memcpy(&value, image.data() + offset, sizeof value);
+                return value;
+            }
+
+            void check() const;
+
+            std::string_view image;
+            section strings, string_bytes, pool_words, nodes, tokens, statements;
+            std::uint32_t root = 0;
+            std::size_t source_size = 0;
+    };
+
+    // builds the tree again, for the passes that work on syntax trees; names are interned in `symbols`
+    syntax::Program_AST read_program(program_view const &program, symbol_table &symbols = symbol_table::global());
+
+    inline std::size_t scoped_name::size() const{
+        return program->pool(reference, 0);
+    }
+    inline std::string_view scoped_name::operator[](std::size_t i) const{
+        return program->string(program->pool(reference, i + 1));
+    }
+
+    template<class T>
+    std::size_t node_span<T>::size() const{
+        return program->pool(reference, 0);
+    }
+    template<class T>
+    T node_span<T>::operator[](std::size_t i) const{
+        return T{{program, program->pool(reference, i + 1)}};
+    }
+
+    inline node_kind node_view::kind() const{
+        return program->kind(index);
+    }
+    inline std::uint32_t node_view::field(std::size_t i) const{
+        return program->field(index, i);
+    }
+
+    inline scoped_name Variable::name() const{
+        return {program, field(0)};
+    }
+    inline syntax::source_position Variable::position() const{
+        return field(1);
+    }
+    inline scoped_name Constructor::name() const{
+        return {program, field(0)};
+    }
+    inline syntax::source_position Constructor::position() const{
+        return field(1);
+    }
+    inline node_span<Expression> Application::arguments() const{
+        return {program, field(0)};
+    }
+    inline Variable Lambda::binder() const{
+        return {{program, field(0)}};
+    }
+    inline Expression Lambda::body() const{
+        return {{program, field(1)}};
+    }
+    inline syntax::source_position Lambda::position() const{
+        return field(2);
+    }
+    inline Constructor Case_pattern_application::cons() const{
+        return {{program, field(0)}};
+    }
+    inline node_span<Case_pattern> Case_pattern_application::args() const{
+        return {program, field(1)};
+    }
+    inline Case_pattern Case::match_expr() const{
+        return {{program, field(0)}};
+    }
+    inline Expression Case::result_expr() const{
+        return {{program, field(1)}};
+    }
+    inline Expression Match::scrutinee() const{
+        return {{program, field(0)}};
+    }
+    inline node_span<Case> Match::cases() const{
+        return {program, field(1)};
+    }
+    inline syntax::source_position Match::position() const{
+        return field(2);
+    }
+    inline scoped_name Simple_Type::name() const{
+        return {program, field(0)};
+    }
+    inline syntax::source_position Simple_Type::position() const{
+        return field(1);
+    }
+    inline Type Function_Type::argument_type() const{
+        return {{program, field(0)}};
+    }
+    inline Type Function_Type::result_type() const{
+        return {{program, field(1)}};
+    }
+    inline node_span<Type> Type_Application::types() const{
+        return {program, field(0)};
+    }
+    inline node_span<Statement> Block::statement_list() const{
+        return {program, field(0)};
+    }
+    inline syntax::source_position Block::position() const{
+        return field(1);
+    }
+    inline Constructor Constructor_definition::name() const{
+        return {{program, field(0)}};
+    }
+    inline node_span<Type> Constructor_definition::field_types() const{
+        return {program, field(1)};
+    }
+    inline Simple_Type Type_definition::type() const{
+        return {{program, field(0)}};
+    }
+    inline node_span<Simple_Type> Type_definition::parameter_types() const{
+        return {program, field(1)};
+    }
+    inline node_span<Constructor_definition> Type_definition::constructors() const{
+        return {program, field(2)};
+    }
+    inline Variable Variable_definition::name() const{
+        return {{program, field(0)}};
+    }
+    inline std::optional<Type> Variable_definition::type() const{
+        if (field(1) == no_node)
+            return std::nullopt;
+        return Type{{program, field(1)}};
+    }
+    inline Expression Variable_definition::value() const{
+        return {{program, field(2)}};
+    }
+    inline std::string_view Namespace_definition::name() const{
+        return program->string(field(0));
+    }
+    inline Block Namespace_definition::content() const{
+        return {{program, field(1)}};
+    }
+    inline scoped_name Import_declaration::module() const{
+        return {program, field(0)};
+    }
+
+    inline std::variant<Variable, Application, Match, Lambda, Block> Expression::expr() const{
+        switch (kind()){
+            case node_kind::variable: return Variable{*this};
+            case node_kind::application: return Application{*this};
+            case node_kind::match: return Match{*this};
+            case node_kind::lambda: return Lambda{*this};
+            default: return Block{*this}; // checked by program_view
+        }
+    }
+
+    inline std::variant<Variable, Case_pattern_application> Case_pattern::expr() const{
+        if (kind() == node_kind::variable)
+            return Variable{*this};
+        return Case_pattern_application{*this};
+    }
+
+    inline std::variant<Simple_Type, Function_Type, Type_Application> Type::type() const{
+        switch (kind()){
+            case node_kind::simple_type: return Simple_Type{*this};
+            case node_kind::function_type: return Function_Type{*this};
+            default: return Type_Application{*this};
+        }
+    }
+
+    inline std::variant<Block, Type_definition, Variable_definition, Namespace_definition, Import_declaration, Expression> Statement::st() const{
+        switch (kind()){
+            case node_kind::block: return Block{*this};
+            case node_kind::type_definition: return Type_definition{*this};
+            case node_kind::variable_definition: return Variable_definition{*this};
+            case node_kind::namespace_definition: return Namespace_definition{*this};
+            case node_kind::import_declaration: return Import_declaration{*this};
+            default: return Expression{{program, field(0)}}; // an expression_statement
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,182 @@
+#include <bit>
+#include <chrono>
+#include <random>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <system_error>
+#include "utlang_build_cache.hpp"
+#include "utlang_binary_ast.hpp"
+#include "utlang_source_buffer.hpp"
+
+namespace{
+    constexpr char entry_magic[4] = {'U', 'T', 'L', 'C'};
+    // written and read as it is: entries are native to the machine that wrote them
+    // the payload is the image of the tokens and the tree (see utlang_binary_ast.hpp)
+    struct entry_header{
+        char magic[4];
+        std::uint32_t version;
+        utlang::cache::content_key key;
+        std::uint64_t text_size;
+        std::uint64_t payload_size;
+        std::uint64_t payload_checksum;
+    };
+
+    std::uint64_t final_mix(std::uint64_t k){
+        k ^= k >> 33;
+        k *= 0xFF51AFD7ED558CCD;
+        k ^= k >> 33;
+        k *= 0xC4CEB9FE1A85EC53;
+        k ^= k >> 33;
+        return k;
+    }
+
+    std::string hexadecimal(utlang::cache::content_key key){
+        constexpr char digits[] = "0123456789abcdef";
+        auto text = std::string(32, '0');
+        for (int i = 0; i < 16; ++i){
+            text[15 - i] = digits[(key.high >> (4 * i)) & 0xF];
+            text[31 - i] = digits[(key.low >> (4 * i)) & 0xF];
+        }
+        return text;
+    }
+}
+
+namespace utlang::cache{
+
+content_key hash_content(std::string_view text){
+    constexpr std::uint64_t c1 = 0x87C37B91114253D5, c2 = 0x4CF5AD432745937F;
+    std::uint64_t h1 = 0, h2 = 0;
+    auto mix_block = [&](char const *block){
+        std::uint64_t k1, k2;
+        std::memcpy(&k1, block, sizeof k1);
+        std::memcpy(&k2, block + sizeof k1, sizeof k2);
+        h1 ^= std::rotl(k1 * c1, 31) * c2;
+        h1 = (std::rotl(h1, 27) + h2) * 5 + 0x52DCE729;
+        h2 ^= std::rotl(k2 * c2, 33) * c1;
+        h2 = (std::rotl(h2, 31) + h1) * 5 + 0x38495AB5;
+    };
+    auto const whole_blocks = text.size() / 16 * 16;
+    for (std::size_t i = 0; i < whole_blocks; i += 16)
+        mix_block(text.data() + i);
+    // the tail is padded with zeros; the length, mixed in below, tells it from a text that has them
+    char tail[16] = {};
+    std::memcpy(tail, text.data() + whole_blocks, text.size() - whole_blocks);
+    mix_block(tail);
+
+    h1 ^= text.size();
+    h2 ^= text.size();
+    h1 += h2;
+    h2 += h1;
+    h1 = final_mix(h1);
+    h2 = final_mix(h2);
+    h1 += h2;
+    h2 += h1;
+    return content_key{.low = h1, .high = h2};
+}
+
+build_cache::build_cache(std::filesystem::path directory, std::uintmax_t capacity_bytes):
+    path(std::move(directory)), capacity(capacity_bytes), process_tag(std::random_device{}() * 0x100000001B3ull ^ std::random_device{}()){
+    auto error = std::error_code{};
+    std::filesystem::create_directories(path, error);
+}
+
+std::filesystem::path build_cache::entry_path(content_key key) const{
+    return path / (hexadecimal(key) + ".utlc");
+}
+
+std::optional<cached_file> build_cache::load(content_key key, std::string_view text, symbol_table &symbols) const{
+    auto const entry_name = entry_path(key);
+    try{
+        auto const entry = source_buffer{entry_name.string()};
+        auto const bytes = entry.text();
+        auto header = entry_header{};
+        if (bytes.size() < sizeof header)
+            return std::nullopt;
+        std::memcpy(&header, bytes.data(), sizeof header);
+        auto const payload = bytes.substr(sizeof header);
+        if (std::memcmp(header.magic, entry_magic, sizeof entry_magic) != 0 or header.version != format_version or header.key != key or
+            header.text_size != text.size() or header.payload_size != payload.size() or header.payload_checksum != hash_content(payload).low)
+            return std::nullopt;
+
+        auto const image = binary::program_view{payload};
+        if (image.text_size() != text.size())
+            return std::nullopt;
+        auto result = cached_file{.tokens = {}, .tree = binary::read_program(image, symbols)};
+        result.tokens.reserve(image.token_count());
+        for (std::size_t i = 0; i < image.token_count(); ++i)
+            result.tokens.push_back(image.token(i, text));
+
+        auto error = std::error_code{};
+        std::filesystem::last_write_time(entry_name, std::filesystem::file_time_type::clock::now(), error);
+        return result;
+    }catch(std::system_error const &){ // no such entry, or it was removed before it could be opened
+        return std::nullopt;
+    }catch(binary::format_error const &){
+        return std::nullopt;
+    }
+}
+
+void build_cache::store(content_key key, std::string_view text, std::vector<tokenisation::token> const &tokens, syntax::Program_AST const &tree,
+                        symbol_table const &symbols){
+    if (text.size() > UINT32_MAX) // offsets in images are 32-bit
+        return;
+    auto const payload = binary::write_program(tree, tokens, text, symbols);
+    auto header = entry_header{.magic = {}, .version = format_version, .key = key, .text_size = text.size(),
+                               .payload_size = payload.size(), .payload_checksum = hash_content(payload).low};
+    std::memcpy(header.magic, entry_magic, sizeof entry_magic);
+
+    auto const temporary = path / (hexadecimal(key) + '.' + std::to_string(process_tag) + '-' + std::to_string(temporary_files++) + ".tmp");
+    auto error = std::error_code{};
+    {
+        auto file = std::ofstream(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<char const *>(&header), sizeof header);
+        file.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+        file.close();
+        if (not file){
+            std::filesystem::remove(temporary, error);
+            return;
+        }
+    }
+    std::filesystem::rename(temporary, entry_path(key), error);
+    if (error)
+        std::filesystem::remove(temporary, error);
+}
+
+std::size_t build_cache::trim(){
+    struct entry{
+        std::filesystem::path name;
+        std::uintmax_t size;
+        std::filesystem::file_time_type used;
+    };
+    constexpr auto abandoned_after = std::chrono::hours{1}; // a temporary file that old belongs to a process that died
+
+    auto entries = std::vector<entry>{};
+    std::uintmax_t total = 0;
+    std::size_t removed = 0;
+    auto error = std::error_code{};
+    auto const now = std::filesystem::file_time_type::clock::now();
+    for (auto files = std::filesystem::directory_iterator(path, error); not error and files != std::filesystem::directory_iterator{}; files.increment(error)){
+        auto entry_error = std::error_code{};
+        auto const size = files->file_size(entry_error);
+        auto const used = files->last_write_time(entry_error);
+        if (entry_error) // removed by another process in the meantime
+            continue;
+        if (files->path().extension() == ".utlc"){
+            entries.push_back(entry{files->path(), size, used});
+            total += size;
+        }else if (files->path().extension() == ".tmp" and now - used > abandoned_after)
+            removed += std::filesystem::remove(files->path(), entry_error);
+    }
+    std::ranges::sort(entries, {}, &entry::used);
+    for (auto const &old_entry: entries){
+        if (total <= capacity)
+            break;
+        removed += std::filesystem::remove(old_entry.name, error);
+        total -= old_entry.size;
+    }
+    return removed;
+}
+
+}
@@ -0,0 +1,71 @@
+#ifndef UTLANG_BUILD_CACHE_HPP
+#define UTLANG_BUILD_CACHE_HPP
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <optional>
+#include <filesystem>
+#include <string_view>
+#include "utlang_tokeniser.hpp"
+#include "utlang_syntax_tree_builder.hpp"
+#include "utlang_symbol_table.hpp"
+
+/*
+    Tokens and trees of source files kept on disk between runs, found by the hash of the source text
+    Entries are written to a temporary file and renamed into place, so any number of processes may share a directory:
+    a reader sees a whole entry or none, and an entry removed while it is read stays readable until it is closed
+    Every entry starts with the format version, and anything that does not check out (version, hash, length, checksum,
+    the program image in it) is a miss, never an error
+    The directory is kept under its size by removing the least recently used entries; a hit refreshes the entry's time
+*/
+namespace utlang::cache{
+
+    // the name of an entry, and checked again inside it
+    struct content_key{
+        std::uint64_t low = 0;
+        std::uint64_t high = 0;
+
+        friend bool operator==(content_key const &, content_key const &) = default;
+    };
+
+    // 128-bit MurmurHash3
+    content_key hash_content(std::string_view text);
+
+    struct cached_file{
+        std::vector<tokenisation::token> tokens; // views into the text given to load()
+        syntax::Program_AST tree;
+    };
+
+    class build_cache{
+        public:
+            static constexpr std::uint32_t format_version = 2;
+
+            // the directory is made if needed
+            build_cache(std::filesystem::path directory, std::uintmax_t capacity_bytes);
+
+            // names are interned in `symbols`
+            std::optional<cached_file> load(content_key key, std::string_view text, symbol_table &symbols = symbol_table::global()) const;
+
+            // best effort: a cache that cannot be written to only makes no hits
+            void store(content_key key, std::string_view text, std::vector<tokenisation::token> const &tokens, syntax::Program_AST const &tree,
+                       symbol_table const &symbols = symbol_table::global());
+
+            // removes the least recently used entries until the directory fits its capacity; returns how many were removed
+            std::size_t trim();
+
+            std::filesystem::path const &directory() const{
+                return path;
+            }
+
+        private:
+            std::filesystem::path entry_path(content_key key) const;
+
+            std::filesystem::path path;
+            std::uintmax_t capacity;
+            std::uint64_t const process_tag; // tells the temporary files of processes apart
+            std::atomic<std::uint64_t> temporary_files{0};
+    };
+}
+
+#endif
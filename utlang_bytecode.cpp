@@ -0,0 +1,464 @@
+#include <span>
+#include <optional>
+#include <algorithm>
+#include <initializer_list>
+#include "utlang_evaluator.hpp"
+
+/*
+    Lowering of definitions to bytecode, and the stack machine that runs it
+    Definitions are lowered when they are first used; lambdas become functions with flat closures:
+    the variables a lambda uses from outside are copied into the closure when it is created
+*/
+
+using namespace utlang::evaluation;
+using namespace utlang::syntax;
+
+#if defined(__GNUC__)
+    #define UTLANG_COMPUTED_GOTO 1
+#endif
+
+namespace{
+    template<class... F>
+    struct overloaded: F...{
+        using F::operator()...;
+    };
+}
+
+namespace utlang::evaluation{
+
+struct evaluator::function_builder{
+    // a variable of an enclosing function, copied into the closure
+    struct capture_source{
+        bool from_capture; // of the enclosing function, otherwise one of its locals
+        std::uint32_t index;
+        symbol_id name;
+    };
+
+    struct reference{
+        bool is_capture;
+        std::uint32_t index;
+    };
+
+    evaluator &owner;
+    function_builder *parent;
+    std::vector<std::pair<symbol_id, std::uint32_t>> names{}; // locals in scope, the innermost last
+    std::vector<capture_source> captures{};
+    std::vector<std::uint32_t> code{};
+    std::vector<std::uint32_t> jump_targets{}; // positions of operands that are offsets in the function
+    std::uint32_t local_count = 0;
+
+    void emit(opcode op, std::initializer_list<std::uint32_t> operands = {}){
+        code.push_back(static_cast<std::uint32_t>(op));
+        code.insert(code.end(), operands.begin(), operands.end());
+    }
+
+    std::uint32_t here() const{
+        return static_cast<std::uint32_t>(code.size());
+    }
+
+    void emit_jump_target(std::uint32_t target = 0){
+        jump_targets.push_back(here());
+        code.push_back(target);
+    }
+
+    // std::nullopt for globals
+    std::optional<reference> find(symbol_id name){
+        for (auto local = names.rbegin(); local != names.rend(); ++local)
+            if (local->first == name)
+                return reference{false, local->second};
+        for (std::size_t i = 0; i < captures.size(); ++i)
+            if (captures[i].name == name)
+                return reference{true, static_cast<std::uint32_t>(i)};
+        if (not parent)
+            return std::nullopt;
+        auto const outer = parent->find(name);
+        if (not outer)
+            return std::nullopt;
+        captures.push_back(capture_source{outer->is_capture, outer->index, name});
+        return reference{true, static_cast<std::uint32_t>(captures.size() - 1)};
+    }
+
+    global_entry &global(void const *node, scoped_name_type name){
+        return owner.resolve(node, name);
+    }
+
+    void finish_value(bool tail){
+        if (tail)
+            emit(opcode::return_value);
+    }
+
+    void variable(Variable const &v, bool tail){
+        auto const local = v.name.size() == 1 ? find(v.name.back()) : std::nullopt;
+        if (local)
+            emit(local->is_capture ? opcode::load_capture : opcode::load_local, {local->index});
+        else
+            emit(opcode::load_global, {owner.global_index(global(&v, v.name))});
+        finish_value(tail);
+    }
+
+    // C x y with all the fields of C becomes a single construct
+    void application(Application const &a, bool tail){
+        auto const head = std::get_if<Variable *>(&a.arguments.front().expr);
+        auto const arguments = a.arguments.subspan(1);
+        if (head and not ((*head)->name.size() == 1 and find((*head)->name.back()))){
+            auto const &entry = global(*head, (*head)->name);
+            if (not entry.definition and owner.constructors[entry.constructor].arity == arguments.size()){
+                for (auto const argument: arguments)
+                    expression(argument, false);
+                emit(opcode::construct, {entry.constructor, static_cast<std::uint32_t>(arguments.size())});
+                finish_value(tail);
+                return;
+            }
+        }
+        for (auto const argument: a.arguments)
+            expression(argument, false);
+        emit(tail ? opcode::tail_call : opcode::call, {static_cast<std::uint32_t>(arguments.size())});
+    }
+
+    void lambda(Lambda const &l, bool tail){
+        auto inner = function_builder{owner, this};
+        auto const argument = inner.local_count++;
+        if (l.binder.name.back() != owner.ignored_name)
+            inner.names.emplace_back(l.binder.name.back(), argument);
+        inner.expression(l.body, true);
+        auto const function = inner.finish(std::string("\\").append(owner.symbols.name(l.binder.name.back())));
+        for (auto const &c: inner.captures)
+            emit(c.from_capture ? opcode::load_capture : opcode::load_local, {c.index});
+        emit(opcode::make_closure, {function, static_cast<std::uint32_t>(inner.captures.size())});
+        finish_value(tail);
+    }
+
+    // the slots of the decision tree are locals from base on
+    void match(Match const &m, bool tail){
+        auto const &compiled = owner.compile(m);
+        auto const base = local_count;
+        local_count += compiled.slot_count;
+        expression(m.scrutinee, false);
+        emit(opcode::store_local, {base});
+        auto ends = std::vector<std::uint32_t>{};
+        decision(m, compiled, 0, base, tail, ends);
+        for (auto const end: ends)
+            code[end] = here();
+    }
+
+    void decision(Match const &m, compiled_match const &compiled, std::uint32_t index, std::uint32_t base, bool tail, std::vector<std::uint32_t> &ends){
+        auto const node = compiled.nodes[index];
+        switch (node.kind){
+            case decision_node::kind_type::fail:
+                emit(opcode::fail, {base});
+                return;
+            case decision_node::kind_type::leaf:{
+                auto const scope_size = names.size();
+                for (auto const &b: std::span{compiled.bindings}.subspan(node.first, node.count))
+                    names.emplace_back(b.name, base + b.slot);
+                expression(m.cases[node.case_index].result_expr, tail);
+                names.resize(scope_size);
+                if (not tail){
+                    emit(opcode::jump);
+                    ends.push_back(here());
+                    emit_jump_target();
+                }
+                return;
+            }
+            case decision_node::kind_type::test:
+                break;
+        }
+        auto const count = owner.types[node.type].constructors.size();
+        emit(opcode::switch_constructor, {base + node.slot, node.type});
+        auto const table = here();
+        for (std::size_t k = 0; k < count; ++k){
+            code.push_back(base + compiled.branches[node.first + k].first_field_slot);
+            emit_jump_target();
+        }
+        for (std::size_t k = 0; k < count; ++k){
+            code[table + 2 * k + 1] = here();
+            decision(m, compiled, compiled.branches[node.first + k].node, base, tail, ends);
+        }
+    }
+
+    // local definitions are seen by the statements after them; the value is that of the last expression
+    void block(Block const &b, bool tail){
+        auto const statements = b.statement_list;
+        auto const last = std::ranges::find_if(statements.rbegin(), statements.rend(), [](Statement const &s){
+            return std::holds_alternative<Expression *>(s.st);
+        });
+        if (last == statements.rend())
+            throw evaluation_error("block without a value");
+        auto const last_index = static_cast<std::size_t>(statements.rend() - last - 1);
+
+        auto const scope_size = names.size();
+        for (std::size_t i = 0; i < statements.size(); ++i){
+            if (auto const definition = std::get_if<Variable_definition *>(&statements[i].st)){
+                expression((*definition)->value, false);
+                auto const local = local_count++;
+                emit(opcode::store_local, {local});
+                names.emplace_back((*definition)->name.name.back(), local);
+            }else if (auto const e = std::get_if<Expression *>(&statements[i].st)){
+                expression(**e, tail and i + 1 == statements.size());
+                if (i != last_index)
+                    emit(opcode::pop);
+            }else
+                throw evaluation_error("only definitions and expressions can be evaluated in a block");
+        }
+        if (tail and last_index + 1 != statements.size())
+            emit(opcode::return_value);
+        names.resize(scope_size);
+    }
+
+    // leaves one value on the stack, or returns it if tail
+    void expression(Expression e, bool tail){
+        std::visit(overloaded{
+            [&](Variable const *v){ variable(*v, tail); },
+            [&](Application const *a){ application(*a, tail); },
+            [&](Lambda const *l){ lambda(*l, tail); },
+            [&](Match const *m){ match(*m, tail); },
+            [&](Block const *b){ block(*b, tail); }
+        }, e.expr);
+    }
+
+    std::uint32_t finish(std::string name){
+        auto const entry = static_cast<std::uint32_t>(owner.code.size());
+        for (auto const target: jump_targets)
+            code[target] += entry;
+        owner.code.insert(owner.code.end(), code.begin(), code.end());
+        owner.functions.push_back(function_info{entry, local_count, std::move(name)});
+        return static_cast<std::uint32_t>(owner.functions.size() - 1);
+    }
+};
+
+// a function without arguments that computes the definition; no tail call, its frame has to store the result
+std::uint32_t evaluator::lower(global_entry &entry){
+    if (entry.init_function == no_function){
+        auto builder = function_builder{*this, nullptr};
+        builder.expression(entry.definition->value, false);
+        builder.emit(opcode::return_value);
+        entry.init_function = builder.finish(entry.name);
+    }
+    return entry.init_function;
+}
+
+std::uint32_t evaluator::global_index(global_entry &entry){
+    auto const [found, inserted] = global_indices.try_emplace(&entry, static_cast<std::uint32_t>(global_table.size()));
+    if (inserted)
+        global_table.push_back(&entry);
+    return found->second;
+}
+
+#if UTLANG_COMPUTED_GOTO
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+// the stack and the frames are on the heap, so the depth of the recursion is limited by memory, not by the native stack
+value evaluator::execute(global_entry &entry){
+    auto stack = std::vector<value>{};
+    auto frames = std::vector<frame>{};
+    stack.reserve(1024);
+    std::uint32_t const *ip = nullptr;
+    std::uint32_t base = 0;
+    value const *captures = nullptr;
+    auto roots = machine_roots{.stack = &stack, .frames = &frames};
+    auto const running = running_machine{*this, roots};
+
+    auto suspend = [&]{
+        frames.back().pc = static_cast<std::uint32_t>(ip - code.data());
+    };
+    auto resume = [&]{
+        auto const &f = frames.back();
+        ip = code.data() + f.pc;
+        base = f.base;
+        captures = f.closure ? f.closure->captures().data() : nullptr;
+        // only the frame running changes its part of the stack, and itself
+        roots.unchanged_stack = std::min<std::size_t>(roots.unchanged_stack, base);
+        roots.unchanged_frames = std::min(roots.unchanged_frames, frames.size() - 1);
+    };
+    // captures point into a cell, which a collection may move
+    auto safe_point = [&]{
+        if (heap.wants_collection())[[unlikely]]{
+            collect();
+            captures = frames.back().closure ? frames.back().closure->captures().data() : nullptr;
+            roots.unchanged_stack = base;
+            roots.unchanged_frames = frames.size() - 1;
+        }
+    };
+    auto enter = [&](std::uint32_t function, std::uint32_t pending, compiled_closure *closure, global_entry *sets_global){
+        auto const &info = functions[function];
+        frames.push_back(frame{function, info.entry, static_cast<std::uint32_t>(stack.size()), pending, closure, sets_global});
+        stack.resize(stack.size() + info.local_count);
+    };
+    // the arguments are the top argument_count values of the stack; true if a frame was entered, otherwise the result is pushed
+    auto call = [&](value function, std::uint32_t argument_count){
+        for (;;){
+            auto argument = std::move(stack[stack.size() - argument_count]);
+            stack.erase(stack.end() - argument_count);
+            --argument_count;
+            if (auto const closure = function.as<compiled_closure>()){
+                enter(closure->function, argument_count, closure, nullptr);
+                stack[frames.back().base] = std::move(argument);
+                return true;
+            }
+            function = apply(function, std::move(argument));
+            if (argument_count == 0){
+                stack.push_back(std::move(function));
+                return false;
+            }
+        }
+    };
+
+    try{
+        enter(lower(entry), 0, nullptr, nullptr);
+        resume();
+
+#if UTLANG_COMPUTED_GOTO
+        static void *const dispatch_table[] = {
+            &&op_load_local, &&op_load_capture, &&op_load_global, &&op_store_local, &&op_pop, &&op_construct, &&op_make_closure,
+            &&op_call, &&op_tail_call, &&op_return_value, &&op_jump, &&op_switch_constructor, &&op_fail
+        };
+        #define UTLANG_OPCODE(name) op_##name:
+        #define UTLANG_NEXT() goto *dispatch_table[*ip++]
+        UTLANG_NEXT();
+#else
+        #define UTLANG_OPCODE(name) case opcode::name:
+        #define UTLANG_NEXT() goto dispatch
+        dispatch:
+        switch (static_cast<opcode>(*ip++)){
+#endif
+        // every handler is a block of its own: a computed goto out of a scope does not run destructors
+        UTLANG_OPCODE(load_local){
+            stack.push_back(stack[base + ip[0]]);
+            ip += 1;
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(load_capture){
+            stack.push_back(captures[ip[0]]);
+            ip += 1;
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(load_global){
+            auto &global = *global_table[ip[0]];
+            ip += 1;
+            if (global.state == global_state::evaluated)
+                stack.push_back(global.cached);
+            else if (not global.definition)
+                stack.push_back(force(global));
+            else if (global.state == global_state::evaluating)
+                throw evaluation_error(global.name + " depends on its own value");
+            else{
+                suspend();
+                auto const function = lower(global); // code may grow
+                global.state = global_state::evaluating;
+                enter(function, 0, nullptr, &global);
+                resume();
+            }
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(store_local){
+            stack[base + ip[0]] = std::move(stack.back());
+            stack.pop_back();
+            ip += 1;
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(pop){
+            stack.pop_back();
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(construct){
+            // S n of a natural-shaped type is an increment in place
+            if (auto &top = stack.back(); top.is_natural() and constructors[ip[0]].role == constructor_role::successor and top.number().type == constructors[ip[0]].type){
+                top = natural{top.number().type, top.number().count + 1};
+                ip += 2;
+                UTLANG_NEXT();
+            }
+            safe_point();
+            auto const field_count = ip[1];
+            auto const made = complete_constructor(ip[0], std::span{stack}.last(field_count));
+            stack.resize(stack.size() - field_count);
+            stack.push_back(made);
+            ip += 2;
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(make_closure){
+            safe_point();
+            auto const capture_count = ip[1];
+            auto const closure = heap.make_compiled_closure(ip[0], std::span{stack}.last(capture_count));
+            stack.resize(stack.size() - capture_count);
+            stack.push_back(closure);
+            ip += 2;
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(call){
+            safe_point();
+            auto const argument_count = ip[0];
+            ip += 1;
+            auto function = std::move(stack[stack.size() - argument_count - 1]);
+            stack.erase(stack.end() - argument_count - 1);
+            suspend();
+            call(std::move(function), argument_count);
+            resume(); // also when the result was pushed: what apply() evaluated may have collected
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(tail_call){
+            // the arguments replace the frame, in front of the arguments it leaves for its result
+            safe_point();
+            auto const argument_count = ip[0];
+            auto const finished = std::move(frames.back());
+            frames.pop_back();
+            auto function = std::move(stack[stack.size() - argument_count - 1]);
+            std::move(stack.end() - argument_count, stack.end(), stack.begin() + finished.base);
+            stack.resize(finished.base + argument_count);
+            std::rotate(stack.end() - argument_count - finished.pending, stack.end() - argument_count, stack.end());
+            call(std::move(function), argument_count + finished.pending);
+            resume();
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(return_value){
+            auto result = std::move(stack.back());
+            auto const finished = std::move(frames.back());
+            frames.pop_back();
+            stack.resize(finished.base);
+            if (finished.sets_global){
+                finished.sets_global->cached = result;
+                finished.sets_global->state = global_state::evaluated;
+            }
+            if (frames.empty())
+                return result;
+            if (finished.pending == 0)
+                stack.push_back(std::move(result));
+            else
+                call(std::move(result), finished.pending);
+            resume();
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(jump){
+            ip = code.data() + ip[0];
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(switch_constructor){
+            auto const &tested = stack[base + ip[0]];
+            auto const branch = ip + 2 + 2 * constructor_index(tested, ip[1]);
+            unpack_fields(tested, &stack[base + branch[0]]);
+            ip = code.data() + branch[1];
+        }
+        UTLANG_NEXT();
+        UTLANG_OPCODE(fail){
+            throw evaluation_error("no case matches " + to_string(stack[base + ip[0]]));
+        }
+#if not UTLANG_COMPUTED_GOTO
+        }
+#endif
+        #undef UTLANG_OPCODE
+        #undef UTLANG_NEXT
+    }catch(...){
+        for (auto const &f: frames)
+            if (f.sets_global)
+                f.sets_global->state = global_state::unevaluated;
+        throw;
+    }
+    return value{}; // not reached
+}
+
+#if UTLANG_COMPUTED_GOTO
+    #pragma GCC diagnostic pop
+#endif
+
+}
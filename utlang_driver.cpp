@@ -0,0 +1,439 @@
+#include <deque>
+#include <mutex>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <optional>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <unordered_map>
+#include <condition_variable>
+#include "utlang_driver.hpp"
+#include "utlang_source_buffer.hpp"
+#include "utlang_syntax_tree_builder.hpp"
+#include "utlang_type_checker.hpp"
+#include "utlang_binary_ast.hpp"
+
+using namespace utlang::driver;
+
+namespace{
+    using clock_type = std::chrono::steady_clock;
+
+    double seconds_since(clock_type::time_point start){
+        return std::chrono::duration<double>(clock_type::now() - start).count();
+    }
+
+    void collect_argument(std::string const &argument, std::vector<std::string> &files, int response_depth){
+        if (argument.starts_with('@') and response_depth < 16){
+            auto response_file = std::ifstream(argument.substr(1));
+            if (not response_file){ // let compile_file() report it
+                files.push_back(argument.substr(1));
+                return;
+            }
+            for (std::string line; std::getline(response_file, line);){
+                line.erase(0, line.find_first_not_of(" \t\r"));
+                line.erase(line.find_last_not_of(" \t\r") + 1);
+                if (not line.empty() and not line.starts_with('#'))
+                    collect_argument(line, files, response_depth + 1);
+            }
+            return;
+        }
+
+        auto error = std::error_code{};
+        if (std::filesystem::is_directory(argument, error)){
+            auto directory_files = std::vector<std::string>{};
+            for (auto const &entry: std::filesystem::recursive_directory_iterator(argument, std::filesystem::directory_options::skip_permission_denied, error))
+                if (entry.is_regular_file(error) and entry.path().extension() == ".utlang")
+                    directory_files.push_back(entry.path().string());
+            std::sort(directory_files.begin(), directory_files.end()); // deterministic order
+            files.insert(files.end(), directory_files.begin(), directory_files.end());
+            return;
+        }
+        files.push_back(argument);
+    }
+
+    std::string module_name(std::span<const utlang::symbol_id> path){
+        auto name = std::string{};
+        for (auto const id: path)
+            (name += name.empty() ? "" : "::") += utlang::symbol_table::global().name(id);
+        return name;
+    }
+
+    // a/b for a::b
+    std::filesystem::path module_file(std::span<const utlang::symbol_id> path){
+        auto file = std::filesystem::path{};
+        for (auto const id: path)
+            file /= std::string(utlang::symbol_table::global().name(id));
+        return file;
+    }
+
+    void find_imports(node_list<utlang::syntax::Statement const> statements, std::vector<utlang::syntax::scoped_name_type> &names){
+        for (auto const &statement: statements){
+            if (auto const declaration = std::get_if<utlang::syntax::Import_declaration *>(&statement.st))
+                names.push_back((*declaration)->module);
+            else if (auto const definition = std::get_if<utlang::syntax::Namespace_definition *>(&statement.st))
+                find_imports((*definition)->content.statement_list, names);
+            else if (auto const block = std::get_if<utlang::syntax::Block *>(&statement.st))
+                find_imports((*block)->statement_list, names);
+        }
+    }
+
+    // a file to compile, or the precompiled interface of a module
+    struct module{
+        std::filesystem::path identity;                  // the file, canonical: the same module whatever it is called
+        std::vector<utlang::symbol_id> path;
+        bool precompiled = false;                        // an interface (.utli) rather than source code
+        bool named_by_import = false;
+        file_result result;                              // a module fails as soon as it has an error
+        std::optional<utlang::source_buffer> file;       // never moved: the tokens are views into it
+        std::optional<utlang::cache::cached_file> parsed;
+        std::vector<utlang::syntax::scoped_name_type> import_names;
+        std::vector<std::size_t> imports;                // each module once
+        std::vector<std::size_t> importers;
+        std::size_t waiting = 0;                         // imports not done yet
+        utlang::syntax::Program_AST interface;
+    };
+
+    /*
+        Parsing goes in rounds, one for each depth of imports: the modules that a round's imports find are parsed in the next
+        Checking is a topological order run by all jobs at once: a module is ready when its imports are done,
+        and its interface is kept for the modules that import it; modules in an import cycle are never ready
+    */
+    class module_build{
+        public:
+            module_build(tokeniser_type tokeniser, utlang::cache::build_cache *cache, module_settings const &settings, std::vector<std::string> const &file_names);
+
+            std::vector<file_result> run(std::size_t jobs);
+
+        private:
+            std::size_t add(std::filesystem::path const &file, std::vector<utlang::symbol_id> path, bool precompiled);
+            void parse(module &unit);
+            void resolve_imports(std::size_t index);
+            void check(module &unit);
+
+            tokeniser_type tokeniser;
+            utlang::cache::build_cache *cache;
+            std::vector<std::filesystem::path> roots;
+            std::filesystem::path interface_directory;
+            std::deque<module> modules;
+            std::unordered_map<std::string, std::size_t> by_identity;
+    };
+
+    module_build::module_build(tokeniser_type tokeniser, utlang::cache::build_cache *cache, module_settings const &settings, std::vector<std::string> const &file_names):
+        tokeniser(tokeniser), cache(cache), interface_directory(settings.interface_directory){
+        auto error = std::error_code{};
+        for (auto const &root: settings.roots)
+            roots.push_back(std::filesystem::weakly_canonical(root, error));
+        if (roots.empty())
+            for (auto const &file_name: file_names){
+                auto const directory = std::filesystem::weakly_canonical(file_name, error).parent_path();
+                if (std::ranges::find(roots, directory) == roots.end())
+                    roots.push_back(directory);
+            }
+
+        for (auto const &file_name: file_names){
+            // the shortest path from a root, as the one an import would most likely use; the name of the file outside them
+            auto const identity = std::filesystem::weakly_canonical(file_name, error);
+            auto path = std::filesystem::path{};
+            for (auto const &root: roots){
+                auto const relative = identity.lexically_relative(root);
+                if (not relative.empty() and *relative.begin() != ".." and (path.empty() or std::distance(relative.begin(), relative.end()) < std::distance(path.begin(), path.end())))
+                    path = relative;
+            }
+            if (path.empty())
+                path = identity.filename();
+            path.replace_extension();
+            auto parts = std::vector<utlang::symbol_id>{};
+            for (auto const &part: path)
+                parts.push_back(utlang::symbol_table::global().intern(part.string()));
+            modules[add(file_name, std::move(parts), false)].result.file_name = file_name;
+        }
+    }
+
+    std::size_t module_build::add(std::filesystem::path const &file, std::vector<utlang::symbol_id> path, bool precompiled){
+        auto error = std::error_code{};
+        auto identity = std::filesystem::weakly_canonical(file, error);
+        if (auto const found = by_identity.find(identity.string()); found != by_identity.end())
+            return found->second;
+        by_identity.emplace(identity.string(), modules.size());
+        auto &unit = modules.emplace_back();
+        unit.identity = std::move(identity);
+        unit.path = std::move(path);
+        unit.precompiled = precompiled;
+        unit.result.file_name = file.string();
+        unit.result.module_name = module_name(unit.path);
+        return modules.size() - 1;
+    }
+
+    void module_build::parse(module &unit){
+        auto &result = unit.result;
+        auto const start = clock_type::now();
+        try{
+            auto const &file = unit.file.emplace(result.file_name);
+            result.bytes = file.text().size();
+            result.read_seconds = seconds_since(start);
+            if (unit.precompiled){
+                unit.interface = utlang::binary::read_program(utlang::binary::program_view{file.text()});
+                find_imports(unit.interface.code.statement_list, unit.import_names);
+                result.total_seconds = seconds_since(start);
+                return;
+            }
+
+            auto key = utlang::cache::content_key{};
+            auto &parsed = unit.parsed;
+            if (cache){
+                auto const cache_start = clock_type::now();
+                key = utlang::cache::hash_content(file.text());
+                parsed = cache->load(key, file.text());
+                result.cached = parsed.has_value();
+                result.cache_seconds = seconds_since(cache_start);
+            }
+            if (not parsed){
+                parsed.emplace();
+                auto const tokenise_start = clock_type::now();
+                parsed->tokens = tokeniser(file.text());
+                result.tokenise_seconds = seconds_since(tokenise_start);
+
+                auto const parse_start = clock_type::now();
+                parsed->tree = utlang::syntax::build_AST(parsed->tokens);
+                result.parse_seconds = seconds_since(parse_start);
+
+                if (cache){
+                    auto const cache_start = clock_type::now();
+                    cache->store(key, file.text(), parsed->tokens, parsed->tree);
+                    result.cache_seconds += seconds_since(cache_start);
+                }
+            }
+            result.tokens = parsed->tokens.size();
+            find_imports(parsed->tree.code.statement_list, unit.import_names);
+        }catch(std::system_error const &error){
+            result.error = error.code().message();
+        }catch(std::exception const &error){
+            result.error = error.what();
+        }catch(...){
+            result.error = "syntax error";
+        }
+        result.total_seconds = seconds_since(start);
+    }
+
+    // import a::b;  is the first a/b.utlang or a/b.utli in the roots
+    void module_build::resolve_imports(std::size_t index){
+        auto fail = [&](std::string message){
+            if (modules[index].result.error.empty())
+                modules[index].result.error = std::move(message);
+        };
+        for (auto const &name: modules[index].import_names){
+            auto const path = std::vector<utlang::symbol_id>(name.parts().begin(), name.parts().end());
+            auto found = modules.size();
+            for (auto const &root: roots){
+                auto error = std::error_code{};
+                auto file = root / module_file(path);
+                if (std::filesystem::exists(file.replace_extension(".utlang"), error))
+                    found = add(file, path, false);
+                else if (std::filesystem::exists(file.replace_extension(".utli"), error))
+                    found = add(file, path, true);
+                else
+                    continue;
+                break;
+            }
+            if (found == modules.size()){
+                fail("cannot find module " + module_name(path) + " (" + module_file(path).string() + ".utlang or .utli)");
+                continue;
+            }
+            auto &imported = modules[found];
+            if (not std::exchange(imported.named_by_import, true)){
+                imported.path = path;
+                imported.result.module_name = module_name(path);
+            }else if (imported.path != path){
+                fail(imported.result.file_name + " is imported both as " + module_name(imported.path) + " and as " + module_name(path));
+                continue;
+            }
+            if (std::ranges::find(modules[index].imports, found) == modules[index].imports.end()){
+                modules[index].imports.push_back(found);
+                imported.importers.push_back(index);
+            }
+        }
+    }
+
+    void module_build::check(module &unit){
+        auto &result = unit.result;
+        for (auto const imported: unit.imports)
+            if (result.error.empty() and not modules[imported].result.succeeded){
+                result.error = "imports " + module_name(modules[imported].path) + ", which failed";
+                if (modules[imported].precompiled) // not in the results to tell why
+                    result.error += ": " + modules[imported].result.file_name + ": " + modules[imported].result.error;
+            }
+        if (unit.precompiled or not result.error.empty()){
+            result.succeeded = result.error.empty();
+            return;
+        }
+
+        auto const start = clock_type::now();
+        try{
+            // the modules it imports, and the ones their interfaces refer to
+            auto interfaces = std::vector<utlang::syntax::Program_AST const *>{};
+            auto dependencies = std::vector<utlang::syntax::Program_AST const *>{};
+            auto seen = std::vector<bool>(modules.size());
+            for (auto const imported: unit.imports){
+                seen[imported] = true;
+                interfaces.push_back(&modules[imported].interface);
+            }
+            auto pending = unit.imports;
+            while (not pending.empty()){
+                auto const imported = pending.back();
+                pending.pop_back();
+                for (auto const dependency: modules[imported].imports)
+                    if (not seen[dependency]){
+                        seen[dependency] = true;
+                        dependencies.push_back(&modules[dependency].interface);
+                        pending.push_back(dependency);
+                    }
+            }
+
+            auto const &[tokens, tree] = *unit.parsed;
+            auto checked = utlang::typing::check_module(tree, interfaces, dependencies, unit.path);
+            auto const &errors = checked.errors;
+            if (not errors.empty()){
+                result.error = utlang::typing::line_and_column(tokens, unit.file->text(), errors.front().position) + ": " + errors.front().message;
+                if (errors.size() > 1)
+                    result.error += " (and " + std::to_string(errors.size() - 1) + " more type error(s))";
+            }else{
+                unit.interface = std::move(checked.interface);
+                if (not interface_directory.empty()){
+                    auto const file_name = (interface_directory / module_file(unit.path)).replace_extension(".utli");
+                    std::filesystem::create_directories(file_name.parent_path());
+                    auto const image = utlang::binary::write_program(unit.interface, {}, {});
+                    auto output = std::ofstream(file_name, std::ios::binary | std::ios::trunc);
+                    output.write(image.data(), static_cast<std::streamsize>(image.size()));
+                    output.close();
+                    if (not output)
+                        throw std::runtime_error("cannot write " + file_name.string());
+                }
+                result.succeeded = true;
+            }
+        }catch(std::system_error const &error){
+            result.error = error.code().message();
+        }catch(std::exception const &error){
+            result.error = error.what();
+        }
+        result.check_seconds = seconds_since(start);
+        result.total_seconds += result.check_seconds;
+    }
+
+    std::vector<file_result> module_build::run(std::size_t jobs){
+        auto in_parallel = [&](std::size_t count, auto const &task){
+            auto next = std::atomic<std::size_t>{0};
+            auto job = [&]{
+                for (auto i = next++; i < count; i = next++)
+                    task(i);
+            };
+            auto workers = std::vector<std::jthread>{};
+            for (std::size_t i = 1; i < std::clamp<std::size_t>(jobs, 1, std::max<std::size_t>(count, 1)); ++i)
+                workers.emplace_back(job);
+            job();
+        };
+
+        for (std::size_t begin = 0; begin < modules.size();){
+            auto const end = modules.size();
+            in_parallel(end - begin, [&](std::size_t i){parse(modules[begin + i]);});
+            for (auto i = begin; i < end; ++i)
+                resolve_imports(i);
+            begin = end;
+        }
+
+        auto ready = std::vector<std::size_t>{};
+        for (std::size_t i = 0; i < modules.size(); ++i)
+            if ((modules[i].waiting = modules[i].imports.size()) == 0)
+                ready.push_back(i);
+        auto mutex = std::mutex{};
+        auto wake = std::condition_variable{};
+        std::size_t busy = 0;
+        in_parallel(modules.size(), [&](std::size_t){ // each takes one module
+            auto lock = std::unique_lock{mutex};
+            wake.wait(lock, [&]{return not ready.empty() or busy == 0;});
+            if (ready.empty()) // nothing is being checked that could make more ready: the rest is in or behind a cycle
+                return;
+            auto const index = ready.back();
+            ready.pop_back();
+            ++busy;
+            lock.unlock();
+            check(modules[index]);
+            lock.lock();
+            --busy;
+            for (auto const importer: modules[index].importers)
+                if (--modules[importer].waiting == 0)
+                    ready.push_back(importer);
+            wake.notify_all();
+        });
+
+        auto results = std::vector<file_result>{};
+        for (auto &unit: modules){
+            if (unit.waiting > 0 and unit.result.error.empty())
+                unit.result.error = "in an import cycle, or imports a module in one";
+            if (not unit.precompiled)
+                results.push_back(std::move(unit.result));
+        }
+        return results;
+    }
+}
+
+namespace utlang::driver{
+
+std::vector<std::string> collect_input_files(std::vector<std::string> const &arguments){
+    auto files = std::vector<std::string>{};
+    for (auto const &argument: arguments)
+        collect_argument(argument, files, 0);
+    return files;
+}
+
+file_result compile_file(std::string const &file_name, tokeniser_type tokeniser, cache::build_cache *cache, module_settings const &modules){
+    return module_build{tokeniser, cache, modules, {file_name}}.run(1).front();
+}
+
+std::vector<file_result> compile_files(std::vector<std::string> const &file_names, tokeniser_type tokeniser, std::size_t jobs, cache::build_cache *cache,
+                                       module_settings const &modules){
+    auto results = module_build{tokeniser, cache, modules, file_names}.run(jobs);
+    if (cache)
+        cache->trim();
+    return results;
+}
+
+std::size_t print_summary(std::ostream &output, std::vector<file_result> const &results, double wall_seconds){
+    std::size_t failed = 0, bytes = 0, tokens = 0, cached = 0;
+    double cpu_seconds = 0;
+    auto const old_precision = output.precision(3);
+    output << std::fixed;
+    for (auto const &result: results){
+        if (result.succeeded and result.cached)
+            output << "ok      " << result.file_name << ": " << result.bytes << " bytes, " << result.tokens << " tokens, "
+                   << result.total_seconds * 1000 << " ms (read " << result.read_seconds * 1000 << " ms, cached " << result.cache_seconds * 1000
+                   << " ms, check " << result.check_seconds * 1000 << " ms)\n";
+        else if (result.succeeded)
+            output << "ok      " << result.file_name << ": " << result.bytes << " bytes, " << result.tokens << " tokens, "
+                   << result.total_seconds * 1000 << " ms (read " << result.read_seconds * 1000 << " ms, tokenise " << result.tokenise_seconds * 1000
+                   << " ms, parse " << result.parse_seconds * 1000 << " ms, check " << result.check_seconds * 1000 << " ms)\n";
+        else
+            output << "FAILED  " << result.file_name << ": " << result.error << '\n';
+        failed += not result.succeeded;
+        bytes += result.bytes;
+        tokens += result.tokens;
+        cached += result.cached;
+        cpu_seconds += result.total_seconds;
+    }
+    output << results.size() - failed << " of " << results.size() << " file(s) compiled, " << failed << " failed";
+    if (cached > 0)
+        output << ", " << cached << " from the cache";
+    output << "; "
+           << bytes << " bytes, " << tokens << " tokens; " << wall_seconds << " s wall, " << cpu_seconds << " s in files";
+    if (wall_seconds > 0)
+        output << ", " << static_cast<double>(bytes) / (1024 * 1024) / wall_seconds << " MiB/s";
+    output << '\n';
+    output.unsetf(std::ios::floatfield);
+    output.precision(old_precision);
+    return failed;
+}
+
+}
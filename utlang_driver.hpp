@@ -0,0 +1,66 @@
+#ifndef UTLANG_DRIVER_HPP
+#define UTLANG_DRIVER_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <filesystem>
+#include <string_view>
+#include "utlang_tokeniser.hpp"
+#include "utlang_build_cache.hpp"
+
+/*
+    Compiling many files in one process
+    Files are handed to a bounded set of jobs; a failure in one file is recorded and never affects the others
+    With a build cache, files whose text is in it are neither tokenised nor parsed (see utlang_build_cache.hpp)
+    Every file is a module: import a::b;  is the file a/b.utlang under one of the module roots, compiled along with the
+    files given, or the precompiled interface a/b.utli there (see check_module() in utlang_type_checker.hpp)
+    Each module is parsed once; the modules that import it are checked against its interface, after it, and modules
+    that do not depend on each other are checked at the same time
+*/
+namespace utlang::driver{
+
+    using tokeniser_type = std::vector<tokenisation::token> (*)(std::string_view);
+
+    struct file_result{
+        std::string file_name;
+        std::string module_name;    // a::b
+        bool succeeded = false;
+        std::string error;          // if not succeeded
+        std::size_t bytes = 0;
+        std::size_t tokens = 0;
+        double read_seconds = 0;
+        double tokenise_seconds = 0;
+        double parse_seconds = 0;
+        double check_seconds = 0;   // type checking, and writing the interface
+        double cache_seconds = 0;   // hashing the text, and loading or storing its tokens and tree
+        bool cached = false;        // tokens and tree were loaded from the cache
+        double total_seconds = 0;
+    };
+
+    // expands arguments into a list of files:
+    // @file - a response file with one argument per line, directory - all *.utlang files in it (recursively)
+    std::vector<std::string> collect_input_files(std::vector<std::string> const &arguments);
+
+    struct module_settings{
+        // where imports are looked for, in order; if there are none, the directories of the files given
+        // the module a file is, is its path from the root it is in (a/b.utlang is a::b), unless an import names it otherwise
+        std::vector<std::filesystem::path> roots;
+        // if not empty, the interface of every module that compiles is written there (a/b.utli), for other builds to import
+        std::filesystem::path interface_directory;
+    };
+
+    // the cache may be null; modules the file imports are compiled too, but only the file's result is returned
+    file_result compile_file(std::string const &file_name, tokeniser_type tokeniser, cache::build_cache *cache = nullptr,
+                             module_settings const &modules = {});
+
+    // results are in the order of file_names, followed by the modules they import that were not among them;
+    // the cache is trimmed to its capacity at the end
+    std::vector<file_result> compile_files(std::vector<std::string> const &file_names, tokeniser_type tokeniser, std::size_t jobs,
+                                           cache::build_cache *cache = nullptr, module_settings const &modules = {});
+
+    // per-file lines and the aggregate; returns the number of failed files
+    std::size_t print_summary(std::ostream &output, std::vector<file_result> const &results, double wall_seconds);
+}
+
+#endif
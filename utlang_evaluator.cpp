@@ -0,0 +1,676 @@
+#include <algorithm>
+#include <span>
+#include <array>
+#include <optional>
+#include "utlang_evaluator.hpp"
+
+using namespace utlang::evaluation;
+using namespace utlang::syntax;
+
+namespace{
+    template<class... F>
+    struct overloaded: F...{
+        using F::operator()...;
+    };
+
+    bool is_simple_type_named(Type type, scoped_name_type name){
+        auto const simple = std::get_if<Simple_Type *>(&type.type);
+        return simple and (*simple)->name == name;
+    }
+}
+
+namespace utlang::evaluation{
+
+evaluator::evaluator(Program_AST const &program, symbol_table &symbols, options evaluation_options):
+    symbols(symbols), evaluation_options(evaluation_options), ignored_name(symbols.intern("_")){
+    names = resolution::resolve_names(program, {}, {}, symbols);
+    entry_of.resize(names.definition_count());
+    collect_definitions(program.code.statement_list, {});
+}
+
+std::string evaluator::path_name(std::vector<symbol_id> const &path) const{
+    auto name = std::string{};
+    for (auto const id: path){
+        if (not name.empty())
+            name += "::";
+        name += symbols.name(id);
+    }
+    return name;
+}
+
+evaluator::global_entry &evaluator::add_global(std::vector<symbol_id> const &namespace_path, symbol_id name, void const *definition){
+    auto path = namespace_path;
+    path.push_back(name);
+    auto &entry = entries.emplace_back();
+    entry.name = path_name(path);
+    entry_of[names.definition_of(definition)] = &entry;
+    return entry;
+}
+
+// Z | S T, where T is the type itself (without parameters)
+void evaluator::add_type(Type_definition const &definition, std::vector<symbol_id> const &namespace_path){
+    auto const type = static_cast<std::uint32_t>(types.size());
+    auto &info = types.emplace_back();
+    for (auto const &constructor: definition.constructors){
+        auto &entry = add_global(namespace_path, constructor.name.name.back(), &constructor);
+        entry.constructor = static_cast<std::uint32_t>(constructors.size());
+        info.constructors.push_back(entry.constructor);
+        auto const index = static_cast<std::uint32_t>(info.constructors.size() - 1);
+        constructors.push_back(constructor_info{entry.name, type, static_cast<std::uint32_t>(constructor.field_types.size()), index});
+    }
+
+    auto const &cs = definition.constructors;
+    if (not evaluation_options.native_naturals or not definition.parameter_types.empty() or cs.size() != 2)
+        return;
+    for (std::size_t zero = 0; zero < 2; ++zero){
+        auto const successor = 1 - zero;
+        if (cs[zero].field_types.empty() and cs[successor].field_types.size() == 1 and is_simple_type_named(cs[successor].field_types[0], definition.type.name)){
+            info.natural_shaped = true;
+            info.zero = static_cast<std::uint32_t>(zero);
+            info.successor = static_cast<std::uint32_t>(successor);
+            constructors[info.constructors[zero]].role = constructor_role::zero;
+            constructors[info.constructors[successor]].role = constructor_role::successor;
+        }
+    }
+}
+
+void evaluator::collect_definitions(node_list<Statement const> statements, std::vector<symbol_id> const &namespace_path){
+    for (auto const &statement: statements){
+        std::visit(overloaded{
+            [&](Type_definition const *definition){
+                add_type(*definition, namespace_path);
+            },
+            [&](Variable_definition const *definition){
+                auto &entry = add_global(namespace_path, definition->name.name.back(), definition);
+                entry.definition = definition;
+                run_order.push_back(run_item{&entry, nullptr});
+            },
+            [&](Namespace_definition const *definition){
+                auto inner = namespace_path;
+                inner.push_back(definition->name);
+                collect_definitions(definition->content.statement_list, inner);
+            },
+            [&](Expression const *expression){
+                run_order.push_back(run_item{nullptr, expression});
+            },
+            [&](Block const *block){
+                collect_definitions(block->statement_list, namespace_path);
+            },
+            [&](Import_declaration const *){} // modules are not there yet
+        }, statement.st);
+    }
+}
+
+evaluator::global_entry &evaluator::resolve(void const *node, scoped_name_type name){
+    auto const bound = names.of(node);
+    if (bound.kind != resolution::binding_kind::value and bound.kind != resolution::binding_kind::constructor)
+        throw evaluation_error("unbound name " + path_name({name.parts().begin(), name.parts().end()}));
+    return *entry_of[bound.index];
+}
+
+value evaluator::force(global_entry &entry){
+    switch (entry.state){
+        case global_state::evaluated:
+            return entry.cached;
+        case global_state::evaluating:
+            throw evaluation_error(entry.name + " depends on its own value");
+        case global_state::unevaluated:
+            break;
+    }
+    entry.state = global_state::evaluating;
+    try{
+        if (entry.definition and evaluation_options.engine == engine_type::bytecode)
+            entry.cached = execute(entry);
+        else if (entry.definition)
+            entry.cached = evaluate(entry.definition->value, scope{nullptr});
+        else if (constructors[entry.constructor].arity == 0)
+            entry.cached = complete_constructor(entry.constructor, {});
+        else
+            entry.cached = heap.make_partial_constructor(entry.constructor, {});
+    }catch(...){
+        entry.state = global_state::unevaluated;
+        throw;
+    }
+    entry.state = global_state::evaluated;
+    return entry.cached;
+}
+
+value evaluator::complete_constructor(std::uint32_t constructor, std::span<value const> fields){
+    auto const &info = constructors[constructor];
+    switch (info.role){
+        case constructor_role::zero:
+            return natural{info.type, 0};
+        case constructor_role::successor:{
+            auto const predecessor = fields.front().number();
+            if (not fields.front().is_natural() or predecessor.type != info.type)
+                throw evaluation_error(info.name + " applied to a value of another type");
+            return natural{info.type, predecessor.count + 1};
+        }
+        case constructor_role::plain:
+            break;
+    }
+    return heap.make_constructed(constructor, fields, evaluation_options.hash_consing);
+}
+
+value evaluator::apply(value const &function, value argument){
+    if (auto const f = function.as<closure>()){
+        auto const &lambda = *f->lambda;
+        auto locals = f->captured.locals;
+        if (lambda.binder.name.back() != ignored_name)
+            locals = heap.make_binding(lambda.binder.name.back(), argument, locals);
+        return evaluate(lambda.body, scope{locals});
+    }
+    if (auto const f = function.as<partial_constructor>()){
+        auto fields = std::vector<value>(f->fields().begin(), f->fields().end());
+        fields.push_back(argument);
+        if (fields.size() == constructors[f->constructor].arity)
+            return complete_constructor(f->constructor, fields);
+        return heap.make_partial_constructor(f->constructor, fields);
+    }
+    throw evaluation_error(to_string(function) + " is not a function");
+}
+
+/*
+    A machine with an explicit stack: a part of an expression that is not in tail position (the function and the arguments
+    of an application but the last one, a scrutinee, the statements of a block but the last one, a definition used for the first time)
+    pushes what is left to do onto continuations, which are on the heap, so the depth of recursion is only limited by memory
+    Calls in tail position (the body of the function applied last, the case taken, the value of a block) push nothing
+*/
+value evaluator::evaluate(Expression expression, scope const &outer){
+    auto continuations = std::vector<continuation>{};
+    auto where = outer;
+    auto result = value{};
+    auto descending = true; // expression is evaluated in where next; otherwise result goes to the innermost continuation
+
+    // a local, or a global that has its value already
+    auto known_value = [&](Variable const &variable, scope const &in) -> value const *{
+        if (variable.name.size() == 1)
+            for (auto local = in.locals; local; local = local->next)
+                if (local->name == variable.name.back())
+                    return &local->bound;
+        auto const &entry = resolve(&variable, variable.name);
+        return entry.state == global_state::evaluated ? &entry.cached : nullptr;
+    };
+    // a part of an expression that is a known variable takes no step of the machine
+    auto evaluate_part = [&](Expression part, scope const &in){
+        if (auto const variable = std::get_if<Variable *>(&part.expr))
+            if (auto const known = known_value(**variable, in)){
+                result = *known;
+                descending = false;
+                return;
+            }
+        expression = part;
+        where = in;
+        descending = true;
+    };
+    // a closure is entered (its body is evaluated next), anything else is applied at once
+    auto call = [&](value const &function, value argument){
+        auto const f = function.as<closure>();
+        if (not f){
+            result = apply(function, argument);
+            return;
+        }
+        auto const &lambda = *f->lambda;
+        auto locals = f->captured.locals;
+        if (lambda.binder.name.back() != ignored_name)
+            locals = heap.make_binding(lambda.binder.name.back(), argument, locals);
+        where = scope{locals};
+        expression = lambda.body;
+        descending = true;
+    };
+    // the block of the innermost continuation goes on from statement `first`: local definitions are seen by the statements after them;
+    // the value is that of the last expression
+    auto next_statement = [&](std::size_t first){
+        auto &block = continuations.back();
+        auto const statements = static_cast<Block const *>(block.node)->statement_list;
+        if (first == statements.size()){
+            result = std::move(block.partial);
+            continuations.pop_back();
+            return;
+        }
+        if (auto const definition = std::get_if<Variable_definition *>(&statements[first].st))
+            expression = (*definition)->value;
+        else if (auto const e = std::get_if<Expression *>(&statements[first].st))
+            expression = **e;
+        else
+            throw evaluation_error("only definitions and expressions can be evaluated in a block");
+        block.index = static_cast<std::uint32_t>(first);
+        descending = true;
+        if (first + 1 == statements.size() and std::holds_alternative<Expression *>(statements[first].st)){
+            where = std::move(block.where);
+            continuations.pop_back();
+        }else
+            where = block.where;
+    };
+
+    auto roots = machine_roots{.continuations = &continuations, .where = &where, .result = &result};
+    auto const running = running_machine{*this, roots};
+    try{
+        for (;;){
+            if (heap.wants_collection())[[unlikely]]{
+                collect();
+                roots.unchanged_continuations = continuations.size();
+            }
+            // a step changes the innermost continuation at most
+            if (not continuations.empty())
+                roots.unchanged_continuations = std::min(roots.unchanged_continuations, continuations.size() - 1);
+            if (descending){
+                if (auto const variable = std::get_if<Variable *>(&expression.expr)){
+                    descending = false;
+                    if (auto const known = known_value(**variable, where)){
+                        result = *known;
+                        continue;
+                    }
+                    auto &entry = resolve(*variable, (*variable)->name);
+                    if (entry.definition and entry.state == global_state::unevaluated and evaluation_options.engine == engine_type::tree_walking){
+                        entry.state = global_state::evaluating;
+                        continuations.push_back(continuation{.kind = continuation::kind_type::global, .global = &entry});
+                        where = scope{nullptr};
+                        expression = entry.definition->value;
+                        descending = true;
+                    }else
+                        result = force(entry);
+                }else if (auto const lambda = std::get_if<Lambda *>(&expression.expr)){
+                    descending = false;
+                    result = heap.make_closure(*lambda, where);
+                }else if (auto const application = std::get_if<Application *>(&expression.expr)){
+                    auto const arguments = (*application)->arguments;
+                    if (arguments.size() == 1){
+                        expression = arguments.front();
+                        continue;
+                    }
+                    continuations.push_back(continuation{.kind = continuation::kind_type::argument, .node = *application, .where = std::move(where)});
+                    evaluate_part(arguments.front(), continuations.back().where);
+                }else if (auto const match = std::get_if<Match *>(&expression.expr)){
+                    continuations.push_back(continuation{.kind = continuation::kind_type::scrutinee, .node = *match, .where = std::move(where)});
+                    evaluate_part((*match)->scrutinee, continuations.back().where);
+                }else{
+                    auto const block = std::get<Block *>(expression.expr);
+                    if (std::ranges::none_of(block->statement_list, [](Statement const &s){return std::holds_alternative<Expression *>(s.st);}))
+                        throw evaluation_error("block without a value");
+                    continuations.push_back(continuation{.kind = continuation::kind_type::statement, .node = block, .where = std::move(where)});
+                    next_statement(0);
+                }
+                continue;
+            }
+
+            if (continuations.empty())
+                return result;
+            auto &innermost = continuations.back();
+            switch (innermost.kind){
+                case continuation::kind_type::argument:{
+                    auto const arguments = static_cast<Application const *>(innermost.node)->arguments;
+                    if (innermost.index == 0){
+                        innermost.partial = std::move(result);
+                        innermost.index = 1;
+                        evaluate_part(arguments[1], innermost.where);
+                    }else if (innermost.index + 1 == arguments.size()){ // the last one: a call in tail position
+                        auto const function = std::move(innermost.partial);
+                        continuations.pop_back();
+                        call(function, std::move(result));
+                    }else{
+                        innermost.kind = continuation::kind_type::applied;
+                        call(std::exchange(innermost.partial, value{}), std::move(result));
+                    }
+                } break;
+                case continuation::kind_type::applied:
+                    innermost.partial = std::move(result);
+                    innermost.kind = continuation::kind_type::argument;
+                    evaluate_part(static_cast<Application const *>(innermost.node)->arguments[++innermost.index], innermost.where);
+                    break;
+                case continuation::kind_type::statement:{
+                    auto const &statement = static_cast<Block const *>(innermost.node)->statement_list[innermost.index];
+                    if (auto const definition = std::get_if<Variable_definition *>(&statement.st))
+                        innermost.where.locals = heap.make_binding((*definition)->name.name.back(), result, innermost.where.locals);
+                    else
+                        innermost.partial = std::move(result);
+                    next_statement(innermost.index + 1);
+                } break;
+                case continuation::kind_type::scrutinee:{
+                    auto const &match = *static_cast<Match const *>(innermost.node);
+                    where = std::move(innermost.where);
+                    continuations.pop_back();
+                    expression = select_case(match, std::move(result), where);
+                    descending = true;
+                } break;
+                case continuation::kind_type::global:
+                    innermost.global->cached = result;
+                    innermost.global->state = global_state::evaluated;
+                    continuations.pop_back();
+                    break;
+            }
+        }
+    }catch(...){
+        for (auto const &c: continuations)
+            if (c.kind == continuation::kind_type::global)
+                c.global->state = global_state::unevaluated;
+        throw;
+    }
+}
+
+// rows of patterns still to be tested, specialised one constructor test at a time (first row, leftmost test first)
+struct evaluator::match_compiler{
+    struct row{
+        std::vector<std::pair<std::uint32_t, Case_pattern_application const *>> tests; // slot, pattern
+        std::vector<pattern_binding> bindings;
+        std::uint32_t case_index;
+    };
+
+    // what the tests on the way to the current node have found out, to describe unmatched values
+    struct known_constructor{
+        bool known = false;
+        std::uint32_t constructor = 0;
+        std::uint32_t first_field_slot = 0;
+    };
+
+    evaluator &owner;
+    compiled_match &result;
+    std::vector<bool> reached;
+    std::vector<known_constructor> known;
+
+    std::uint32_t constructor_of(Case_pattern_application const &application){
+        auto const &entry = owner.resolve(&application.cons, application.cons.name);
+        if (entry.definition)
+            throw evaluation_error(entry.name + " is not a constructor");
+        auto const &info = owner.constructors[entry.constructor];
+        if (info.arity != application.args.size())
+            throw evaluation_error(info.name + " takes " + std::to_string(info.arity) + " argument(s) in a pattern");
+        return entry.constructor;
+    }
+
+    // variables are bound right away, only constructor patterns become tests
+    void add(row &to, std::vector<std::pair<std::uint32_t, Case_pattern_application const *>> &tests, std::uint32_t slot, Case_pattern pattern){
+        if (auto const variable = std::get_if<Variable *>(&pattern.expr)){
+            if ((*variable)->name.back() != owner.ignored_name)
+                to.bindings.push_back(pattern_binding{(*variable)->name.back(), slot});
+        }else
+            tests.emplace_back(slot, std::get<Case_pattern_application *>(pattern.expr));
+    }
+
+    std::string describe(std::uint32_t slot) const{
+        if (slot >= known.size() or not known[slot].known)
+            return "_";
+        auto const &info = owner.constructors[known[slot].constructor];
+        auto text = info.name;
+        for (std::uint32_t i = 0; i < info.arity; ++i){
+            auto const field = describe(known[slot].first_field_slot + i);
+            auto const needs_brackets = field.find(' ') != std::string::npos;
+            text += needs_brackets ? " (" : " ";
+            text += field;
+            if (needs_brackets)
+                text += ')';
+        }
+        return text;
+    }
+
+    std::uint32_t build(std::vector<row> rows){
+        auto const index = static_cast<std::uint32_t>(result.nodes.size());
+        result.nodes.emplace_back();
+        if (rows.empty()){
+            if (result.unmatched.empty())
+                result.unmatched = describe(0);
+            return index;
+        }
+        auto const &first = rows.front();
+        if (first.tests.empty()){
+            reached[first.case_index] = true;
+            auto &leaf = result.nodes[index];
+            leaf.kind = decision_node::kind_type::leaf;
+            leaf.first = static_cast<std::uint32_t>(result.bindings.size());
+            leaf.count = static_cast<std::uint32_t>(first.bindings.size());
+            leaf.case_index = first.case_index;
+            result.bindings.insert(result.bindings.end(), first.bindings.begin(), first.bindings.end());
+            return index;
+        }
+
+        auto const slot = first.tests.front().first;
+        auto const type = owner.constructors[constructor_of(*first.tests.front().second)].type;
+        auto const &siblings = owner.types[type].constructors;
+        auto const first_branch = static_cast<std::uint32_t>(result.branches.size());
+        result.branches.resize(result.branches.size() + siblings.size());
+        if (known.size() <= slot)
+            known.resize(slot + 1);
+
+        for (std::size_t k = 0; k < siblings.size(); ++k){
+            auto const constructor = siblings[k];
+            auto const first_field_slot = result.slot_count;
+            result.slot_count += owner.constructors[constructor].arity;
+
+            auto specialised = std::vector<row>{};
+            for (auto const &r: rows){
+                auto const tested = std::ranges::find(r.tests, slot, &std::pair<std::uint32_t, Case_pattern_application const *>::first);
+                if (tested == r.tests.end()){
+                    specialised.push_back(r);
+                    continue;
+                }
+                auto const pattern_constructor = constructor_of(*tested->second);
+                if (owner.constructors[pattern_constructor].type != type)
+                    throw evaluation_error(owner.constructors[pattern_constructor].name + " does not belong to the type of " + owner.constructors[constructor].name);
+                if (pattern_constructor != constructor)
+                    continue;
+                // the fields take the place of the test, so that the patterns are still looked at left to right
+                auto &narrowed = specialised.emplace_back(row{{}, r.bindings, r.case_index});
+                narrowed.tests.assign(r.tests.begin(), tested);
+                for (std::size_t i = 0; i < tested->second->args.size(); ++i)
+                    add(narrowed, narrowed.tests, first_field_slot + static_cast<std::uint32_t>(i), tested->second->args[i]);
+                narrowed.tests.insert(narrowed.tests.end(), tested + 1, r.tests.end());
+            }
+
+            known[slot] = known_constructor{true, constructor, first_field_slot};
+            auto const child = build(std::move(specialised));
+            known[slot] = known_constructor{};
+            result.branches[first_branch + k] = decision_branch{child, first_field_slot};
+        }
+
+        auto &test = result.nodes[index];
+        test.kind = decision_node::kind_type::test;
+        test.slot = slot;
+        test.type = type;
+        test.first = first_branch;
+        return index;
+    }
+};
+
+evaluator::compiled_match const &evaluator::compile(Match const &match){
+    if (auto const found = compiled_matches.find(&match); found != compiled_matches.end())
+        return found->second;
+    auto result = compiled_match{};
+    auto compiler = match_compiler{*this, result, std::vector<bool>(match.cases.size()), {}};
+    auto rows = std::vector<match_compiler::row>{};
+    for (std::size_t i = 0; i < match.cases.size(); ++i){
+        auto &r = rows.emplace_back(match_compiler::row{{}, {}, static_cast<std::uint32_t>(i)});
+        compiler.add(r, r.tests, 0, match.cases[i].match_expr);
+    }
+    compiler.build(std::move(rows));
+    for (std::size_t i = 0; i < match.cases.size(); ++i)
+        if (not compiler.reached[i])
+            result.unreachable_cases.push_back(static_cast<std::uint32_t>(i));
+    return compiled_matches.emplace(&match, std::move(result)).first->second;
+}
+
+// binds the variables of the case taken in where; its expression gives the value
+Expression evaluator::select_case(Match const &match, value scrutinee, scope &where){
+    auto const &compiled = compile(match);
+    // most matches look at a handful of sub-terms
+    auto inline_slots = std::array<value, 8>{};
+    auto outside_slots = std::vector<value>(compiled.slot_count > inline_slots.size() ? compiled.slot_count : 0);
+    auto const slots = outside_slots.empty() ? std::span<value>{inline_slots} : std::span<value>{outside_slots};
+    slots.front() = std::move(scrutinee);
+    for (auto node = &compiled.nodes.front();;){
+        switch (node->kind){
+            case decision_node::kind_type::fail:
+                throw evaluation_error("no case matches " + to_string(slots.front()));
+            case decision_node::kind_type::leaf:
+                for (auto const &b: std::span{compiled.bindings}.subspan(node->first, node->count))
+                    where.locals = heap.make_binding(b.name, slots[b.slot], where.locals);
+                return match.cases[node->case_index].result_expr;
+            case decision_node::kind_type::test:
+                break;
+        }
+        auto const &tested = slots[node->slot];
+        auto const &branch = compiled.branches[node->first + constructor_index(tested, node->type)];
+        unpack_fields(tested, &slots[branch.first_field_slot]);
+        node = &compiled.nodes[branch.node];
+    }
+}
+
+std::uint32_t evaluator::constructor_index(value const &tested, std::uint32_t type) const{
+    if (tested.is_natural() and tested.number().type == type)
+        return tested.number().count == 0 ? types[type].zero : types[type].successor;
+    if (auto const object = tested.as<constructed>(); object and constructors[object->constructor].type == type)
+        return constructors[object->constructor].index;
+    throw evaluation_error(to_string(tested) + " cannot be matched against " + constructors[types[type].constructors.front()].name);
+}
+
+// the fields of the constructor found by constructor_index()
+void evaluator::unpack_fields(value const &tested, value *fields){
+    if (tested.is_natural()){
+        if (auto const number = tested.number(); number.count > 0)
+            *fields = natural{number.type, number.count - 1};
+    }else if (auto const object = tested.as<constructed>())
+        std::ranges::copy(object->fields(), fields);
+}
+
+void evaluator::check_matches(Expression expression, std::string const &definition, std::vector<match_diagnostic> &diagnostics){
+    std::visit(overloaded{
+        [&](Variable const *){},
+        [&](Application const *application){
+            for (auto const argument: application->arguments)
+                check_matches(argument, definition, diagnostics);
+        },
+        [&](Lambda const *lambda){
+            check_matches(lambda->body, definition, diagnostics);
+        },
+        [&](Match const *match){
+            check_matches(match->scrutinee, definition, diagnostics);
+            try{
+                auto const &compiled = compile(*match);
+                if (not compiled.unmatched.empty())
+                    diagnostics.push_back(match_diagnostic{definition, "match is not exhaustive: " + compiled.unmatched + " is not matched"});
+                for (auto const unreachable: compiled.unreachable_cases)
+                    diagnostics.push_back(match_diagnostic{definition, "case " + std::to_string(unreachable + 1) + " of a match is never taken"});
+            }catch(evaluation_error const &error){
+                diagnostics.push_back(match_diagnostic{definition, error.what()});
+            }
+            for (auto const &c: match->cases)
+                check_matches(c.result_expr, definition, diagnostics);
+        },
+        [&](Block const *block){
+            for (auto const &statement: block->statement_list){
+                if (auto const inner = std::get_if<Variable_definition *>(&statement.st))
+                    check_matches((*inner)->value, definition, diagnostics);
+                else if (auto const inner = std::get_if<Expression *>(&statement.st))
+                    check_matches(**inner, definition, diagnostics);
+            }
+        }
+    }, expression.expr);
+}
+
+std::vector<match_diagnostic> evaluator::check_matches(){
+    auto diagnostics = std::vector<match_diagnostic>{};
+    for (auto const &item: run_order){
+        auto const name = item.definition ? item.definition->name : std::string("_");
+        auto const expression = item.definition ? item.definition->definition->value : *item.expression;
+        check_matches(expression, name, diagnostics);
+    }
+    return diagnostics;
+}
+
+value evaluator::evaluate(std::string_view qualified_name){
+    auto path = std::vector<symbol_id>{};
+    for (auto rest = qualified_name;;){
+        auto const separator = rest.find("::");
+        path.push_back(symbols.intern(rest.substr(0, separator)));
+        if (separator == std::string_view::npos)
+            break;
+        rest.remove_prefix(separator + 2);
+    }
+    auto const found = names.find_value(path);
+    if (found.kind != resolution::binding_kind::value and found.kind != resolution::binding_kind::constructor)
+        throw evaluation_error("unbound name " + std::string(qualified_name));
+    return force(*entry_of[found.index]);
+}
+
+std::size_t evaluator::run(std::ostream &output){
+    std::size_t failed = 0;
+    for (auto const &item: run_order){
+        auto const name = item.definition ? item.definition->name : std::string("_");
+        try{
+            auto const result = item.definition ? force(*item.definition) : evaluate(*item.expression, scope{nullptr});
+            output << name << " = " << to_string(result) << '\n';
+        }catch(evaluation_error const &error){
+            output << name << ": error: " << error.what() << '\n';
+            ++failed;
+        }
+    }
+    return failed;
+}
+
+std::string evaluator::to_string(value const &v) const{
+    if (v.is_natural())
+        return std::to_string(v.number().count);
+    auto current = v.as<constructed>();
+    if (not current)
+        return "<function>";
+    // the last field is followed in a loop, so long chains like S (S (... Z)) do not exhaust the stack
+    auto text = std::string{};
+    std::size_t open_brackets = 0;
+    for (;;){
+        text += constructors[current->constructor].name;
+        auto const fields = current->fields();
+        if (fields.empty())
+            break;
+        for (auto const &field: fields.first(fields.size() - 1)){
+            auto const field_text = to_string(field);
+            auto const needs_brackets = field_text.find(' ') != std::string::npos and field_text.front() != '<';
+            text += needs_brackets ? " (" : " ";
+            text += field_text;
+            if (needs_brackets)
+                text += ')';
+        }
+        auto const last = fields.back().as<constructed>();
+        if (not last){
+            text += ' ';
+            text += to_string(fields.back());
+            break;
+        }
+        current = last;
+        if (current->field_count == 0)
+            text += " ";
+        else{
+            text += " (";
+            ++open_brackets;
+        }
+    }
+    text.append(open_brackets, ')');
+    return text;
+}
+
+void evaluator::collect(){
+    heap.collect([this](root_visitor &visit){
+        for (auto &entry: entries)
+            visit(entry.cached);
+        for (auto const machine: machines){
+            auto const unchanged = [&](std::size_t count){
+                return visit.young_only ? static_cast<std::ptrdiff_t>(count) : 0;
+            };
+            if (machine->stack)
+                for (auto &v: std::span{*machine->stack}.subspan(unchanged(machine->unchanged_stack)))
+                    visit(v);
+            if (machine->frames)
+                for (auto &f: std::span{*machine->frames}.subspan(unchanged(machine->unchanged_frames)))
+                    visit(f.closure);
+            if (machine->continuations)
+                for (auto &c: std::span{*machine->continuations}.subspan(unchanged(machine->unchanged_continuations))){
+                    visit(c.where.locals);
+                    visit(c.partial);
+                }
+            if (machine->where)
+                visit(machine->where->locals);
+            if (machine->result)
+                visit(*machine->result);
+        }
+    });
+}
+
+}
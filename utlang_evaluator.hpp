@@ -0,0 +1,280 @@
+#ifndef UTLANG_EVALUATOR_HPP
+#define UTLANG_EVALUATOR_HPP
+
+#include <span>
+#include <string>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <variant>
+#include <ostream>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+#include <unordered_map>
+#include "utlang_syntax_tree_builder.hpp"
+#include "utlang_symbol_table.hpp"
+#include "utlang_value_heap.hpp"
+#include "utlang_name_resolution.hpp"
+
+/*
+    An evaluator over Program_AST: call by value, top-level definitions are evaluated when first used
+    Definitions are either walked as a tree or lowered to bytecode for a stack machine (see utlang_bytecode.cpp)
+    Types of the shape  type T = Z | S T;  (one nullary constructor and one constructor taking a T)
+    are recognised, and their values are kept as machine integers: S x and matching on S n are O(1)
+    Other values are cells in a value_heap, collected from the globals and from the stacks of the running machines
+*/
+namespace utlang::evaluation{
+
+    class evaluation_error: public std::runtime_error{
+        public:
+            using std::runtime_error::runtime_error;
+    };
+
+    enum class engine_type: std::uint8_t{tree_walking, bytecode};
+
+    struct options{
+        bool native_naturals = true;
+        engine_type engine = engine_type::bytecode;
+        bool hash_consing = true;
+    };
+
+    // found while compiling a match, see evaluator::check_matches()
+    struct match_diagnostic{
+        std::string definition;
+        std::string message;
+    };
+
+    class evaluator{
+        public:
+            // the program and the symbol table must outlive the evaluator
+            evaluator(syntax::Program_AST const &program, symbol_table &symbols, options evaluation_options = {});
+
+            // a top-level definition or constructor, like "x" or "ns::x"; throws evaluation_error
+            // the value refers into the heap of the evaluator: it is good until the next evaluation, which may move or free cells
+            value evaluate(std::string_view qualified_name);
+
+            // evaluates every definition (and expression statement) in source order and prints "name = value" lines;
+            // returns the number of failed ones
+            std::size_t run(std::ostream &output);
+
+            std::string to_string(value const &v) const;
+
+            // the number of distinct constructed values in the hash-consing table: the dead ones leave it when they are collected
+            std::size_t unique_values() const{
+                return heap.interned_count();
+            }
+
+            heap_statistics const &heap_stats() const{
+                return heap.stats();
+            }
+
+            // compiles every match of the program: reports cases that can never be taken and values no case matches
+            std::vector<match_diagnostic> check_matches();
+
+        private:
+            struct type_info{
+                std::vector<std::uint32_t> constructors;
+                bool natural_shaped = false;
+                std::uint32_t zero = 0, successor = 0; // indices in constructors, if natural_shaped
+            };
+
+            enum class constructor_role: std::uint8_t{plain, zero, successor};
+
+            struct constructor_info{
+                std::string name;
+                std::uint32_t type;
+                std::uint32_t arity;
+                std::uint32_t index; // in the constructors of its type
+                constructor_role role = constructor_role::plain;
+            };
+
+            /*
+                A match compiled into a decision tree that tests every sub-term of the scrutinee at most once
+                Sub-terms are kept in numbered slots: slot 0 is the scrutinee, and each branch of a test
+                stores the fields of its constructor in slots of its own
+            */
+            struct decision_node{
+                enum class kind_type: std::uint8_t{fail, leaf, test};
+                kind_type kind = kind_type::fail;
+                std::uint32_t slot = 0;       // test: the sub-term whose constructor is looked at
+                std::uint32_t type = 0;       // test
+                std::uint32_t first = 0;      // test: first of the branches, one per constructor of the type; leaf: first binding
+                std::uint32_t count = 0;      // leaf: the number of bindings
+                std::uint32_t case_index = 0; // leaf: the case taken
+            };
+
+            struct decision_branch{
+                std::uint32_t node;
+                std::uint32_t first_field_slot;
+            };
+
+            struct pattern_binding{
+                symbol_id name;
+                std::uint32_t slot;
+            };
+
+            struct compiled_match{
+                std::vector<decision_node> nodes; // the root is nodes.front()
+                std::vector<decision_branch> branches;
+                std::vector<pattern_binding> bindings;
+                std::uint32_t slot_count = 1;
+                std::string unmatched;                     // an example of a value no case matches, empty if there is none
+                std::vector<std::uint32_t> unreachable_cases;
+            };
+
+            struct match_compiler;
+            friend struct match_compiler;
+
+            static constexpr std::uint32_t no_function = UINT32_MAX;
+
+            enum class global_state: std::uint8_t{unevaluated, evaluating, evaluated};
+
+            struct global_entry{
+                std::string name;
+                syntax::Variable_definition const *definition = nullptr; // nullptr for constructors
+                std::uint32_t constructor = 0;
+                global_state state = global_state::unevaluated;
+                value cached{};
+                std::uint32_t init_function = no_function; // bytecode that computes the definition
+            };
+
+            // a definition or an expression statement, for run()
+            struct run_item{
+                global_entry *definition;
+                syntax::Expression const *expression;
+            };
+
+            /*
+                Bytecode: one array of 32-bit words for all functions, an opcode followed by its operands
+                Every function has a frame of locals (the argument is local 0) with its operand stack above them
+                A call with more arguments than the function takes leaves the rest on the caller's stack,
+                and they are applied to the result when the callee returns
+            */
+            enum class opcode: std::uint32_t{
+                load_local,         // local
+                load_capture,       // index
+                load_global,        // global
+                store_local,        // local
+                pop,
+                construct,          // constructor, field count
+                make_closure,       // function, capture count
+                call,               // argument count
+                tail_call,          // argument count
+                return_value,
+                jump,               // target
+                switch_constructor, // local, type, then (first field local, target) for every constructor of the type
+                fail                // local of the scrutinee
+            };
+
+            struct function_info{
+                std::uint32_t entry;
+                std::uint32_t local_count;
+                std::string name;
+            };
+
+            struct frame{
+                std::uint32_t function;
+                std::uint32_t pc;
+                std::uint32_t base;    // of the locals on the stack
+                std::uint32_t pending; // arguments left for the result
+                compiled_closure *closure;
+                global_entry *sets_global;
+            };
+
+            struct function_builder;
+            friend struct function_builder;
+
+            // what is left of an expression of the tree walker once the value of one of its parts is known
+            struct continuation{
+                enum class kind_type: std::uint8_t{
+                    argument,  // of an application: index is the argument whose value comes (0 - the function)
+                    applied,   // the function was applied to argument index: the result is the function for the next one
+                    statement, // of a block: index is the statement whose value comes
+                    scrutinee, // of a match
+                    global     // the value of a top-level definition
+                };
+                kind_type kind;
+                std::uint32_t index = 0;
+                void const *node = nullptr; // the Application, Block or Match
+                scope where{};
+                value partial{};             // argument: the function so far; statement: the value of the last expression statement
+                global_entry *global = nullptr;
+            };
+
+            // what a running machine keeps values in: roots of the heap, with the globals (whatever is null is not there)
+            struct machine_roots{
+                std::vector<value> *stack = nullptr;
+                std::vector<frame> *frames = nullptr;
+                std::vector<continuation> *continuations = nullptr;
+                scope *where = nullptr;
+                value *result = nullptr;
+                // how many entries at the bottom of each vector the machine has not changed since it last collected:
+                // they refer to no young cell, so a minor collection skips them
+                std::size_t unchanged_stack = 0;
+                std::size_t unchanged_frames = 0;
+                std::size_t unchanged_continuations = 0;
+            };
+
+            // registers the roots of a machine for as long as it runs; machines nest (force() and apply() may start one)
+            class running_machine{
+                public:
+                    running_machine(evaluator &owner, machine_roots &roots): owner(owner){
+                        owner.machines.push_back(&roots);
+                    }
+                    running_machine(running_machine const &) = delete;
+                    running_machine &operator=(running_machine const &) = delete;
+                    ~running_machine(){
+                        owner.machines.pop_back();
+                    }
+
+                private:
+                    evaluator &owner;
+            };
+
+            void collect_definitions(node_list<syntax::Statement const> statements, std::vector<symbol_id> const &namespace_path);
+            void add_type(syntax::Type_definition const &definition, std::vector<symbol_id> const &namespace_path);
+            global_entry &add_global(std::vector<symbol_id> const &namespace_path, symbol_id name, void const *definition);
+
+            value evaluate(syntax::Expression expression, scope const &where);
+            syntax::Expression select_case(syntax::Match const &match, value scrutinee, scope &where);
+            compiled_match const &compile(syntax::Match const &match);
+            void check_matches(syntax::Expression expression, std::string const &definition, std::vector<match_diagnostic> &diagnostics);
+            value apply(value const &function, value argument);
+            value force(global_entry &entry);
+            value complete_constructor(std::uint32_t constructor, std::span<value const> fields);
+
+            // at a safe point of a machine: every value in use is in the roots of the running machines or in a global
+            void collect();
+
+            std::uint32_t constructor_index(value const &tested, std::uint32_t type) const; // in the constructors of the type; throws
+            static void unpack_fields(value const &tested, value *fields);
+
+            std::uint32_t lower(global_entry &entry);
+            std::uint32_t global_index(global_entry &entry);
+            value execute(global_entry &entry);
+
+            global_entry &resolve(void const *node, syntax::scoped_name_type name);
+
+            std::string path_name(std::vector<symbol_id> const &path) const;
+
+            symbol_table &symbols;
+            options evaluation_options;
+            value_heap heap;
+            std::vector<machine_roots *> machines;
+            symbol_id ignored_name;
+            std::vector<type_info> types;
+            std::vector<constructor_info> constructors;
+            std::deque<global_entry> entries;
+            resolution::program_names names;
+            std::vector<global_entry *> entry_of; // by the number of the definition
+            std::vector<run_item> run_order;
+            std::unordered_map<syntax::Match const *, compiled_match> compiled_matches;
+            std::vector<std::uint32_t> code;
+            std::vector<function_info> functions;
+            std::vector<global_entry *> global_table; // operands of load_global
+            std::unordered_map<global_entry const *, std::uint32_t> global_indices;
+    };
+}
+
+#endif
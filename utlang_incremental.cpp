@@ -0,0 +1,368 @@
+#include <cstdint>
+#include <stdexcept>
+#include <algorithm>
+#include "utlang_incremental.hpp"
+
+using namespace utlang::syntax;
+using token = utlang::tokenisation::token;
+
+namespace utlang::incremental{
+
+namespace{
+    // the minimum of tokens parsed again by edits before the garbage nodes they left are freed by a rebuild
+    constexpr std::size_t min_reparsed_tokens_before_rebuild = 1 << 16;
+
+    // where old tokens were is worked out from addresses as integers: the text they point into may have moved
+    std::uintptr_t address_of(char const *text){
+        return reinterpret_cast<std::uintptr_t>(text);
+    }
+
+    token moved_to(token const &t, char const *text){
+        return token{std::string_view{text, t.token_value().size()}, t.kind_set()};
+    }
+
+    struct tree_comparison{
+        template<class T>
+        static bool same(node_list<T> a, node_list<T> b){
+            return std::ranges::equal(a, b, [](T const &x, T const &y){return same(x, y);});
+        }
+
+        template<class... T>
+        static bool same(indirect_variant<T...> const &a, indirect_variant<T...> const &b){
+            if (a.index() != b.index())
+                return false;
+            return std::visit([&b](auto const *x){
+                auto const y = std::get<std::remove_const_t<std::remove_pointer_t<decltype(x)>> *>(b);
+                return x and y ? same(*x, *y) : x == y;
+            }, a);
+        }
+
+        static bool same(Variable const &a, Variable const &b){
+            return a.name == b.name and a.position == b.position;
+        }
+        static bool same(Constructor const &a, Constructor const &b){
+            return a.name == b.name and a.position == b.position;
+        }
+        static bool same(Expression const &a, Expression const &b){
+            return same(a.expr, b.expr);
+        }
+        static bool same(Application const &a, Application const &b){
+            return same(a.arguments, b.arguments);
+        }
+        static bool same(Lambda const &a, Lambda const &b){
+            return same(a.binder, b.binder) and same(a.body, b.body) and a.position == b.position;
+        }
+        static bool same(Case_pattern const &a, Case_pattern const &b){
+            return same(a.expr, b.expr);
+        }
+        static bool same(Case_pattern_application const &a, Case_pattern_application const &b){
+            return same(a.cons, b.cons) and same(a.args, b.args);
+        }
+        static bool same(Case const &a, Case const &b){
+            return same(a.match_expr, b.match_expr) and same(a.result_expr, b.result_expr);
+        }
+        static bool same(Match const &a, Match const &b){
+            return same(a.scrutinee, b.scrutinee) and same(a.cases, b.cases) and a.position == b.position;
+        }
+        static bool same(Type const &a, Type const &b){
+            return same(a.type, b.type);
+        }
+        static bool same(Simple_Type const &a, Simple_Type const &b){
+            return a.name == b.name and a.position == b.position;
+        }
+        static bool same(Function_Type const &a, Function_Type const &b){
+            return same(a.argument_type, b.argument_type) and same(a.result_type, b.result_type);
+        }
+        static bool same(Type_Application const &a, Type_Application const &b){
+            return same(a.types, b.types);
+        }
+        static bool same(Statement const &a, Statement const &b){
+            return same(a.st, b.st);
+        }
+        static bool same(Block const &a, Block const &b){
+            return same(a.statement_list, b.statement_list) and a.position == b.position;
+        }
+        static bool same(Constructor_definition const &a, Constructor_definition const &b){
+            return same(a.name, b.name) and same(a.field_types, b.field_types);
+        }
+        static bool same(Type_definition const &a, Type_definition const &b){
+            return same(a.type, b.type) and same(a.parameter_types, b.parameter_types) and same(a.constructors, b.constructors);
+        }
+        static bool same(Variable_definition const &a, Variable_definition const &b){
+            return same(a.name, b.name) and same(a.type, b.type) and same(a.value, b.value);
+        }
+        static bool same(Namespace_definition const &a, Namespace_definition const &b){
+            return a.name == b.name and same(a.content, b.content);
+        }
+        static bool same(Import_declaration const &a, Import_declaration const &b){
+            return a.module == b.module;
+        }
+    };
+}
+
+document::document(std::string text, symbol_table &symbols): symbols(symbols), source(std::move(text)){
+    rebuild();
+}
+
+void document::rebuild(){
+    statistics = edit_statistics{.relexed_bytes = source.size(), .rebuilt = true};
+    is_valid = false;
+    reparsed_tokens = 0;
+    separators.clear();
+    statements.clear();
+    tree = Program_AST{.code = {}, .nodes = std::make_unique<utlang::arena>(), .statement_positions = {}};
+    try{
+        token_stream = tokenisation::tokenise(source);
+    }catch(int){ // no tokens: the next edit lexes the whole text again
+        token_stream.clear();
+        invalid_first = invalid_end = 0;
+        invalid_unlexed = true;
+        return;
+    }
+    try{
+        tree = build_AST(token_stream, symbols);
+    }catch(int){ // a syntax error: all of it is invalid
+        invalid_first = 0;
+        invalid_end = token_stream.size();
+        invalid_unlexed = false;
+        return;
+    }
+    statements.assign(tree.code.statement_list.begin(), tree.code.statement_list.end());
+    tree.code.statement_list = statements;
+    std::size_t depth = 0;
+    for (std::uint32_t i = 0; i < token_stream.size(); ++i){
+        auto const &t = token_stream[i];
+        if (t.is_grouping_bracket_left() or t.is_block_bracket_left())
+            ++depth;
+        else if (t.is_grouping_bracket_right() or t.is_block_bracket_right())
+            --depth;
+        else if (t.is_statement_separator() and depth == 0)
+            separators.push_back(i);
+    }
+    statistics.relexed_tokens = token_stream.size();
+    statistics.reparsed_statements = statements.size();
+    is_valid = true;
+}
+
+void document::apply(text_edit const &edit){
+    if (edit.offset > source.size() or edit.removed_length > source.size() - edit.offset)
+        throw std::out_of_range("the edit is not inside the text");
+    update(edit);
+    if (is_valid and reparsed_tokens > std::max(token_stream.size(), min_reparsed_tokens_before_rebuild))
+        rebuild();
+}
+
+void document::update(text_edit const &edit){
+    statistics = edit_statistics{};
+    auto const inserted = std::string(edit.inserted); // it may be a part of the text
+    auto const delta = static_cast<std::ptrdiff_t>(inserted.size()) - static_cast<std::ptrdiff_t>(edit.removed_length);
+    auto const old_address = address_of(source.data());
+    auto const old_size = source.size();
+    auto old_offset = [&](std::size_t i){
+        return static_cast<std::ptrdiff_t>(address_of(token_stream[i].token_value().data()) - old_address);
+    };
+    auto old_token_end = [&](std::size_t i){
+        return old_offset(i) + static_cast<std::ptrdiff_t>(token_stream[i].token_value().size());
+    };
+
+    // lexing starts after the last top-level ; that ends before the edit: the character after it is not changed,
+    // so neither is the ; or anything before it, and the lexer is not in a comment there
+    auto boundary = std::ranges::partition_point(separators, [&](std::uint32_t s){
+        return old_offset(s) + 1 < static_cast<std::ptrdiff_t>(edit.offset);
+    });
+    // a comment that an invalid region opens ends at the first */ after it, wherever that is: edits after its start lex it again
+    if (not is_valid and invalid_unlexed)
+        boundary = std::min(boundary, std::ranges::lower_bound(separators, static_cast<std::uint32_t>(invalid_first)));
+    auto const first_token = boundary == separators.begin() ? std::size_t{0} : std::size_t{*(boundary - 1)} + 1;
+    auto const lex_start = boundary == separators.begin() ? std::size_t{0} : static_cast<std::size_t>(old_offset(*(boundary - 1)) + 1);
+
+    // old tokens are only taken up again after the edit, and after an invalid region whose tokens are out of date
+    auto resume_from = static_cast<std::ptrdiff_t>(edit.offset + inserted.size());
+    if (not is_valid and invalid_unlexed)
+        resume_from = std::max(resume_from, (invalid_end == token_stream.size() ? static_cast<std::ptrdiff_t>(old_size) : old_token_end(invalid_end - 1)) + delta);
+
+    // twice the size when the text grows out of its buffer, so that tokens rarely have to be moved for that
+    if (source.size() + inserted.size() - edit.removed_length > source.capacity())
+        source.reserve(2 * (source.size() + inserted.size()));
+    source.replace(edit.offset, edit.removed_length, inserted);
+    auto const moved = address_of(source.data()) != old_address;
+
+    // a new token after the edit that starts where an old one (shifted by delta) started is that token again,
+    // and so are all the tokens after it: the lexer is at the start of a token in both texts, and the rest of the text is the same
+    auto new_tokens = std::vector<token>{};
+    auto resumed = token_stream.size(); // the first old token that is kept after the edit
+    auto old = first_token;
+    auto lexed = true;
+    try{
+        auto const lex_end = tokenisation::tokenise_from(source, lex_start, [&](token const &t){
+            auto const offset = static_cast<std::ptrdiff_t>(t.token_value().data() - source.data());
+            if (offset >= resume_from){
+                while (old < token_stream.size() and old_offset(old) + delta < offset)
+                    ++old;
+                if (old < token_stream.size() and old_offset(old) + delta == offset and
+                    token_stream[old].token_value().size() == t.token_value().size() and token_stream[old].kind_set() == t.kind_set()){
+                    resumed = old;
+                    return false;
+                }
+            }
+            new_tokens.push_back(t);
+            return true;
+        });
+        statistics.relexed_bytes = lex_end - lex_start;
+        statistics.relexed_tokens = new_tokens.size();
+    }catch(int){ // a comment that is not closed or characters that are no token: only the old tokens that the edit touched are dropped
+        lexed = false;
+        statistics.relexed_bytes = source.size() - lex_start; // at most
+        new_tokens.clear();
+        auto const old_edit_end = static_cast<std::ptrdiff_t>(edit.offset + edit.removed_length);
+        for (resumed = first_token; resumed < token_stream.size() and old_token_end(resumed) <= static_cast<std::ptrdiff_t>(edit.offset); ++resumed)
+            new_tokens.push_back(moved_to(token_stream[resumed], source.data() + old_offset(resumed)));
+        while (resumed < token_stream.size() and old_offset(resumed) < old_edit_end)
+            ++resumed;
+    }
+
+    // the kept tokens are moved to the new text, then the new ones replace those between
+    if (moved)
+        for (std::size_t i = 0; i < first_token; ++i)
+            token_stream[i] = moved_to(token_stream[i], source.data() + old_offset(i));
+    for (auto i = resumed; i < token_stream.size(); ++i)
+        token_stream[i] = moved_to(token_stream[i], source.data() + old_offset(i) + delta);
+    auto const removed_tokens = resumed - first_token;
+    auto const token_delta = static_cast<std::ptrdiff_t>(new_tokens.size()) - static_cast<std::ptrdiff_t>(removed_tokens);
+    token_stream.erase(token_stream.begin() + first_token, token_stream.begin() + resumed);
+    token_stream.insert(token_stream.begin() + first_token, new_tokens.begin(), new_tokens.end());
+    if (lexed and new_tokens.empty() and removed_tokens == 0 and (is_valid or not invalid_unlexed)) // an unlexed region still has to be checked
+        return;
+    auto const new_end = first_token + new_tokens.size();
+
+    // the invalid region from before the edit, in the new tokens; the part of it that was lexed again is taken from first_token
+    // (it may have no tokens: a comment that is not closed after the last one)
+    auto const had_invalid = not is_valid;
+    auto invalid = std::pair{invalid_first, invalid_end};
+    if (had_invalid and invalid_first >= first_token){
+        if (invalid_first >= resumed)
+            invalid = {invalid_first + token_delta, invalid_end + token_delta};
+        else
+            invalid = {first_token, invalid_end >= resumed ? invalid_end + token_delta : new_end};
+    }
+
+    auto splice = [](auto &old_values, std::size_t first, std::size_t last, auto const &new_values){
+        old_values.erase(old_values.begin() + first, old_values.begin() + last);
+        old_values.insert(old_values.begin() + first, new_values.begin(), new_values.end());
+    };
+    auto shift = [token_delta](std::vector<std::uint32_t> &indices, std::size_t first){
+        for (auto i = first; i < indices.size(); ++i)
+            indices[i] = static_cast<std::uint32_t>(indices[i] + token_delta);
+    };
+    // the new tokens from first (before any changed one) to last (after them all) take the place of the old ones up to last - token_delta
+    auto replace = [&](std::size_t first, std::size_t last, auto const &parsed, std::vector<std::uint32_t> const &positions, std::vector<std::uint32_t> const &new_separators){
+        auto const old_last = static_cast<std::uint32_t>(static_cast<std::ptrdiff_t>(last) - token_delta);
+        auto &statement_positions = tree.statement_positions;
+        auto const first_statement = static_cast<std::size_t>(std::ranges::lower_bound(statement_positions, first) - statement_positions.begin());
+        auto const last_statement = static_cast<std::size_t>(std::ranges::lower_bound(statement_positions, old_last) - statement_positions.begin());
+        splice(statements, first_statement, last_statement, parsed);
+        splice(statement_positions, first_statement, last_statement, positions);
+        shift(statement_positions, first_statement + positions.size());
+        auto const first_separator = static_cast<std::size_t>(std::ranges::lower_bound(separators, first) - separators.begin());
+        auto const last_separator = static_cast<std::size_t>(std::ranges::lower_bound(separators, old_last) - separators.begin());
+        splice(separators, first_separator, last_separator, new_separators);
+        shift(separators, first_separator + new_separators.size());
+        tree.code.statement_list = statements;
+    };
+    // throws on a syntax error, before anything is changed
+    auto parse = [&](std::size_t first, std::size_t last, std::vector<std::uint32_t> const &new_separators){
+        auto nodes = utlang::arena{4 * 1024};
+        auto positions = std::vector<std::uint32_t>{};
+        auto const parsed = build_statements(std::span{token_stream}.subspan(first, last - first), nodes, positions, symbols);
+        for (auto &position: positions)
+            position += static_cast<std::uint32_t>(first);
+        tree.nodes->absorb(std::move(nodes));
+        reparsed_tokens += last - first;
+        statistics.reparsed_statements += parsed.size();
+        replace(first, last, parsed, positions, new_separators);
+    };
+    auto is_left_bracket = [](token const &t){
+        return t.is_grouping_bracket_left() or t.is_block_bracket_left();
+    };
+    auto is_right_bracket = [](token const &t){
+        return t.is_grouping_bracket_right() or t.is_block_bracket_right();
+    };
+
+    if (lexed){
+        try{
+            // parsing goes on to a top-level ; after the new tokens that was a top-level ; before the edit: the statements after it are the old ones
+            auto new_separators = std::vector<std::uint32_t>{};
+            auto old_separator = boundary;
+            auto region_end = token_stream.size();
+            std::size_t depth = 0;
+            for (auto i = first_token; i < token_stream.size(); ++i){
+                auto const &t = token_stream[i];
+                if (is_left_bracket(t))
+                    ++depth;
+                else if (is_right_bracket(t)){
+                    if (depth == 0)
+                        throw 0;
+                    --depth;
+                }else if (t.is_statement_separator() and depth == 0){
+                    new_separators.push_back(static_cast<std::uint32_t>(i));
+                    if (i + 1 < new_end)
+                        continue;
+                    auto const old_index = static_cast<std::ptrdiff_t>(i) - token_delta;
+                    while (old_separator != separators.end() and *old_separator < old_index)
+                        ++old_separator;
+                    if (old_separator != separators.end() and *old_separator == old_index){
+                        region_end = i + 1;
+                        break;
+                    }
+                }
+            }
+            parse(first_token, region_end, new_separators);
+            // an invalid region that was reached has been parsed with the rest (no top-level ; inside it could end the region)
+            is_valid = not had_invalid or (invalid.first >= first_token and invalid.second <= region_end);
+            invalid_first = invalid.first;
+            invalid_end = invalid.second;
+            return;
+        }catch(int){}
+    }
+
+    // the invalid region ends at the first top-level ; after the changed tokens, so the statements after it are kept;
+    // with an invalid region from before, the statements between them are invalid too (a bracket opened in one may be closed in the other)
+    auto const next_separator = std::ranges::lower_bound(separators, resumed);
+    auto first = first_token;
+    auto last = next_separator == separators.end() ? token_stream.size() : static_cast<std::size_t>(*next_separator + token_delta + 1);
+    if (had_invalid and (invalid.first < first or invalid.second > last)){
+        first = std::min(first, invalid.first);
+        last = std::max(last, invalid.second);
+        if (lexed){
+            try{
+                auto new_separators = std::vector<std::uint32_t>{};
+                std::size_t depth = 0;
+                for (auto i = first; i < last; ++i){
+                    auto const &t = token_stream[i];
+                    if (is_left_bracket(t))
+                        ++depth;
+                    else if (is_right_bracket(t)){
+                        if (depth == 0)
+                            throw 0;
+                        --depth;
+                    }else if (t.is_statement_separator() and depth == 0)
+                        new_separators.push_back(static_cast<std::uint32_t>(i));
+                }
+                parse(first, last, new_separators);
+                is_valid = true;
+                return;
+            }catch(int){}
+        }
+    }
+    replace(first, last, std::vector<Statement>{}, {}, last < token_stream.size() ? std::vector{static_cast<std::uint32_t>(last - 1)} : std::vector<std::uint32_t>{});
+    is_valid = false;
+    invalid_first = first;
+    invalid_end = last;
+    invalid_unlexed = not lexed;
+}
+
+bool same_tree(Program_AST const &a, Program_AST const &b){
+    return tree_comparison::same(a.code.statement_list, b.code.statement_list) and a.statement_positions == b.statement_positions;
+}
+
+}
@@ -0,0 +1,92 @@
+#ifndef UTLANG_INCREMENTAL_HPP
+#define UTLANG_INCREMENTAL_HPP
+
+#include <string>
+#include <vector>
+#include <string_view>
+#include "utlang_tokeniser.hpp"
+#include "utlang_syntax_tree_builder.hpp"
+#include "utlang_symbol_table.hpp"
+
+/*
+    A source text with its tokens and its tree, kept up to date edit by edit (for editors, which edit on every keystroke)
+    An edit is lexed again from the end of the last top-level ; before it, until the new tokens run into an old token
+    at the same place after the edit (a comment opened or closed by the edit simply takes longer to get there),
+    and only the top-level statements up to the next ; where the old statements continue are parsed again
+    Positions in the tree count from the start of their top-level statement, so the other statements are kept as they are
+    A syntax error only makes its top-level statements invalid: the tree leaves them out and keeps the others as they last parsed,
+    and later edits go on relexing and reparsing their own region (and the invalid one, once they reach it)
+*/
+namespace utlang::incremental{
+
+    // removed_length bytes at offset (in the text before the edit) are replaced by inserted
+    struct text_edit{
+        std::size_t offset;
+        std::size_t removed_length;
+        std::string_view inserted;
+    };
+
+    struct edit_statistics{
+        std::size_t relexed_bytes = 0;
+        std::size_t relexed_tokens = 0;       // new tokens
+        std::size_t reparsed_statements = 0;
+        bool rebuilt = false;                 // lexed and parsed as a whole
+    };
+
+    class document{
+        public:
+            explicit document(std::string text, symbol_table &symbols = symbol_table::global());
+            document(document const &) = delete;
+            document &operator=(document const &) = delete;
+
+            // throws std::out_of_range if the edit is not inside the text; a syntax error in the new text makes the document not valid()
+            // until an edit fixes it
+            void apply(text_edit const &edit);
+
+            std::string_view text() const{
+                return source;
+            }
+
+            // whether the tokens and the tree are those of the text; otherwise it has a syntax error,
+            // and the tree holds the statements before and after the region that does not parse
+            bool valid() const{
+                return is_valid;
+            }
+
+            std::vector<tokenisation::token> const &tokens() const{
+                return token_stream;
+            }
+
+            // its statement list belongs to the document and changes with every edit
+            syntax::Program_AST const &program() const{
+                return tree;
+            }
+
+            edit_statistics const &last_edit() const{
+                return statistics;
+            }
+
+        private:
+            void rebuild();
+            void update(text_edit const &edit);
+
+            symbol_table &symbols;
+            std::string source;
+            std::vector<tokenisation::token> token_stream;
+            std::vector<std::uint32_t> separators; // top-level ; in token_stream
+            std::vector<syntax::Statement> statements;
+            syntax::Program_AST tree;
+            std::size_t reparsed_tokens = 0;       // since the last rebuild; the nodes they replaced are garbage in tree.nodes
+            bool is_valid = false;
+            // while not valid: the tokens of the top-level statements that do not parse; separators has none of their ; but the last
+            std::size_t invalid_first = 0;
+            std::size_t invalid_end = 0;
+            bool invalid_unlexed = false;          // and they are not all tokens of the text (a comment that is not closed, a character that is no token)
+            edit_statistics statistics;
+    };
+
+    // same statements, nodes and positions
+    bool same_tree(syntax::Program_AST const &a, syntax::Program_AST const &b);
+}
+
+#endif
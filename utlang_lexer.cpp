@@ -0,0 +1,93 @@
+#include "utlang_lexer.hpp"
+#include "utlang_simd_scan.hpp"
+
+using namespace utlang::tokenisation;
+using namespace utlang::tokenisation::lexer;
+
+namespace utlang::tokenisation{
+
+namespace{
+
+/*
+    One left-to-right pass, one table lookup per character:
+    * other characters are skipped (runs of them with simd::find_token_like)
+    * name-like characters are collected into a name (simd::find_not_name_like)
+    * an operator-like character either starts a comment (skipped up to its end)
+      or starts the longest reserved operator that the trie can match
+    Starts at position, which must not be inside a comment; stops early when emit returns false,
+    and returns where the refused token starts (the size of the text otherwise)
+*/
+template<class E>
+std::size_t lex(const std::string_view input_text, std::size_t position, E &&emit){
+    auto const text = input_text.data();
+    auto const length = input_text.size();
+    auto starts_comment = [&](std::size_t position, char second){
+        return text[position] == '/' and position + 1 < length and text[position + 1] == second;
+    };
+
+    while (position < length){
+        switch (class_of(text[position])){
+            case character_class::other:
+            case character_class::new_line_like:
+                position = simd::find_token_like(text + position + 1, text + length) - text;
+                break;
+            case character_class::name_like:{
+                auto const end = static_cast<std::size_t>(simd::find_not_name_like(text + position + 1, text + length) - text);
+                auto const name = input_text.substr(position, end - position);
+                if (not emit(token{name, name_kinds(name)}))
+                    return position;
+                position = end;
+            } break;
+            case character_class::operator_like:{
+                if (starts_comment(position, '/')){
+                    position = simd::find_new_line(text + position + token::single_line_comment_identifier.length(), text + length) - text;
+                    ++position; // coment ends at the end-of-line or end-of-file [ok]
+                    break;
+                }
+                if (starts_comment(position, '*')){
+                    auto const comment_end = simd::find_block_comment_end(text + position + token::block_comment_start.length(), text + length);
+                    if (comment_end == text + length) // coment is not closed [bad]
+                        throw 0;
+                    position = comment_end - text + token::block_comment_end.length();
+                    break;
+                }
+
+                std::uint8_t node = 0;
+                std::size_t operator_length = 0;
+                token_kind_set kinds = 0;
+                for (auto end = position; end < length and class_of(text[end]) == character_class::operator_like and not starts_comment(end, '/') and not starts_comment(end, '*');){
+                    if ((node = operators.step(node, text[end++])) == 0)
+                        break;
+                    if (operators.accepted_kinds[node]){
+                        operator_length = end - position;
+                        kinds = operators.accepted_kinds[node];
+                    }
+                }
+                if (operator_length == 0)[[unlikely]] // not an operator
+                    throw 0;
+                if (not emit(token{input_text.substr(position, operator_length), kinds}))
+                    return position;
+                position += operator_length;
+            } break;
+        }
+    }
+    return length;
+}
+
+}
+
+std::vector<token> tokenise_single_pass(const std::string_view input_text){
+    auto token_stream = std::vector<token>{};
+    token_stream.reserve(input_text.size() / 4);
+    lex(input_text, 0, [&](token const &t){
+        token_stream.push_back(t);
+        return true;
+    });
+    return token_stream;
+}
+
+std::size_t tokenise_from(const std::string_view input_text, std::size_t position, std::function<bool(token const &)> const &consumer){
+    return lex(input_text, position, consumer);
+}
+
+}
@@ -0,0 +1,194 @@
+#ifndef UTLANG_LEXER_HPP
+#define UTLANG_LEXER_HPP
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include "utlang_tokeniser.hpp"
+
+/*
+    Tables of the single-pass lexer (tokenise_single_pass), and the reserved texts that token::token looks up
+    Everything here is computed at compile time from token::reserved_name_values and token::reserved_operator_values,
+    so a new keyword or operator only has to be added there
+*/
+namespace utlang::tokenisation::lexer{
+
+    enum class character_class: std::uint8_t{other, name_like, operator_like, new_line_like};
+
+    // same classes as symbol_is_*_like() in the "C" locale, without calling into the locale
+    constexpr character_class classify_character(unsigned char c){
+        if ((c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or (c >= '0' and c <= '9') or c == '_')
+            return character_class::name_like;
+        if ((c >= '!' and c <= '/') or (c >= ':' and c <= '@') or (c >= '[' and c <= '`') or (c >= '{' and c <= '~'))
+            return character_class::operator_like;
+        if (c == '\n' or c == '\r')
+            return character_class::new_line_like;
+        return character_class::other;
+    }
+
+    constexpr auto build_character_classes(){
+        std::array<character_class, 256> classes{};
+        for (unsigned c = 0; c < classes.size(); ++c)
+            classes[c] = classify_character(static_cast<unsigned char>(c));
+        return classes;
+    }
+
+    inline constexpr auto character_classes = build_character_classes();
+
+    constexpr character_class class_of(char c){
+        return character_classes[static_cast<unsigned char>(c)];
+    }
+
+    constexpr bool all_of_class(std::string_view text, character_class expected){
+        for (auto const c: text)
+            if (class_of(c) != expected)
+                return false;
+        return true;
+    }
+
+    constexpr bool reserved_values_are_well_formed(){
+        for (auto const &[kind, text]: token::reserved_name_values)
+            if (text.empty() or not all_of_class(text, character_class::name_like))
+                return false;
+        for (auto const &[kind, text]: token::reserved_operator_values)
+            if (text.empty() or not all_of_class(text, character_class::operator_like))
+                return false;
+        return true;
+    }
+    static_assert(reserved_values_are_well_formed(), "reserved names must be name-like and reserved operators operator-like");
+
+    /*
+        A perfect hash of all reserved texts (names and operators): every text has a slot of its own, with all its kinds
+        ("->" is two), so a lookup is a hash of the length and the first and last characters and one compare
+        The seed that makes the hash perfect is searched for at compile time
+    */
+    struct reserved_slot{
+        std::string_view text; // empty for a free slot
+        token_kind_set kinds = 0;
+    };
+
+    struct reserved_table{
+        static constexpr unsigned bits = 6; // room enough for a perfect seed to be found in a few tries
+        static_assert(token::reserved_values.size() <= (1u << bits), "more reserved texts than slots");
+
+        std::array<reserved_slot, 1u << bits> slots{};
+        std::uint32_t seed = 0;
+
+        static constexpr std::uint32_t hash(std::string_view text, std::uint32_t seed){
+            auto mixed = (static_cast<std::uint32_t>(text.size()) ^ seed) * 0x9E3779B1u;
+            mixed = (mixed ^ static_cast<unsigned char>(text.front())) * 0x85EBCA6Bu;
+            mixed = (mixed ^ static_cast<unsigned char>(text.back())) * 0xC2B2AE35u;
+            return mixed >> (32 - bits);
+        }
+
+        constexpr token_kind_set kinds_of(std::string_view text) const{
+            if (text.empty())
+                return 0;
+            auto const &slot = slots[hash(text, seed)];
+            return slot.text == text ? slot.kinds : 0;
+        }
+    };
+
+    constexpr reserved_table build_reserved_table(){
+        for (std::uint32_t seed = 0;; ++seed){
+            auto table = reserved_table{};
+            table.seed = seed;
+            auto perfect = true;
+            for (auto const &[kind, text]: token::reserved_values){
+                auto &slot = table.slots[reserved_table::hash(text, seed)];
+                if (slot.text.empty())
+                    slot.text = text;
+                else if (slot.text != text){
+                    perfect = false;
+                    break;
+                }
+                slot.kinds |= kind_bit(kind);
+            }
+            if (perfect)
+                return table;
+        }
+    }
+
+    inline constexpr auto reserved_texts = build_reserved_table();
+
+    constexpr bool reserved_table_is_complete(){
+        for (auto const &[kind, text]: token::reserved_values)
+            if (not (reserved_texts.kinds_of(text) & kind_bit(kind)))
+                return false;
+        return true;
+    }
+    static_assert(reserved_table_is_complete(), "every reserved text must be in its slot with its kinds");
+
+    // all kinds a reserved text has, 0 for any other text
+    constexpr token_kind_set reserved_kinds_of(std::string_view text){
+        return reserved_texts.kinds_of(text);
+    }
+    static_assert(reserved_kinds_of("->") == (kind_bit(token_kind::function_type_builder) | kind_bit(token_kind::lambda_expression_introduction)));
+    static_assert(reserved_kinds_of("val") == kind_bit(token_kind::variable_identifier));
+    static_assert(reserved_kinds_of("vel") == 0 and reserved_kinds_of(":=") == 0 and reserved_kinds_of("") == 0);
+
+    // kinds of a name-like text: a reserved name or a general name (which must not start with a digit)
+    constexpr token_kind_set name_kinds(std::string_view text){
+        if (auto const kinds = reserved_kinds_of(text))
+            return kinds;
+        return text.front() >= '0' and text.front() <= '9' ? 0 : kind_bit(token_kind::general_name);
+    }
+    static_assert(name_kinds("let") == kind_bit(token_kind::variable_identifier));
+    static_assert(name_kinds("lets") == kind_bit(token_kind::general_name));
+    static_assert(name_kinds("9z") == 0);
+
+    /*
+        A trie of all reserved operators: walking it along the text finds the longest operator in one pass
+        node 0 is the root; next == 0 means there is no transition
+    */
+    constexpr std::size_t operator_characters_amount(){
+        std::size_t amount = 0;
+        for (auto const &[kind, text]: token::reserved_operator_values)
+            amount += text.size();
+        return amount;
+    }
+
+    struct operator_trie{
+        static constexpr std::size_t max_nodes = operator_characters_amount() + 1;
+        static_assert(max_nodes <= 256, "node indices are stored as std::uint8_t");
+
+        std::array<std::array<std::uint8_t, 128>, max_nodes> next{};
+        std::array<token_kind_set, max_nodes> accepted_kinds{};
+        std::size_t nodes_amount = 1;
+
+        constexpr std::uint8_t step(std::uint8_t node, char c) const{
+            auto const index = static_cast<unsigned char>(c);
+            return index < 128 ? next[node][index] : 0;
+        }
+    };
+
+    constexpr operator_trie build_operator_trie(){
+        auto trie = operator_trie{};
+        for (auto const &[kind, text]: token::reserved_operator_values){
+            std::uint8_t node = 0;
+            for (auto const c: text){
+                auto &child = trie.next[node][static_cast<unsigned char>(c)];
+                if (child == 0)
+                    child = static_cast<std::uint8_t>(trie.nodes_amount++);
+                node = child;
+            }
+            trie.accepted_kinds[node] |= kind_bit(kind);
+        }
+        return trie;
+    }
+
+    inline constexpr auto operators = build_operator_trie();
+
+    constexpr token_kind_set operator_kinds(std::string_view text){
+        std::uint8_t node = 0;
+        for (auto const c: text)
+            if ((node = operators.step(node, c)) == 0)
+                return 0;
+        return operators.accepted_kinds[node];
+    }
+    static_assert(operator_kinds("->") == (kind_bit(token_kind::function_type_builder) | kind_bit(token_kind::lambda_expression_introduction)));
+    static_assert(operator_kinds("::") == kind_bit(token_kind::namespace_resolution_operator));
+    static_assert(operator_kinds("-") == 0);
+}
+
+#endif
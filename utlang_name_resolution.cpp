@@ -0,0 +1,266 @@
+#include "utlang_name_resolution.hpp"
+
+using namespace utlang::syntax;
+
+namespace{
+    template<class... F>
+    struct overloaded: F...{
+        using F::operator()...;
+    };
+
+    constexpr utlang::resolution::namespace_id no_namespace = UINT32_MAX;
+}
+
+namespace utlang::resolution{
+
+binding program_names::find(flat_map<binding> const &table, std::span<const symbol_id> parts, namespace_id from) const{
+    for (auto scope = from;; scope = parents[scope]){
+        auto inner = scope;
+        for (auto const part: parts.first(parts.size() - 1)){
+            auto const child = children.find(key(inner, part));
+            if (not child){
+                inner = no_namespace;
+                break;
+            }
+            inner = *child;
+        }
+        if (inner != no_namespace)
+            if (auto const found = table.find(key(inner, parts.back())))
+                return *found;
+        if (scope == top_namespace)
+            return binding{};
+    }
+}
+
+class name_resolver{
+    public:
+        name_resolver(program_names &names, symbol_table &symbols): names(names), ignored_name(symbols.intern("_")){}
+
+        void declare(Program_AST const &interface, bool with_values);
+        void collect(node_list<Statement const> statements, namespace_id scope);
+        void bind_statements(node_list<Statement const> statements, namespace_id scope);
+
+    private:
+        namespace_id enter(namespace_id scope, symbol_id name);
+        namespace_id enter_all(std::span<const symbol_id> path);
+        binding define(void const *definition, binding_kind kind);
+
+        void bind(void const *node, binding bound){
+            if (bound.kind != binding_kind::unbound)
+                names.bindings[reinterpret_cast<std::uintptr_t>(node)] = bound;
+        }
+        void bind_expression(Expression expression, namespace_id scope);
+        void bind_pattern(Case_pattern pattern, namespace_id scope);
+        void bind_type(Type type, namespace_id scope);
+        void push_local(Variable const &binder);
+        void pop_locals(std::size_t kept);
+
+        program_names &names;
+        symbol_id const ignored_name;
+        flat_map<std::uint32_t> innermost_local; // by name: the number of the local + 1, 0 for none
+        struct local{
+            symbol_id name;
+            std::uint32_t hidden; // what innermost_local had for the name before
+        };
+        std::vector<local> locals;
+};
+
+namespace_id name_resolver::enter(namespace_id scope, symbol_id name){
+    auto &child = names.children[program_names::key(scope, name)];
+    if (child == top_namespace){ // nothing is a child of the top namespace, so it is a new one
+        child = static_cast<namespace_id>(names.parents.size());
+        names.parents.push_back(scope);
+    }
+    return child;
+}
+
+namespace_id name_resolver::enter_all(std::span<const symbol_id> path){
+    auto scope = top_namespace;
+    for (auto const part: path)
+        scope = enter(scope, part);
+    return scope;
+}
+
+binding name_resolver::define(void const *definition, binding_kind kind){
+    auto const index = static_cast<std::uint32_t>(names.definitions.size());
+    names.definitions[reinterpret_cast<std::uintptr_t>(definition)] = index;
+    return binding{kind, index};
+}
+
+// the names in an interface are whole
+void name_resolver::declare(Program_AST const &interface, bool with_values){
+    for (auto const &statement: interface.code.statement_list)
+        std::visit(overloaded{
+            [&](Type_definition const *definition){
+                auto const path = definition->type.name.parts();
+                names.types[program_names::key(enter_all(path.first(path.size() - 1)), path.back())] = define(definition, binding_kind::type);
+                for (auto const &constructor: definition->constructors){
+                    auto const constructor_path = constructor.name.name.parts();
+                    names.values[program_names::key(enter_all(constructor_path.first(constructor_path.size() - 1)), constructor_path.back())] =
+                        define(&constructor, binding_kind::constructor);
+                }
+            },
+            [&](Variable_definition const *definition){
+                if (not with_values)
+                    return;
+                auto const path = definition->name.name.parts();
+                names.values[program_names::key(enter_all(path.first(path.size() - 1)), path.back())] = define(definition, binding_kind::value);
+            },
+            [](auto const *){}
+        }, statement.st);
+}
+
+// top-level statements, and those of namespaces and of blocks among them, define names in their namespace
+void name_resolver::collect(node_list<Statement const> statements, namespace_id scope){
+    for (auto const &statement: statements)
+        std::visit(overloaded{
+            [&](Type_definition const *definition){
+                names.types[program_names::key(scope, definition->type.name.back())] = define(definition, binding_kind::type);
+                for (auto const &constructor: definition->constructors)
+                    names.values[program_names::key(scope, constructor.name.name.back())] = define(&constructor, binding_kind::constructor);
+            },
+            [&](Variable_definition const *definition){
+                names.values[program_names::key(scope, definition->name.name.back())] = define(definition, binding_kind::value);
+            },
+            [&](Namespace_definition const *definition){
+                collect(definition->content.statement_list, enter(scope, definition->name));
+            },
+            [&](Block const *block){
+                collect(block->statement_list, scope);
+            },
+            [](auto const *){}
+        }, statement.st);
+}
+
+void name_resolver::bind_statements(node_list<Statement const> statements, namespace_id scope){
+    for (auto const &statement: statements)
+        std::visit(overloaded{
+            [&](Type_definition const *definition){
+                bind(&definition->type, binding{binding_kind::type, names.definition_of(definition)});
+                for (auto const &constructor: definition->constructors){
+                    bind(&constructor.name, binding{binding_kind::constructor, names.definition_of(&constructor)});
+                    for (auto const field_type: constructor.field_types)
+                        bind_type(field_type, scope);
+                }
+            },
+            [&](Variable_definition const *definition){
+                bind(&definition->name, binding{binding_kind::value, names.definition_of(definition)});
+                bind_type(definition->type, scope);
+                bind_expression(definition->value, scope);
+            },
+            [&](Namespace_definition const *definition){
+                bind_statements(definition->content.statement_list, enter(scope, definition->name));
+            },
+            [&](Expression const *expression){
+                bind_expression(*expression, scope);
+            },
+            [&](Block const *block){
+                bind_statements(block->statement_list, scope);
+            },
+            [](Import_declaration const *){}
+        }, statement.st);
+}
+
+void name_resolver::push_local(Variable const &binder){
+    auto const number = static_cast<std::uint32_t>(locals.size());
+    auto &innermost = innermost_local[binder.name.back()];
+    locals.push_back(local{binder.name.back(), innermost});
+    innermost = number + 1;
+    bind(&binder, binding{binding_kind::local, number});
+}
+
+void name_resolver::pop_locals(std::size_t kept){
+    for (; locals.size() > kept; locals.pop_back())
+        innermost_local[locals.back().name] = locals.back().hidden;
+}
+
+// in the order the type checker infers them
+void name_resolver::bind_expression(Expression expression, namespace_id scope){
+    std::visit(overloaded{
+        [&](Variable const *variable){
+            if (variable->name.size() == 1)
+                if (auto const number = innermost_local.find(variable->name.back()); number and *number > 0){
+                    bind(variable, binding{binding_kind::local, *number - 1});
+                    return;
+                }
+            bind(variable, names.find_value(variable->name.parts(), scope));
+        },
+        [&](Application const *application){
+            for (auto const argument: application->arguments)
+                bind_expression(argument, scope);
+        },
+        [&](Match const *match){
+            bind_expression(match->scrutinee, scope);
+            for (auto const &match_case: match->cases){
+                auto const outer_locals = locals.size();
+                bind_pattern(match_case.match_expr, scope);
+                bind_expression(match_case.result_expr, scope);
+                pop_locals(outer_locals);
+            }
+        },
+        [&](Lambda const *lambda){
+            auto const outer_locals = locals.size();
+            if (lambda->binder.name.back() != ignored_name)
+                push_local(lambda->binder);
+            bind_expression(lambda->body, scope);
+            pop_locals(outer_locals);
+        },
+        [&](Block const *block){
+            // a local definition is seen by the statements after it, not by its own value
+            auto const outer_locals = locals.size();
+            for (auto const &statement: block->statement_list){
+                if (auto const definition = std::get_if<Variable_definition *>(&statement.st)){
+                    bind_type((*definition)->type, scope);
+                    bind_expression((*definition)->value, scope);
+                    push_local((*definition)->name);
+                }else if (auto const e = std::get_if<Expression *>(&statement.st))
+                    bind_expression(**e, scope);
+            }
+            pop_locals(outer_locals);
+        }
+    }, expression.expr);
+}
+
+void name_resolver::bind_pattern(Case_pattern pattern, namespace_id scope){
+    if (auto const variable = std::get_if<Variable *>(&pattern.expr)){
+        if ((*variable)->name.back() != ignored_name)
+            push_local(**variable);
+        return;
+    }
+    auto const &application = *std::get<Case_pattern_application *>(pattern.expr);
+    bind(&application.cons, names.find_value(application.cons.name.parts(), scope));
+    for (auto const argument: application.args)
+        bind_pattern(argument, scope);
+}
+
+void name_resolver::bind_type(Type type, namespace_id scope){
+    std::visit(overloaded{
+        [&](Simple_Type const *simple){
+            if (simple) // no annotation
+                bind(simple, names.find_type(simple->name.parts(), scope));
+        },
+        [&](Function_Type const *function){
+            bind_type(function->argument_type, scope);
+            bind_type(function->result_type, scope);
+        },
+        [&](Type_Application const *application){
+            for (auto const part: application->types)
+                bind_type(part, scope);
+        }
+    }, type.type);
+}
+
+program_names resolve_names(Program_AST const &program, std::span<const Program_AST *const> imports, std::span<const Program_AST *const> dependencies,
+                            symbol_table &symbols){
+    auto names = program_names{};
+    auto resolver = name_resolver{names, symbols};
+    for (auto const interface: imports)
+        resolver.declare(*interface, true);
+    for (auto const interface: dependencies)
+        resolver.declare(*interface, false);
+    resolver.collect(program.code.statement_list, top_namespace);
+    resolver.bind_statements(program.code.statement_list, top_namespace);
+    return names;
+}
+
+}
@@ -0,0 +1,145 @@
+#ifndef UTLANG_NAME_RESOLUTION_HPP
+#define UTLANG_NAME_RESOLUTION_HPP
+
+#include <span>
+#include <vector>
+#include <cstdint>
+#include "utlang_syntax_tree_builder.hpp"
+#include "utlang_symbol_table.hpp"
+
+/*
+    Binds every name of a program to what it names, once, before the passes that use the names
+    Namespaces are numbered, and what they define is in flat open-addressing tables keyed by the namespace and the interned id:
+    a::b::f  seen from namespace n is looked for in n, its parent, ... up to the top namespace (the innermost first),
+    going down a and b from each; that is a few probes, and no string is hashed or compared
+    A later definition of a name hides an earlier one
+    Locals (lambda binders, pattern variables, lets in blocks) are numbered from the start of the top-level definition or
+    statement they are in, in the order they come into scope: the order in which the type checker pushes them
+*/
+namespace utlang::resolution{
+
+    // open addressing with linear probing, for keys made of ids or addresses (all bits set is not a key)
+    template<class V>
+    class flat_map{
+        public:
+            V const *find(std::uint64_t key) const{
+                if (keys.empty())
+                    return nullptr;
+                for (auto slot = home(key);; slot = (slot + 1) & (keys.size() - 1)){
+                    if (keys[slot] == key)
+                        return &values[slot];
+                    if (keys[slot] == empty_key)
+                        return nullptr;
+                }
+            }
+
+            // a new key has the value V{}
+            V &operator[](std::uint64_t key){
+                if ((count + 1) * 4 > keys.size() * 3)
+                    grow();
+                auto slot = home(key);
+                while (keys[slot] != key and keys[slot] != empty_key)
+                    slot = (slot + 1) & (keys.size() - 1);
+                if (keys[slot] == empty_key){
+                    keys[slot] = key;
+                    ++count;
+                }
+                return values[slot];
+            }
+
+            std::size_t size() const{
+                return count;
+            }
+
+        private:
+            static constexpr std::uint64_t empty_key = UINT64_MAX;
+
+            // Fibonacci hashing: the top bits of the product
+            std::size_t home(std::uint64_t key) const{
+                return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15u) >> (64 - bits));
+            }
+
+            void grow(){
+                auto old_keys = std::move(keys);
+                auto old_values = std::move(values);
+                bits = bits == 0 ? 4 : bits + 1;
+                keys.assign(std::size_t{1} << bits, empty_key);
+                values.assign(std::size_t{1} << bits, V{});
+                count = 0;
+                for (std::size_t i = 0; i < old_keys.size(); ++i)
+                    if (old_keys[i] != empty_key)
+                        (*this)[old_keys[i]] = std::move(old_values[i]);
+            }
+
+            std::vector<std::uint64_t> keys;
+            std::vector<V> values;
+            std::size_t count = 0;
+            unsigned bits = 0;
+    };
+
+    using namespace_id = std::uint32_t;
+    inline constexpr namespace_id top_namespace = 0;
+
+    enum class binding_kind: std::uint8_t{
+        unbound,     // also a type variable: the type checker tells them apart
+        local,       // index: the number of the local
+        value,       // index: the definition, a let
+        constructor, // index: the definition, a constructor
+        type         // index: the definition, a type
+    };
+
+    struct binding{
+        binding_kind kind = binding_kind::unbound;
+        std::uint32_t index = 0;
+    };
+
+    class program_names{
+        public:
+            // the binding of a Variable, Constructor or Simple_Type node of the program; definitions are bound to themselves
+            binding of(void const *node) const{
+                auto const found = bindings.find(reinterpret_cast<std::uintptr_t>(node));
+                return found ? *found : binding{};
+            }
+
+            // the number of a Variable_definition, Constructor_definition or Type_definition node, of the program or of its imports
+            std::uint32_t definition_of(void const *definition) const{
+                return *definitions.find(reinterpret_cast<std::uintptr_t>(definition));
+            }
+
+            std::size_t definition_count() const{
+                return definitions.size();
+            }
+
+            // names that are not in the program (those of imported declarations are whole) are looked up from the top namespace
+            binding find_value(std::span<const symbol_id> name, namespace_id from = top_namespace) const{
+                return find(values, name, from);
+            }
+
+            binding find_type(std::span<const symbol_id> name, namespace_id from = top_namespace) const{
+                return find(types, name, from);
+            }
+
+        private:
+            friend class name_resolver;
+
+            static std::uint64_t key(namespace_id scope, symbol_id name){
+                return std::uint64_t{scope} << 32 | name;
+            }
+
+            binding find(flat_map<binding> const &table, std::span<const symbol_id> name, namespace_id from) const;
+
+            std::vector<namespace_id> parents{top_namespace};
+            flat_map<namespace_id> children; // by (namespace, name)
+            flat_map<binding> values;        // lets and constructors, by (namespace, name)
+            flat_map<binding> types;
+            flat_map<binding> bindings;      // by node address
+            flat_map<std::uint32_t> definitions;
+    };
+
+    // imports: interfaces whose types and values are seen; dependencies: interfaces whose types (and constructors) alone are
+    // (see check_module() in utlang_type_checker.hpp); their nodes are not bound, only what the program uses of them
+    program_names resolve_names(syntax::Program_AST const &program, std::span<const syntax::Program_AST *const> imports = {},
+                                std::span<const syntax::Program_AST *const> dependencies = {}, symbol_table &symbols = symbol_table::global());
+}
+
+#endif
@@ -0,0 +1,223 @@
+#include <bit>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include "utlang_simd_scan.hpp"
+#include "utlang_lexer.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define UTLANG_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace utlang::simd;
+using utlang::tokenisation::lexer::character_class;
+using utlang::tokenisation::lexer::class_of;
+
+namespace{
+
+    character_masks classify_scalar(char const *block){
+        auto masks = character_masks{};
+        for (std::size_t i = 0; i < block_size; ++i){
+            switch (class_of(block[i])){
+                case character_class::name_like:     masks.name_like     |= std::uint32_t{1} << i; break;
+                case character_class::operator_like: masks.operator_like |= std::uint32_t{1} << i; break;
+                case character_class::new_line_like: masks.new_line_like |= std::uint32_t{1} << i; break;
+                case character_class::other: break;
+            }
+        }
+        return masks;
+    }
+
+    std::uint32_t pair_mask_scalar(char const *block, char first, char second_a, char second_b){
+        std::uint32_t mask = 0;
+        for (std::size_t i = 0; i < block_size; ++i)
+            if (block[i] == first and (block[i + 1] == second_a or block[i + 1] == second_b))
+                mask |= std::uint32_t{1} << i;
+        return mask;
+    }
+
+#ifdef UTLANG_SIMD_X86
+
+    /*
+        Signed byte compares: bytes >= 0x80 are negative, so they never fall into an ASCII range
+        letters are folded to lower case with | 0x20 before the range check
+    */
+
+    __attribute__((target("sse2"))) inline __m128i in_range_sse2(__m128i x, char low, char high){
+        return _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(static_cast<char>(low - 1))), _mm_cmplt_epi8(x, _mm_set1_epi8(static_cast<char>(high + 1))));
+    }
+
+    __attribute__((target("avx2"))) inline __m256i in_range_avx2(__m256i x, char low, char high){
+        return _mm256_and_si256(_mm256_cmpgt_epi8(x, _mm256_set1_epi8(static_cast<char>(low - 1))), _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(high + 1)), x));
+    }
+
+    struct sse2_masks{
+        std::uint32_t name_like, operator_like, new_line_like;
+    };
+
+    __attribute__((target("sse2"))) sse2_masks classify_sse2_half(char const *half){
+        auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(half));
+        auto const letters = in_range_sse2(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+        auto const digits = in_range_sse2(v, '0', '9');
+        auto const underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+        auto const name = _mm_or_si128(_mm_or_si128(letters, digits), underscore);
+        auto const printable = in_range_sse2(v, '!', '~');
+        auto const new_line = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+        return sse2_masks{
+            static_cast<std::uint32_t>(_mm_movemask_epi8(name)),
+            static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_andnot_si128(name, printable))),
+            static_cast<std::uint32_t>(_mm_movemask_epi8(new_line))
+        };
+    }
+
+    __attribute__((target("sse2"))) character_masks classify_sse2(char const *block){
+        auto const low = classify_sse2_half(block);
+        auto const high = classify_sse2_half(block + 16);
+        return character_masks{
+            low.name_like | high.name_like << 16,
+            low.operator_like | high.operator_like << 16,
+            low.new_line_like | high.new_line_like << 16
+        };
+    }
+
+    __attribute__((target("sse2"))) inline std::uint32_t pair_mask_sse2_half(char const *half, char first, char second_a, char second_b){
+        auto const v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(half));
+        auto const next = _mm_loadu_si128(reinterpret_cast<__m128i const *>(half + 1));
+        auto const second = _mm_or_si128(_mm_cmpeq_epi8(next, _mm_set1_epi8(second_a)), _mm_cmpeq_epi8(next, _mm_set1_epi8(second_b)));
+        return static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(first)), second)));
+    }
+
+    __attribute__((target("sse2"))) std::uint32_t pair_mask_sse2(char const *block, char first, char second_a, char second_b){
+        return pair_mask_sse2_half(block, first, second_a, second_b) | pair_mask_sse2_half(block + 16, first, second_a, second_b) << 16;
+    }
+
+    __attribute__((target("avx2"))) character_masks classify_avx2(char const *block){
+        auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(block));
+        auto const letters = in_range_avx2(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+        auto const digits = in_range_avx2(v, '0', '9');
+        auto const underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+        auto const name = _mm256_or_si256(_mm256_or_si256(letters, digits), underscore);
+        auto const printable = in_range_avx2(v, '!', '~');
+        auto const new_line = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+        return character_masks{
+            static_cast<std::uint32_t>(_mm256_movemask_epi8(name)),
+            static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_andnot_si256(name, printable))),
+            static_cast<std::uint32_t>(_mm256_movemask_epi8(new_line))
+        };
+    }
+
+    __attribute__((target("avx2"))) std::uint32_t pair_mask_avx2(char const *block, char first, char second_a, char second_b){
+        auto const v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(block));
+        auto const next = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(block + 1));
+        auto const second = _mm256_or_si256(_mm256_cmpeq_epi8(next, _mm256_set1_epi8(second_a)), _mm256_cmpeq_epi8(next, _mm256_set1_epi8(second_b)));
+        return static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(first)), second)));
+    }
+
+#endif
+
+    constexpr auto scalar_kernels = kernel_set{"scalar", classify_scalar, pair_mask_scalar};
+#ifdef UTLANG_SIMD_X86
+    constexpr auto sse2_kernels = kernel_set{"sse2", classify_sse2, pair_mask_sse2};
+    constexpr auto avx2_kernels = kernel_set{"avx2", classify_avx2, pair_mask_avx2};
+#endif
+
+    kernel_set const *detect_kernels(){
+#ifdef UTLANG_SIMD_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return &avx2_kernels;
+        if (__builtin_cpu_supports("sse2"))
+            return &sse2_kernels;
+#endif
+        return &scalar_kernels;
+    }
+
+    std::atomic<kernel_set const *> selected_kernels = nullptr;
+
+    std::uint32_t valid_bits(std::size_t length){
+        return length >= block_size ? ~std::uint32_t{0} : (std::uint32_t{1} << length) - 1;
+    }
+
+    // first byte for which hit(masks) has its bit set
+    template<class H>
+    char const *find_first(char const *begin, char const *end, H hit){
+        auto const &k = kernels();
+        for (; end - begin >= static_cast<std::ptrdiff_t>(block_size); begin += block_size)
+            if (auto const mask = hit(k.classify(begin)))
+                return begin + std::countr_zero(mask);
+        if (begin == end)
+            return end;
+        auto tail = std::array<char, block_size>{}; // the last partial block, padded with '\0' (space-like)
+        std::memcpy(tail.data(), begin, end - begin);
+        auto const mask = hit(k.classify(tail.data())) & valid_bits(end - begin);
+        return mask ? begin + std::countr_zero(mask) : end;
+    }
+
+    char const *find_first_pair(char const *begin, char const *end, char first, char second_a, char second_b){
+        auto const &k = kernels();
+        for (; end - begin > static_cast<std::ptrdiff_t>(block_size); begin += block_size)
+            if (auto const mask = k.pair_mask(begin, first, second_a, second_b))
+                return begin + std::countr_zero(mask);
+        if (begin == end)
+            return end;
+        auto tail = std::array<char, block_size + 1>{};
+        std::memcpy(tail.data(), begin, end - begin);
+        auto const mask = k.pair_mask(tail.data(), first, second_a, second_b) & valid_bits(end - begin);
+        return mask ? begin + std::countr_zero(mask) : end;
+    }
+}
+
+namespace utlang::simd{
+
+kernel_set const &kernels(){
+    auto current = selected_kernels.load(std::memory_order_relaxed);
+    if (not current)[[unlikely]]{
+        current = detect_kernels();
+        selected_kernels.store(current, std::memory_order_relaxed);
+    }
+    return *current;
+}
+
+bool select_kernels(std::string_view name){
+    auto const best = detect_kernels();
+    for (auto const candidate: {best, &scalar_kernels}){
+        if (candidate->name == name){
+            selected_kernels.store(candidate);
+            return true;
+        }
+    }
+#ifdef UTLANG_SIMD_X86
+    if (name == "sse2" and best == &avx2_kernels){
+        selected_kernels.store(&sse2_kernels);
+        return true;
+    }
+#endif
+    return false;
+}
+
+char const *find_token_like(char const *begin, char const *end){
+    return find_first(begin, end, [](character_masks m){return m.name_like | m.operator_like;});
+}
+
+char const *find_not_name_like(char const *begin, char const *end){
+    return find_first(begin, end, [](character_masks m){return ~m.name_like;});
+}
+
+char const *find_not_operator_like(char const *begin, char const *end){
+    return find_first(begin, end, [](character_masks m){return ~m.operator_like;});
+}
+
+char const *find_new_line(char const *begin, char const *end){
+    return find_first(begin, end, [](character_masks m){return m.new_line_like;});
+}
+
+char const *find_comment_start(char const *begin, char const *end){
+    return find_first_pair(begin, end, '/', '/', '*');
+}
+
+char const *find_block_comment_end(char const *begin, char const *end){
+    return find_first_pair(begin, end, '*', '/', '/');
+}
+
+}
@@ -0,0 +1,47 @@
+#ifndef UTLANG_SIMD_SCAN_HPP
+#define UTLANG_SIMD_SCAN_HPP
+
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+
+/*
+    Vectorised scanning for the tokeniser
+    The text is looked at in blocks of 32 bytes; a kernel turns a block into bitmasks (bit i - byte i)
+    Kernels: AVX2 (32 bytes at a time), SSE2 (2 x 16 bytes), scalar (portable)
+    The best one the CPU supports is picked on first use
+*/
+namespace utlang::simd{
+
+    inline constexpr std::size_t block_size = 32;
+
+    struct character_masks{
+        std::uint32_t name_like;        // a-z A-Z 0-9 _
+        std::uint32_t operator_like;    // printable ASCII punctuation except _
+        std::uint32_t new_line_like;    // \n \r
+        // everything else is space-like
+    };
+
+    struct kernel_set{
+        char const *name;
+        // reads block_size bytes
+        character_masks (*classify)(char const *block);
+        // bytes equal to `first` followed by `second_a` or `second_b`; reads block_size + 1 bytes
+        std::uint32_t (*pair_mask)(char const *block, char first, char second_a, char second_b);
+    };
+
+    kernel_set const &kernels();
+
+    // forces a kernel set ("avx2", "sse2" or "scalar"); returns false if it is not available
+    bool select_kernels(std::string_view name);
+
+    // all of these return `end` if nothing is found
+    char const *find_token_like(char const *begin, char const *end);     // first name- or operator-like byte
+    char const *find_not_name_like(char const *begin, char const *end);
+    char const *find_not_operator_like(char const *begin, char const *end);
+    char const *find_new_line(char const *begin, char const *end);
+    char const *find_comment_start(char const *begin, char const *end);   // first "//" or "/*"
+    char const *find_block_comment_end(char const *begin, char const *end); // first "*/"
+}
+
+#endif
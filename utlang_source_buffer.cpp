@@ -0,0 +1,106 @@
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <utility>
+#include <system_error>
+#include "utlang_source_buffer.hpp"
+
+#if __has_include(<sys/mman.h>) && __has_include(<sys/stat.h>) && __has_include(<fcntl.h>) && __has_include(<unistd.h>)
+#define UTLANG_HAS_MMAP 1
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace utlang;
+
+namespace{
+    std::string read_whole_stream(std::istream &stream){
+        return std::string(std::istreambuf_iterator<char>{stream}, std::istreambuf_iterator<char>{});
+    }
+
+    [[noreturn]] void throw_file_error(std::string const &file_name){
+        throw std::system_error(errno, std::generic_category(), file_name);
+    }
+}
+
+source_buffer::source_buffer(std::string const &file_name): file_name(file_name){
+    if (file_name == "-"){
+        owned_text = std::make_unique<std::string const>(read_whole_stream(std::cin));
+        return;
+    }
+#ifdef UTLANG_HAS_MMAP
+    auto const descriptor = ::open(file_name.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        throw_file_error(file_name);
+
+    struct stat status{};
+    if (::fstat(descriptor, &status) == 0 and S_ISREG(status.st_mode) and status.st_size > 0){
+        auto const mapping = ::mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapping != MAP_FAILED){
+            ::madvise(mapping, static_cast<std::size_t>(status.st_size), MADV_SEQUENTIAL);
+            mapped_text = static_cast<char const *>(mapping);
+            mapped_size = static_cast<std::size_t>(status.st_size);
+            ::close(descriptor);
+            return;
+        }
+    }
+
+    // a pipe, an empty file or a failed mapping: read it once
+    auto text = std::string{};
+    char buffer[1 << 16];
+    while (true){
+        auto const read_amount = ::read(descriptor, buffer, sizeof(buffer));
+        if (read_amount < 0){
+            if (errno == EINTR)
+                continue;
+            auto const error = errno;
+            ::close(descriptor);
+            errno = error;
+            throw_file_error(file_name);
+        }
+        if (read_amount == 0)
+            break;
+        text.append(buffer, static_cast<std::size_t>(read_amount));
+    }
+    ::close(descriptor);
+    owned_text = std::make_unique<std::string const>(std::move(text));
+#else
+    auto file = std::ifstream(file_name, std::ios::binary);
+    if (not file)
+        throw_file_error(file_name);
+    owned_text = std::make_unique<std::string const>(read_whole_stream(file));
+#endif
+}
+
+source_buffer::source_buffer(std::istream &stream, std::string name): file_name(std::move(name)), owned_text(std::make_unique<std::string const>(read_whole_stream(stream))) {}
+
+source_buffer::source_buffer(source_buffer &&other) noexcept:
+    file_name(std::move(other.file_name)), mapped_text(std::exchange(other.mapped_text, nullptr)),
+    mapped_size(std::exchange(other.mapped_size, 0)), owned_text(std::move(other.owned_text)) {}
+
+source_buffer &source_buffer::operator=(source_buffer &&other) noexcept{
+    if (this != &other){
+        release();
+        file_name = std::move(other.file_name);
+        mapped_text = std::exchange(other.mapped_text, nullptr);
+        mapped_size = std::exchange(other.mapped_size, 0);
+        owned_text = std::move(other.owned_text);
+    }
+    return *this;
+}
+
+source_buffer::~source_buffer(){
+    release();
+}
+
+void source_buffer::release(){
+#ifdef UTLANG_HAS_MMAP
+    if (mapped_text)
+        ::munmap(const_cast<char *>(mapped_text), mapped_size);
+#endif
+    mapped_text = nullptr;
+    mapped_size = 0;
+}
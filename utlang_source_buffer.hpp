@@ -0,0 +1,54 @@
+#ifndef UTLANG_SOURCE_BUFFER_HPP
+#define UTLANG_SOURCE_BUFFER_HPP
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <istream>
+
+namespace utlang{
+
+    /*
+        The text of one source file, kept alive for the whole compilation
+        Tokens and AST names are views into it, so it must outlive them
+        Regular files are memory-mapped read-only (no copy at all);
+        pipes, stdin and systems without mmap are read once into an owned string
+        A move keeps the text where it is (the mapping, or the owned string on the heap), so views into it stay valid
+    */
+    class source_buffer{
+        public:
+            // "-" is stdin; throws std::system_error if the file cannot be read
+            explicit source_buffer(std::string const &file_name);
+            explicit source_buffer(std::istream &stream, std::string name = "<stream>");
+
+            source_buffer(source_buffer const &) = delete;
+            source_buffer &operator=(source_buffer const &) = delete;
+            source_buffer(source_buffer &&other) noexcept;
+            source_buffer &operator=(source_buffer &&other) noexcept;
+            ~source_buffer();
+
+            std::string_view text() const{
+                if (mapped_text)
+                    return {mapped_text, mapped_size};
+                return owned_text ? std::string_view{*owned_text} : std::string_view{};
+            }
+
+            std::string const &name() const{
+                return file_name;
+            }
+
+            bool is_memory_mapped() const{
+                return mapped_text != nullptr;
+            }
+
+        private:
+            void release();
+
+            std::string file_name;
+            char const *mapped_text = nullptr;
+            std::size_t mapped_size = 0;
+            std::unique_ptr<std::string const> owned_text; // not inline: short strings would move with the object
+    };
+}
+
+#endif
@@ -0,0 +1,119 @@
+#include <bit>
+#include <algorithm>
+#include "utlang_symbol_table.hpp"
+
+using namespace utlang;
+
+namespace{
+    // FNV-1a; names are short
+    std::uint64_t hash_name(std::string_view name){
+        auto hash = std::uint64_t{14695981039346656037u};
+        for (auto const c: name)
+            hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211u;
+        return hash;
+    }
+
+    // names are short: a loop beats a call to memcmp
+    bool same_text(char const *text, std::size_t size, std::string_view name){
+        if (size != name.size())
+            return false;
+        for (std::size_t i = 0; i < size; ++i)
+            if (text[i] != name[i])
+                return false;
+        return true;
+    }
+
+    struct segment_position{
+        std::size_t segment;
+        std::size_t offset;
+    };
+
+    // segment k starts at first_segment_size * (2^k - 1)
+    segment_position locate(symbol_id id, std::size_t first_segment_size){
+        auto const segment = static_cast<std::size_t>(std::bit_width(id / first_segment_size + 1) - 1);
+        return {segment, id - first_segment_size * ((std::size_t{1} << segment) - 1)};
+    }
+}
+
+symbol_table::symbol_table() = default;
+
+symbol_table::~symbol_table(){
+    for (auto &segment: segments)
+        delete[] segment.load();
+}
+
+std::string_view &symbol_table::name_slot(symbol_id id){
+    auto const [segment, offset] = locate(id, first_segment_size);
+    auto names = segments[segment].load(std::memory_order_acquire);
+    if (not names)[[unlikely]]{
+        auto lock = std::lock_guard{segments_mutex};
+        names = segments[segment].load(std::memory_order_relaxed);
+        if (not names){
+            names = new std::string_view[first_segment_size << segment];
+            segments[segment].store(names, std::memory_order_release);
+        }
+    }
+    return names[offset];
+}
+
+// the shard is chosen by the top bits of the hash, the slot by the low ones
+symbol_table::entry const *symbol_table::find(entry_table const *table, std::uint64_t hash, std::string_view name){
+    if (not table)
+        return nullptr;
+    for (auto slot = hash & table->mask;; slot = (slot + 1) & table->mask){
+        auto const found = table->slots[slot].load(std::memory_order_acquire);
+        if (not found or (found->hash == hash and same_text(found->text, found->size, name)))
+            return found;
+    }
+}
+
+void symbol_table::insert(entry_table &table, entry const *added){
+    auto slot = added->hash & table.mask;
+    while (table.slots[slot].load(std::memory_order_relaxed))
+        slot = (slot + 1) & table.mask;
+    table.slots[slot].store(added, std::memory_order_release);
+}
+
+symbol_id symbol_table::intern(std::string_view name){
+    auto const hash = hash_name(name);
+    auto const shard_index = hash >> (64 - shard_bits);
+    auto &current = current_tables[shard_index];
+    if (auto const found = find(current.load(std::memory_order_acquire), hash, name))
+        return found->id;
+
+    auto &s = shards[shard_index];
+    auto lock = std::lock_guard{s.mutex};
+    if (auto const found = find(current.load(std::memory_order_relaxed), hash, name)) // added in the meantime
+        return found->id;
+
+    if ((s.count + 1) * 2 > (s.tables.empty() ? 0 : s.tables.back()->mask + 1)){
+        auto const size = s.tables.empty() ? std::size_t{64} : (s.tables.back()->mask + 1) * 2;
+        auto larger = std::make_unique<entry_table>(entry_table{size - 1, std::make_unique<std::atomic<entry const *>[]>(size)});
+        if (not s.tables.empty())
+            for (std::size_t slot = 0; slot <= s.tables.back()->mask; ++slot)
+                if (auto const old = s.tables.back()->slots[slot].load(std::memory_order_relaxed))
+                    insert(*larger, old);
+        current.store(larger.get(), std::memory_order_release);
+        s.tables.push_back(std::move(larger));
+    }
+
+    auto const added = s.texts.make<entry>();
+    auto const text = static_cast<char *>(s.texts.allocate(name.size(), 1));
+    std::copy(name.begin(), name.end(), text);
+    auto const id = next_id.fetch_add(1, std::memory_order_relaxed);
+    *added = entry{hash, text, static_cast<std::uint32_t>(name.size()), id};
+    name_slot(id) = std::string_view{text, name.size()};
+    insert(*s.tables.back(), added);
+    ++s.count;
+    return id;
+}
+
+std::string_view symbol_table::name(symbol_id id) const{
+    auto const [segment, offset] = locate(id, first_segment_size);
+    return segments[segment].load(std::memory_order_acquire)[offset];
+}
+
+symbol_table &symbol_table::global(){
+    static symbol_table table;
+    return table;
+}
@@ -0,0 +1,85 @@
+#ifndef UTLANG_SYMBOL_TABLE_HPP
+#define UTLANG_SYMBOL_TABLE_HPP
+
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <string_view>
+#include "utlang_arena.hpp"
+
+namespace utlang{
+
+    // dense: the n-th different name gets id n
+    using symbol_id = std::uint32_t;
+
+    /*
+        Interns names: every different name is stored once and gets a symbol_id, so names compare as integers
+        intern() may be called from any number of threads; the table is split into shards by hash,
+        each with its own open-addressing table and text storage
+        A name that is already there is found without locking: entries are published with release stores and never move,
+        and a full table is replaced by a larger one (the old one is kept for readers still probing it);
+        only adding a name takes the lock of its shard
+        name() does not lock; an id has to be passed from the interning thread the usual way (future, join, ...)
+    */
+    class symbol_table{
+        public:
+            symbol_table();
+            symbol_table(symbol_table const &) = delete;
+            symbol_table &operator=(symbol_table const &) = delete;
+            ~symbol_table();
+
+            symbol_id intern(std::string_view name);
+
+            // the text stays valid as long as the table
+            std::string_view name(symbol_id id) const;
+
+            std::size_t size() const{
+                return next_id.load(std::memory_order_relaxed);
+            }
+
+            // the table of the whole process, used by the parser
+            static symbol_table &global();
+
+        private:
+            static constexpr unsigned shard_bits = 6;
+            static constexpr std::size_t first_segment_size = 1024;
+            static constexpr std::size_t segments_amount = 32;
+
+            struct entry{
+                std::uint64_t hash;
+                char const *text; // right after the entry, so that a lookup reads one cache line
+                std::uint32_t size;
+                symbol_id id;
+            };
+
+            // open addressing with linear probing; at most half full
+            struct entry_table{
+                std::size_t mask;
+                std::unique_ptr<std::atomic<entry const *>[]> slots;
+            };
+
+            struct shard{
+                std::mutex mutex; // for adding names
+                std::vector<std::unique_ptr<entry_table>> tables; // the current one last
+                std::size_t count = 0;
+                utlang::arena texts{16 * 1024};
+            };
+
+            static entry const *find(entry_table const *table, std::uint64_t hash, std::string_view name);
+            static void insert(entry_table &table, entry const *added);
+
+            // id -> name: segment k holds first_segment_size * 2^k names and is allocated when first needed
+            std::string_view &name_slot(symbol_id id);
+
+            std::array<std::atomic<entry_table const *>, std::size_t{1} << shard_bits> current_tables{}; // apart from the shards: a lookup reads nothing else
+            std::array<shard, std::size_t{1} << shard_bits> shards;
+            std::atomic<symbol_id> next_id{0};
+            std::mutex segments_mutex;
+            std::array<std::atomic<std::string_view *>, segments_amount> segments{};
+    };
+}
+
+#endif
@@ -1,180 +1,544 @@
 #include <tuple>
 #include <stack>
+#include <span>
+#include <cstdint>
+#include <array>
 #include "utlang_syntax_tree_builder.hpp"
 #include "compiler_stream.hpp"
+#include "utlang_thread_pool.hpp"
 
 using namespace utlang::syntax;
 using token = utlang::tokenisation::token;
+using token_kind = utlang::tokenisation::token_kind;
 
+// the position of the matching bracket for every bracket token of the whole program, and where the top-level statements end
+class bracket_table{
+    public:
+        explicit bracket_table(std::span<const token> all_tokens): all_tokens(all_tokens), partner(all_tokens.size()) {}
 
-Variable                    build_Variable                  (std::vector<token> const &token_list);
-Constructor                 build_Constructor               (std::vector<token> const &token_list);
-Expression                  build_Expression                (std::vector<token> const &token_list);
-Application                 build_Application               (std::vector<token> const &token_list);
-Lambda                      build_Lambda                    (std::vector<token> const &token_list);
-Case_pattern                build_Case_pattern              (std::vector<token> const &token_list);
-Case_pattern_application    build_Case_pattern_application  (std::vector<token> const &token_list);
-Case                        build_Case                      (std::vector<token> const &token_list);
-Match                       build_Match                     (std::vector<token> const &token_list);
-Expression                  build_Expression                (std::vector<token> const &token_list);
-Type                        build_Type                      (std::vector<token> const &token_list);
-Simple_Type                 build_Simple_Type               (std::vector<token> const &token_list);
-Function_Type               build_Function_Type             (std::vector<token> const &token_list);
-Type_Application            build_Type_Application          (std::vector<token> const &token_list);
-Statement                   build_Statement                 (std::vector<token> const &token_list);
-Block                       build_Block                     (std::vector<token> const &token_list);
-Type_definition             build_Type_definition           (std::vector<token> const &token_list);
-Variable_definition         build_Variable_definition       (std::vector<token> const &token_list);
-Namespace_definition        build_Namespace_definition      (std::vector<token> const &token_list);
-Import_declaration          build_Import_declaration        (std::vector<token> const &token_list);
-
-// give the tokens between the brackets + all following tokens
-std::pair<std::vector<token>, std::vector<token>> find_closing_grouping_bracket(std::vector<token> const &token_list, size_t const opening_bracket_position);
-std::pair<std::vector<token>, std::vector<token>> find_closing_block_bracket(std::vector<token> const &token_list, size_t const opening_bracket_position);
-
-
-std::pair<std::vector<token>, std::vector<token>> find_closing_grouping_bracket(std::vector<token> const &token_list, size_t const opening_bracket_position){
-    size_t depth = 1;
-    for (size_t i = opening_bracket_position; i < token_list.size(); ++i){
-        if (token_list[i].is_grouping_bracket_left)
-            ++depth;
-        else if (token_list[i].is_grouping_bracket_right){
-            -- depth;
-            if (depth == 0){
-                std::vector<token> inside(token_list.cbegin() + opening_bracket_position + 1, token_list.cbegin() + i);
-                std::vector<token> after(token_list.cbegin() + i + 1, token_list.cend());
-                return std::make_pair(inside, after);
-            }
+        void pair(std::uint32_t opening_bracket_position, std::uint32_t closing_bracket_position){
+            partner[opening_bracket_position] = closing_bracket_position;
+            partner[closing_bracket_position] = opening_bracket_position;
         }
-    }
-    throw 0;
-}
-std::pair<std::vector<token>, std::vector<token>> find_closing_block_bracket(std::vector<token> const &token_list, size_t const opening_bracket_position){
-    size_t depth = 1;
-    for (size_t i = opening_bracket_position; i < token_list.size(); ++i){
-        if (token_list[i].is_block_bracket_left)
-            ++depth;
-        else if (token_list[i].is_block_bracket_right){
-            -- depth;
-            if (depth == 0){
-                std::vector<token> inside(token_list.cbegin() + opening_bracket_position + 1, token_list.cbegin() + i);
-                std::vector<token> after(token_list.cbegin() + i + 1, token_list.cend());
-                return std::make_pair(inside, after);
-            }
+
+        void add_top_level_separator(std::uint32_t separator_position){
+            top_level_separators.push_back(separator_position);
+        }
+
+        // positions of the ; at bracket depth 0, in order
+        std::span<const std::uint32_t> top_level_statement_separators() const{
+            return top_level_separators;
+        }
+
+        // the index of the first token of token_list in all_tokens
+        std::uint32_t position_of(std::span<const token> token_list) const{
+            return static_cast<std::uint32_t>(token_list.data() - all_tokens.data());
         }
+
+        // token_list must be a part of all_tokens
+        size_t closing_bracket_position(std::span<const token> token_list, size_t opening_bracket_position) const{
+            auto const offset = static_cast<size_t>(token_list.data() - all_tokens.data());
+            return partner[offset + opening_bracket_position] - offset;
+        }
+
+    private:
+        std::span<const token> all_tokens;
+        std::vector<std::uint32_t> partner;
+        std::vector<std::uint32_t> top_level_separators;
+};
+
+// state shared by all build_* functions of one build_AST call
+struct parse_context{
+    utlang::arena &nodes;
+    bracket_table const &brackets;
+    utlang::symbol_table &symbols;
+    std::uint32_t statement_start = 0; // the first token of the top-level statement being built
+
+    source_position position_of(std::span<const token> token_list) const{
+        return brackets.position_of(token_list) - statement_start;
     }
-    throw 0;
+};
+
+
+/*
+    Every build_X takes the tokens of one X from the front of token_list and leaves the rest there
+    Each token is looked at a constant number of times and brackets are skipped with the bracket table,
+    so parsing is linear in the number of tokens
+*/
+scoped_name_type            build_scoped_name               (parse_context &context, std::span<const token> &token_list);
+Variable                    build_Variable                  (parse_context &context, std::span<const token> &token_list);
+Constructor                 build_Constructor               (parse_context &context, std::span<const token> &token_list);
+Expression                  build_Expression                (parse_context &context, std::span<const token> &token_list, bool stops_at_block = false);
+Expression                  build_operand                   (parse_context &context, std::span<const token> &token_list, bool stops_at_block);
+Lambda                      build_Lambda                    (parse_context &context, std::span<const token> &token_list);
+Case_pattern                build_Case_pattern              (parse_context &context, std::span<const token> &token_list);
+Case_pattern                build_pattern_operand           (parse_context &context, std::span<const token> &token_list);
+Case                        build_Case                      (parse_context &context, std::span<const token> &token_list);
+Match                       build_Match                     (parse_context &context, std::span<const token> &token_list);
+Type                        build_Type                      (parse_context &context, std::span<const token> &token_list);
+Type                        build_type_operand              (parse_context &context, std::span<const token> &token_list);
+Simple_Type                 build_Simple_Type               (parse_context &context, std::span<const token> &token_list);
+Function_Type               build_Function_Type             (parse_context &context, Type argument_type, std::span<const token> &token_list);
+Type                        build_Type_Application          (parse_context &context, std::span<const token> &token_list);
+Statement                   build_Statement                 (parse_context &context, std::span<const token> &token_list);
+node_list<Statement>        build_statement_list            (parse_context &context, std::span<const token> &token_list, std::vector<std::uint32_t> *top_level_positions = nullptr);
+Block                       build_Block                     (parse_context &context, std::span<const token> &token_list);
+Constructor_definition      build_Constructor_definition    (parse_context &context, std::span<const token> &token_list);
+Type_definition             build_Type_definition           (parse_context &context, std::span<const token> &token_list);
+Variable_definition         build_Variable_definition       (parse_context &context, std::span<const token> &token_list);
+Namespace_definition        build_Namespace_definition      (parse_context &context, std::span<const token> &token_list);
+Import_declaration          build_Import_declaration        (parse_context &context, std::span<const token> &token_list);
+
+// give the tokens between the brackets + all following tokens; O(1), nothing is copied
+std::pair<std::span<const token>, std::span<const token>> find_closing_grouping_bracket(parse_context const &context, std::span<const token> token_list, size_t const opening_bracket_position);
+std::pair<std::span<const token>, std::span<const token>> find_closing_block_bracket(parse_context const &context, std::span<const token> token_list, size_t const opening_bracket_position);
+
+std::pair<std::span<const token>, std::span<const token>> split_at_closing_bracket(parse_context const &context, std::span<const token> token_list, size_t const opening_bracket_position){
+    auto const closing_bracket_position = context.brackets.closing_bracket_position(token_list, opening_bracket_position);
+    return std::make_pair(token_list.subspan(opening_bracket_position + 1, closing_bracket_position - opening_bracket_position - 1),
+                          token_list.subspan(closing_bracket_position + 1));
 }
 
-scoped_name_type build_scoped_name(std::vector<token> const &token_list){ // TO DO
-    ;
+std::pair<std::span<const token>, std::span<const token>> find_closing_grouping_bracket(parse_context const &context, std::span<const token> token_list, size_t const opening_bracket_position){
+    if (not token_list[opening_bracket_position].is_grouping_bracket_left())
+        throw 0;
+    return split_at_closing_bracket(context, token_list, opening_bracket_position);
 }
 
-Variable build_Variable(std::vector<token> const &token_list){ // TO DO
-    return Variable{.name = build_scoped_name(token_list)};
+std::pair<std::span<const token>, std::span<const token>> find_closing_block_bracket(parse_context const &context, std::span<const token> token_list, size_t const opening_bracket_position){
+    if (not token_list[opening_bracket_position].is_block_bracket_left())
+        throw 0;
+    return split_at_closing_bracket(context, token_list, opening_bracket_position);
 }
 
-Constructor build_Constructor(std::vector<token> const &token_list){ // TO DO
-    return Constructor{.name = build_scoped_name(token_list)};
+bool next_is(std::span<const token> token_list, token_kind kind){
+    return not token_list.empty() and token_list.front().is(kind);
 }
 
-Expression build_Expression(std::vector<token> const &token_list){ // TO DO
-    ;
+token const &take(std::span<const token> &token_list){
+    if (token_list.empty())
+        throw 0;
+    auto const &first = token_list.front();
+    token_list = token_list.subspan(1);
+    return first;
 }
 
-Application build_Application(std::vector<token> const &token_list){ // TO DO
-    ;
+token const &expect(std::span<const token> &token_list, token_kind kind){
+    if (not next_is(token_list, kind))
+        throw 0;
+    return take(token_list);
 }
 
-Lambda build_Lambda(std::vector<token> const &token_list){ // TO DO
-    ;
+void expect_end(std::span<const token> token_list){
+    if (not token_list.empty())
+        throw 0;
 }
 
-Case_pattern build_Case_pattern(std::vector<token> const &token_list){ // TO DO
-    ;
+// constructors are told apart from variables by the first letter of the last name part
+bool is_constructor_name(parse_context const &context, scoped_name_type name){
+    auto const first_letter = context.symbols.name(name.back()).front();
+    return first_letter >= 'A' and first_letter <= 'Z';
 }
 
-Case_pattern_application build_Case_pattern_application(std::vector<token> const &token_list){ // TO DO
-    ;
+bool starts_operand(token const &t, bool stops_at_block){
+    return t.is_general_name() or t.is_grouping_bracket_left() or t.is_match_expression_identifier() or
+           t.is_lambda_expression_identifier() or (t.is_block_bracket_left() and not stops_at_block);
 }
 
-Case build_Case(std::vector<token> const &token_list){ // TO DO
-    ;
+bool starts_type_operand(token const &t){
+    return t.is_general_name() or t.is_grouping_bracket_left();
 }
 
-Match build_Match(std::vector<token> const &token_list){ // TO DO
-    ;
+bool starts_pattern_operand(token const &t){
+    return t.is_general_name() or t.is_ignored_name() or t.is_grouping_bracket_left();
 }
 
-Expression build_Expression(std::vector<token> const &token_list){ // TO DO
-    ;
+scoped_name_type build_scoped_name(parse_context &context, std::span<const token> &token_list){
+    if (next_is(token_list, token_kind::ignored_name)){
+        auto const id = context.symbols.intern(take(token_list).token_value());
+        return scoped_name_type{std::span{&id, 1}, context.nodes};
+    }
+    // name :: name :: ... name; only names with more than inline_capacity parts need a buffer on the heap
+    std::size_t parts_amount = 1;
+    while (2 * parts_amount < token_list.size() and token_list[2 * parts_amount - 1].is_namespace_resolution_operator())
+        ++parts_amount;
+    auto inline_parts = std::array<utlang::symbol_id, scoped_name_type::inline_capacity>{};
+    auto long_parts = std::vector<utlang::symbol_id>(parts_amount > inline_parts.size() ? parts_amount : 0);
+    auto const parts = parts_amount > inline_parts.size() ? std::span{long_parts} : std::span{inline_parts}.first(parts_amount);
+    for (std::size_t i = 0; i < parts_amount; ++i){
+        if (i > 0)
+            expect(token_list, token_kind::namespace_resolution_operator);
+        parts[i] = context.symbols.intern(expect(token_list, token_kind::general_name).token_value());
+    }
+    return scoped_name_type{parts, context.nodes};
 }
 
-Type build_Type(std::vector<token> const &token_list){ // TO DO
-    ;
+// a name that is defined here, not referred to: no ns:: parts
+scoped_name_type build_simple_name(parse_context &context, std::span<const token> &token_list){
+    auto const name = build_scoped_name(context, token_list);
+    if (name.size() != 1)
+        throw 0;
+    return name;
+}
+
+Variable build_Variable(parse_context &context, std::span<const token> &token_list){
+    auto const position = context.position_of(token_list);
+    return Variable{.name = build_scoped_name(context, token_list), .position = position};
 }
 
-Simple_Type build_Simple_Type(std::vector<token> const &token_list){ // TO DO
-    return Simple_Type{.name = build_scoped_name(token_list)};
+Constructor build_Constructor(parse_context &context, std::span<const token> &token_list){
+    auto const position = context.position_of(token_list);
+    return Constructor{.name = build_scoped_name(context, token_list), .position = position};
 }
 
-Function_Type build_Function_Type(std::vector<token> const &token_list){ // TO DO
-    ;
+// application: operands side by side, left to right; binds tighter than anything else
+Expression build_Expression(parse_context &context, std::span<const token> &token_list, bool stops_at_block){
+    auto arguments = std::vector<Expression>{};
+    while (not token_list.empty() and starts_operand(token_list.front(), stops_at_block))
+        arguments.push_back(build_operand(context, token_list, stops_at_block));
+    if (arguments.empty())
+        throw 0;
+    if (arguments.size() == 1)
+        return arguments.front();
+    return Expression{context.nodes.make<Application>(context.nodes.copy(arguments))};
 }
 
-Type_Application build_Type_Application(std::vector<token> const &token_list){ // TO DO
-    ;
+// stops_at_block: a { ends the expression instead of starting a block (the scrutinee of a match)
+Expression build_operand(parse_context &context, std::span<const token> &token_list, bool stops_at_block){
+    auto const &first = token_list.front();
+    if (first.is_grouping_bracket_left()){
+        auto [inside, rest] = find_closing_grouping_bracket(context, token_list, 0);
+        auto const expression = build_Expression(context, inside);
+        expect_end(inside);
+        token_list = rest;
+        return expression;
+    }
+    if (first.is_block_bracket_left() and not stops_at_block)
+        return Expression{context.nodes.make<Block>(build_Block(context, token_list))};
+    if (first.is_match_expression_identifier())
+        return Expression{context.nodes.make<Match>(build_Match(context, token_list))};
+    if (first.is_lambda_expression_identifier())
+        return Expression{context.nodes.make<Lambda>(build_Lambda(context, token_list))};
+    return Expression{context.nodes.make<Variable>(build_Variable(context, token_list))};
 }
 
-Statement build_Statement(std::vector<token> const &token_list){ // TO DO
-    ;
+// the body takes everything up to the end of the enclosing expression
+Lambda build_Lambda(parse_context &context, std::span<const token> &token_list){
+    auto const position = context.position_of(token_list);
+    expect(token_list, token_kind::lambda_expression_identifier);
+    auto const binder_position = context.position_of(token_list);
+    auto const binder = Variable{.name = build_simple_name(context, token_list), .position = binder_position};
+    expect(token_list, token_kind::lambda_expression_introduction);
+    return Lambda{.binder = binder, .body = build_Expression(context, token_list), .position = position};
 }
 
-Block build_Block(std::vector<token> const &token_list){ // TO DO
-    ;
+Case_pattern build_Case_pattern(parse_context &context, std::span<const token> &token_list){
+    if (next_is(token_list, token_kind::grouping_bracket_left))
+        return build_pattern_operand(context, token_list);
+    auto const position = context.position_of(token_list);
+    auto const name = build_scoped_name(context, token_list);
+    if (not is_constructor_name(context, name)){
+        if (name.size() != 1)
+            throw 0;
+        return Case_pattern{context.nodes.make<Variable>(name, position)};
+    }
+    auto args = std::vector<Case_pattern>{};
+    while (not token_list.empty() and starts_pattern_operand(token_list.front()))
+        args.push_back(build_pattern_operand(context, token_list));
+    return Case_pattern{context.nodes.make<Case_pattern_application>(Constructor{.name = name, .position = position}, context.nodes.copy(args))};
 }
 
-Type_definition build_Type_definition(std::vector<token> const &token_list){ // TO DO
-    ;
+// (pattern), a variable, _ or a constructor without arguments
+Case_pattern build_pattern_operand(parse_context &context, std::span<const token> &token_list){
+    if (next_is(token_list, token_kind::grouping_bracket_left)){
+        auto [inside, rest] = find_closing_grouping_bracket(context, token_list, 0);
+        auto const pattern = build_Case_pattern(context, inside);
+        expect_end(inside);
+        token_list = rest;
+        return pattern;
+    }
+    auto const position = context.position_of(token_list);
+    auto const name = build_scoped_name(context, token_list);
+    if (is_constructor_name(context, name))
+        return Case_pattern{context.nodes.make<Case_pattern_application>(Constructor{.name = name, .position = position}, node_list<Case_pattern>{})};
+    if (name.size() != 1)
+        throw 0;
+    return Case_pattern{context.nodes.make<Variable>(name, position)};
+}
+
+Case build_Case(parse_context &context, std::span<const token> &token_list){
+    expect(token_list, token_kind::match_case_identifier);
+    auto const pattern = build_Case_pattern(context, token_list);
+    expect(token_list, token_kind::match_case_introduction);
+    return Case{.match_expr = pattern, .result_expr = build_Expression(context, token_list)};
+}
+
+Match build_Match(parse_context &context, std::span<const token> &token_list){
+    auto const position = context.position_of(token_list);
+    expect(token_list, token_kind::match_expression_identifier);
+    auto const scrutinee = build_Expression(context, token_list, true);
+    if (token_list.empty())
+        throw 0;
+    auto [inside, rest] = find_closing_block_bracket(context, token_list, 0);
+    token_list = rest;
+
+    auto cases = std::vector<Case>{};
+    while (not inside.empty()){
+        if (next_is(inside, token_kind::statement_separator)){
+            take(inside);
+            continue;
+        }
+        cases.push_back(build_Case(context, inside));
+        if (not inside.empty())
+            expect(inside, token_kind::statement_separator);
+    }
+    return Match{.scrutinee = scrutinee, .cases = context.nodes.copy(cases), .position = position};
+}
+
+// precedence climbing with two levels: application binds tighter than ->, and -> is right-associative
+Type build_Type(parse_context &context, std::span<const token> &token_list){
+    auto const argument_type = build_Type_Application(context, token_list);
+    if (not next_is(token_list, token_kind::function_type_builder))
+        return argument_type;
+    return Type{context.nodes.make<Function_Type>(build_Function_Type(context, argument_type, token_list))};
+}
+
+// (type) or a type name
+Type build_type_operand(parse_context &context, std::span<const token> &token_list){
+    if (next_is(token_list, token_kind::grouping_bracket_left)){
+        auto [inside, rest] = find_closing_grouping_bracket(context, token_list, 0);
+        auto const type = build_Type(context, inside);
+        expect_end(inside);
+        token_list = rest;
+        return type;
+    }
+    return Type{context.nodes.make<Simple_Type>(build_Simple_Type(context, token_list))};
 }
 
-Variable_definition build_Variable_definition(std::vector<token> const &token_list){ // TO DO
-    ;
+Simple_Type build_Simple_Type(parse_context &context, std::span<const token> &token_list){
+    auto const position = context.position_of(token_list);
+    return Simple_Type{.name = build_scoped_name(context, token_list), .position = position};
 }
 
-Namespace_definition build_Namespace_definition(std::vector<token> const &token_list){ // TO DO
-    ;
+// -> T2, the argument type has already been taken
+Function_Type build_Function_Type(parse_context &context, Type argument_type, std::span<const token> &token_list){
+    expect(token_list, token_kind::function_type_builder);
+    return Function_Type{.argument_type = argument_type, .result_type = build_Type(context, token_list)};
 }
 
-Import_declaration build_Import_declaration(std::vector<token> const &token_list){ // TO DO
-    ;
+// T1 T2 ...; a single operand is returned as it is
+Type build_Type_Application(parse_context &context, std::span<const token> &token_list){
+    auto types = std::vector<Type>{build_type_operand(context, token_list)};
+    while (not token_list.empty() and starts_type_operand(token_list.front()))
+        types.push_back(build_type_operand(context, token_list));
+    if (types.size() == 1)
+        return types.front();
+    return Type{context.nodes.make<Type_Application>(context.nodes.copy(types))};
 }
 
-void check_brackets_paired(std::vector<token> const &token_list){
+Statement build_Statement(parse_context &context, std::span<const token> &token_list){
+    auto const &first = token_list.front();
+    if (first.is_type_identifier())
+        return Statement{context.nodes.make<Type_definition>(build_Type_definition(context, token_list))};
+    if (first.is_variable_identifier())
+        return Statement{context.nodes.make<Variable_definition>(build_Variable_definition(context, token_list))};
+    if (first.is_namespace_identifier())
+        return Statement{context.nodes.make<Namespace_definition>(build_Namespace_definition(context, token_list))};
+    if (first.is_import_identifier())
+        return Statement{context.nodes.make<Import_declaration>(build_Import_declaration(context, token_list))};
+    if (first.is_block_bracket_left())
+        return Statement{context.nodes.make<Block>(build_Block(context, token_list))};
+    return Statement{context.nodes.make<Expression>(build_Expression(context, token_list))};
+}
+
+// st1; st2; ... - empty statements are skipped, the last ; may be left out
+// top_level_positions: the statements are top-level ones, their positions go there and the positions inside count from them
+node_list<Statement> build_statement_list(parse_context &context, std::span<const token> &token_list, std::vector<std::uint32_t> *top_level_positions){
+    auto statements = std::vector<Statement>{};
+    while (not token_list.empty()){
+        if (next_is(token_list, token_kind::statement_separator)){
+            take(token_list);
+            continue;
+        }
+        if (top_level_positions){
+            context.statement_start = context.brackets.position_of(token_list);
+            top_level_positions->push_back(context.statement_start);
+        }
+        statements.push_back(build_Statement(context, token_list));
+        if (not token_list.empty())
+            expect(token_list, token_kind::statement_separator);
+    }
+    return context.nodes.copy(statements);
+}
+
+Block build_Block(parse_context &context, std::span<const token> &token_list){
+    if (token_list.empty())
+        throw 0;
+    auto const position = context.position_of(token_list);
+    auto [inside, rest] = find_closing_block_bracket(context, token_list, 0);
+    token_list = rest;
+    return Block{.statement_list = build_statement_list(context, inside), .position = position};
+}
+
+Constructor_definition build_Constructor_definition(parse_context &context, std::span<const token> &token_list){
+    auto const position = context.position_of(token_list);
+    auto const name = Constructor{.name = build_simple_name(context, token_list), .position = position};
+    auto field_types = std::vector<Type>{};
+    while (not token_list.empty() and starts_type_operand(token_list.front()))
+        field_types.push_back(build_type_operand(context, token_list));
+    return Constructor_definition{.name = name, .field_types = context.nodes.copy(field_types)};
+}
+
+Type_definition build_Type_definition(parse_context &context, std::span<const token> &token_list){
+    expect(token_list, token_kind::type_identifier);
+    auto const position = context.position_of(token_list);
+    auto const type = Simple_Type{.name = build_simple_name(context, token_list), .position = position};
+    auto parameter_types = std::vector<Simple_Type>{};
+    while (next_is(token_list, token_kind::general_name)){
+        auto const parameter_position = context.position_of(token_list);
+        parameter_types.push_back(Simple_Type{.name = build_simple_name(context, token_list), .position = parameter_position});
+    }
+    expect(token_list, token_kind::definition_operator);
+
+    auto constructors = std::vector<Constructor_definition>{};
+    if (next_is(token_list, token_kind::general_name)){ // type Empty = ;
+        constructors.push_back(build_Constructor_definition(context, token_list));
+        while (next_is(token_list, token_kind::type_constructor_list_separator)){
+            take(token_list);
+            constructors.push_back(build_Constructor_definition(context, token_list));
+        }
+    }
+    return Type_definition{.type = type, .parameter_types = context.nodes.copy(parameter_types), .constructors = context.nodes.copy(constructors)};
+}
+
+Variable_definition build_Variable_definition(parse_context &context, std::span<const token> &token_list){
+    expect(token_list, token_kind::variable_identifier);
+    auto const position = context.position_of(token_list);
+    auto const name = Variable{.name = build_simple_name(context, token_list), .position = position};
+    auto type = Type{static_cast<Simple_Type *>(nullptr)};
+    if (next_is(token_list, token_kind::type_annotation)){
+        take(token_list);
+        type = build_Type(context, token_list);
+    }
+    expect(token_list, token_kind::definition_operator);
+    return Variable_definition{.name = name, .type = type, .value = build_Expression(context, token_list)};
+}
+
+Namespace_definition build_Namespace_definition(parse_context &context, std::span<const token> &token_list){
+    expect(token_list, token_kind::namespace_identifier);
+    auto const name = context.symbols.intern(expect(token_list, token_kind::general_name).token_value());
+    return Namespace_definition{.name = name, .content = build_Block(context, token_list)};
+}
+
+Import_declaration build_Import_declaration(parse_context &context, std::span<const token> &token_list){
+    expect(token_list, token_kind::import_identifier);
+    return Import_declaration{.module = build_scoped_name(context, token_list)};
+}
+
+// one pass over all tokens: throws if brackets are not paired, otherwise records the partner of every bracket and the top-level ;
+bracket_table check_brackets_paired(std::span<const token> token_list){
     enum class bracket_type: bool{grouping_bracket, block_bracket};
-    std::stack<bracket_type> bracket_order;
-    for (auto const &tok: token_list){
-        if (tok.is_grouping_bracket_left)
-            bracket_order.push(bracket_type::grouping_bracket);
-        else if (tok.is_block_bracket_left)
-            bracket_order.push(bracket_type::block_bracket);
-        else if (tok.is_grouping_bracket_right){
-            if (bracket_order.top() == bracket_type::grouping_bracket)
-                bracket_order.pop();
-            else
-                throw 0;
-        }else if (tok.is_block_bracket_right){
-            if (bracket_order.top() == bracket_type::block_bracket)
-                bracket_order.pop();
-            else
+    std::stack<std::pair<bracket_type, std::uint32_t>, std::vector<std::pair<bracket_type, std::uint32_t>>> bracket_order;
+    auto table = bracket_table{token_list};
+    for (std::uint32_t i = 0; i < token_list.size(); ++i){
+        auto const &tok = token_list[i];
+        if (tok.is_grouping_bracket_left())
+            bracket_order.emplace(bracket_type::grouping_bracket, i);
+        else if (tok.is_block_bracket_left())
+            bracket_order.emplace(bracket_type::block_bracket, i);
+        else if (tok.is_grouping_bracket_right() or tok.is_block_bracket_right()){
+            auto const expected = tok.is_grouping_bracket_right() ? bracket_type::grouping_bracket : bracket_type::block_bracket;
+            if (bracket_order.empty() or bracket_order.top().first != expected)
                 throw 0;
-        }
+            table.pair(bracket_order.top().second, i);
+            bracket_order.pop();
+        }else if (tok.is_statement_separator() and bracket_order.empty())
+            table.add_top_level_separator(i);
     }
     if (not bracket_order.empty())
         throw 0;
+    return table;
+}
+
+/*
+    Top-level statements do not depend on each other, so large programs are cut into runs of whole statements
+    (at the top-level ; found by check_brackets_paired) and the runs are parsed in parallel,
+    each into an arena of its own; the arenas are then absorbed and the statements joined in source order
+*/
+constexpr std::size_t min_tokens_per_parse_task = 1 << 14;
+
+std::vector<std::span<const token>> split_into_statement_runs(std::span<const token> token_list, bracket_table const &brackets, std::size_t tokens_per_run){
+    auto runs = std::vector<std::span<const token>>{};
+    std::size_t run_begin = 0;
+    for (auto const separator: brackets.top_level_statement_separators()){
+        if (separator + 1 - run_begin >= tokens_per_run){
+            runs.push_back(token_list.subspan(run_begin, separator + 1 - run_begin));
+            run_begin = separator + 1;
+        }
+    }
+    if (run_begin < token_list.size())
+        runs.push_back(token_list.subspan(run_begin));
+    return runs;
+}
+
+node_list<Statement> build_statement_list_parallel(parse_context &context, std::span<const token> token_list, std::vector<std::uint32_t> &statement_positions){
+    auto &pool = utlang::thread_pool::instance();
+    auto const tokens_per_run = std::max(token_list.size() / (pool.worker_count() * 4), min_tokens_per_parse_task);
+    auto const runs = split_into_statement_runs(token_list, context.brackets, tokens_per_run);
+    if (runs.size() < 2)
+        return build_statement_list(context, token_list, &statement_positions);
+
+    struct run_result{
+        std::unique_ptr<utlang::arena> nodes;
+        node_list<Statement> statements;
+        std::vector<std::uint32_t> statement_positions;
+    };
+    auto futures = std::vector<std::future<run_result>>{};
+    futures.reserve(runs.size());
+    for (auto const run: runs)
+        futures.push_back(pool.async([run, &brackets = context.brackets, &symbols = context.symbols]{
+            auto result = run_result{std::make_unique<utlang::arena>(), {}, {}};
+            auto run_context = parse_context{*result.nodes, brackets, symbols};
+            auto rest = run;
+            result.statements = build_statement_list(run_context, rest, &result.statement_positions);
+            return result;
+        }));
+
+    // every task refers to the bracket table, so all of them have to finish before an error is passed on
+    auto results = std::vector<run_result>{};
+    results.reserve(runs.size());
+    auto error = std::exception_ptr{};
+    for (auto &future: futures){
+        try{
+            results.push_back(pool.get(future));
+        }catch(...){
+            if (not error)
+                error = std::current_exception();
+        }
+    }
+    if (error)
+        std::rethrow_exception(error);
+
+    auto statements = std::vector<Statement>{};
+    for (auto &result: results){
+        statements.insert(statements.end(), result.statements.begin(), result.statements.end());
+        statement_positions.insert(statement_positions.end(), result.statement_positions.begin(), result.statement_positions.end());
+        context.nodes.absorb(std::move(*result.nodes));
+    }
+    return context.nodes.copy(statements);
+}
+
+Program_AST utlang::syntax::build_AST(std::vector<token> const &token_list, utlang::symbol_table &symbols){
+    auto nodes = std::make_unique<utlang::arena>();
+    auto const brackets = check_brackets_paired(token_list);
+    auto context = parse_context{*nodes, brackets, symbols};
+    auto statement_positions = std::vector<std::uint32_t>{};
+    auto const code = Block{.statement_list = build_statement_list_parallel(context, token_list, statement_positions), .position = 0};
+    return Program_AST{.code = code, .nodes = std::move(nodes), .statement_positions = std::move(statement_positions)};
 }
 
-Program_AST build_AST(std::vector<token> const &token_list){ // TO DO
-    check_brackets_paired(token_list);
-    ;
+node_list<Statement> utlang::syntax::build_statements(std::span<const token> tokens, utlang::arena &nodes, std::vector<std::uint32_t> &statement_positions, utlang::symbol_table &symbols){
+    auto const brackets = check_brackets_paired(tokens);
+    auto context = parse_context{nodes, brackets, symbols};
+    return build_statement_list(context, tokens, &statement_positions);
 }
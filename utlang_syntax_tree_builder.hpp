@@ -1,17 +1,27 @@
 #ifndef UTLANG_SYNTAX_TREE_BUILDER_HPP
 #define UTLANG_SYNTAX_TREE_BUILDER_HPP
 
-#include <string>
+#include <string_view>
 #include <vector>
+#include <span>
 #include <memory>
 #include <variant>
+#include <algorithm>
+#include <cstdint>
 #include "utlang_tokeniser.hpp"
+#include "utlang_arena.hpp"
+#include "utlang_symbol_table.hpp"
 
+// all nodes live in the arena of their Program_AST and refer to each other by pointer
 template<class... T>
-using indirect_variant = std::variant<std::unique_ptr<T>...>;
+using indirect_variant = std::variant<T*...>;
 
 using indirect_variant_index_type = size_t;
 
+// a sequence of nodes, stored in the arena
+template<class T>
+using node_list = std::span<T>;
+
 namespace utlang::syntax{
     /**
      * V - name
@@ -25,57 +35,120 @@ namespace utlang::syntax{
      * * (generic)???
      * 
      * Statement:
-     * * type _V_ = _V_ _T1_ _T2_... | _V2_ ...;
-     * * let _V_ : _T_ = _E_;
+     * * type _V_ _V1_ ... = _Con_ _T1_ _T2_... | _Con2_ ...;
+     * * let _V_ : _T_ = _E_;         (val is the same as let; ": _T_" can be left out)
      * * namespace _V_ {_S1_; _S2_;...};
-     * * import ???;
+     * * import _V_;
+     * * _E_;
+     * * {_S1_; _S2_; ...};
      * 
      * Expression:
      * * _V_
-     * * (_V1_ _V2_ ...)
-     * * match _V_ {case _Con_ ...: _E1_; ...; case _ : _E_}
-     * * \_V_ -> _E_
+     * * _E1_ _E2_ ...               (application, binds tighter than everything else)
+     * * (_E_)
+     * * match _E_ {case _P_: _E1_; ...; case _ : _E_;}
+     * * \_V_ -> _E_                 (extends as far right as possible)
+     * * {_S1_; ...; _E_;}            (block, its value is the last expression)
+     * 
+     * Pattern:
+     * * _                           (anything)
+     * * _v_                         (binds; lower case)
+     * * _Con_ _P1_ _P2_ ...         (constructors start with an upper case letter)
+     * 
+     * Type:  _T1_ _T2_ ... (application) binds tighter than ->, -> is right-associative
      **/
 
-    // ns1::ns2::ns3::...::name
-    using scoped_name_type = std::vector<std::string>;
+    // ns1::ns2::ns3::...::name, as interned symbol ids (see utlang_symbol_table.hpp)
+    // up to inline_capacity parts are stored in the node itself, longer names in the arena
+    class scoped_name_type{
+        public:
+            static constexpr std::size_t inline_capacity = 3;
+
+            scoped_name_type() = default;
+
+            // parts must have at least one element
+            scoped_name_type(std::span<const utlang::symbol_id> parts, utlang::arena &nodes): parts_amount(static_cast<std::uint32_t>(parts.size())){
+                if (parts.size() <= inline_capacity)
+                    std::copy(parts.begin(), parts.end(), storage.inline_parts);
+                else
+                    storage.outside_parts = nodes.copy(parts).data();
+            }
+
+            std::span<const utlang::symbol_id> parts() const{
+                return {parts_amount <= inline_capacity ? storage.inline_parts : storage.outside_parts, parts_amount};
+            }
+
+            std::size_t size() const{
+                return parts_amount;
+            }
+
+            utlang::symbol_id back() const{
+                return parts()[parts_amount - 1];
+            }
+
+            friend bool operator==(scoped_name_type const &a, scoped_name_type const &b){
+                return std::ranges::equal(a.parts(), b.parts());
+            }
+
+        private:
+            std::uint32_t parts_amount = 0;
+            union{
+                utlang::symbol_id inline_parts[inline_capacity];
+                utlang::symbol_id const *outside_parts;
+            } storage{};
+    };
+
+    // where a node starts: the index of its first token, counted from the first token of the top-level statement it is in
+    // (see Program_AST::statement_positions), so that a statement does not depend on what is before it
+    using source_position = std::uint32_t;
 
     struct Variable{
         // can be _ (ignored name)
         scoped_name_type name;
+        source_position position;
     };
 
     struct Constructor{ // special names for type constructors
         scoped_name_type name;
-        // type is not inferred at this stage
+        source_position position;
+        // type is inferred by the type checker (see utlang_type_checker.hpp)
     };
 
     // Expression
-    struct Expression;
+    struct Application;
+    struct Lambda;
+    struct Match;
+    struct Block;
+
+    struct Expression{
+        // TO DO; index enum
+        indirect_variant<Variable, Application, Match, Lambda, Block> expr;
+    };
 
     struct Application{
         // (e1 e2 e3 ...)
-        std::vector<Expression> arguments;
+        node_list<Expression> arguments;
     };
 
     struct Lambda{
         // \x -> e
         Variable binder;
         Expression body;
+        source_position position;
     };
 
     // Expression: Case, Match
-    struct Case_pattern;
-
-    struct Case_pattern_application{
-        Constructor cons;
-        std::vector<Case_pattern> args;
-    };
+    struct Case_pattern_application;
 
     struct Case_pattern{
         indirect_variant<Variable, Case_pattern_application> expr;
     };
 
+    struct Case_pattern_application{
+        Constructor cons;
+        node_list<Case_pattern> args;
+    };
+
     struct Case{
         // case ...: ...
         Case_pattern match_expr;
@@ -83,20 +156,25 @@ namespace utlang::syntax{
     };
     
     struct Match{
-        // match (x){case ... : ...; case ... : ...; ...}
-        std::vector<Case> cases;
+        // match x {case ... : ...; case ... : ...; ...}
+        Expression scrutinee;
+        node_list<Case> cases;
+        source_position position;
     };
 
-    struct Expression{
+    // Type
+    struct Simple_Type;
+    struct Function_Type;
+    struct Type_Application;
+
+    struct Type{
         // TO DO; index enum
-        indirect_variant<Variable, Application, Match, Lambda> expr;
+        indirect_variant<Simple_Type, Function_Type, Type_Application> type; // Generics?
     };
 
-    // Type
-    struct Type;
-
     struct Simple_Type{
         scoped_name_type name;
+        source_position position;
     };
 
     struct Function_Type{
@@ -106,56 +184,74 @@ namespace utlang::syntax{
     };
 
     struct Type_Application{
-        std::vector<Type> types;
+        node_list<Type> types;
     };
 
-    struct Type{
+    // Statement
+    struct Type_definition;
+    struct Variable_definition;
+    struct Namespace_definition;
+    struct Import_declaration;
+
+    struct Statement{
         // TO DO; index enum
-        indirect_variant<Simple_Type, Function_Type, Type_Application> type; // Generics?
+        indirect_variant<Block, Type_definition, Variable_definition, Namespace_definition, Import_declaration, Expression> st;
     };
 
-    // Statement
-    struct Statement;
-
     struct Block{
         // {st1; st2; ...};
-        std::vector<Statement> statement_list;
+        node_list<Statement> statement_list;
+        source_position position;
+    };
+
+    struct Constructor_definition{
+        // C t1' t2' ...
+        Constructor name;
+        node_list<Type> field_types;
     };
 
     struct Type_definition{
         // type T t1 t2 ... = C1 t1' t2' | ...; 
         Simple_Type type;
-        std::vector<Simple_Type> parameter_types;
-        std::vector<Constructor> constructors;
+        node_list<Simple_Type> parameter_types;
+        node_list<Constructor_definition> constructors;
     };
 
     struct Variable_definition{
-        // let x : T = e;
+        // let x : T = e;  or  let x = e;  (the type is deduced)
         Variable name;
-        Type type;
+        Type type; // a null Simple_Type * when there is no annotation
         Expression value;
     };
 
     struct Namespace_definition{
         // namespace ns {st1; st2; ...};
-        std::string name;
+        utlang::symbol_id name;
         Block content;
     };
 
-    [[maybe_unused]] struct Import_declaration{ /* import ???; */};
-
-    struct Statement{
-        // TO DO; index enum
-        indirect_variant<Block, Type_definition, Variable_definition, Namespace_definition, Import_declaration> st;
+    struct Import_declaration{
+        // import ns1::module;
+        scoped_name_type module;
     };
 
     // Program
     struct Program_AST{
         // st1; st2; ...
         Block code;
+        // owns every node of the tree; released in one go
+        std::unique_ptr<utlang::arena> nodes;
+        // the index of the first token of every statement of code in the tokens given to build_AST
+        std::vector<std::uint32_t> statement_positions;
     };
 
-    Program_AST build_AST(const std::vector<utlang::tokenisation::token>&);
+    // throws on a syntax error; names are interned in `symbols`, so the tree does not refer to the source text
+    Program_AST build_AST(const std::vector<utlang::tokenisation::token>&, utlang::symbol_table &symbols = utlang::symbol_table::global());
+
+    // a part of a program that starts and ends between top-level statements, for trees kept up to date piece by piece
+    // (see utlang_incremental.hpp); the nodes are made in `nodes`, the position of every statement in the tokens is appended to statement_positions
+    node_list<Statement> build_statements(std::span<const utlang::tokenisation::token> tokens, utlang::arena &nodes, std::vector<std::uint32_t> &statement_positions,
+                                          utlang::symbol_table &symbols = utlang::symbol_table::global());
     
 }
 
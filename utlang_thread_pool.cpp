@@ -0,0 +1,114 @@
+#include <algorithm>
+#include "utlang_thread_pool.hpp"
+
+using namespace utlang;
+
+namespace{
+    // which pool (if any) the current thread works for, and its queue
+    thread_local thread_pool const *current_pool = nullptr;
+    thread_local std::size_t current_queue = 0;
+
+    std::atomic<std::size_t> requested_worker_count{0};
+}
+
+thread_pool::thread_pool(std::size_t worker_count){
+    worker_count = std::max<std::size_t>(worker_count, 1);
+    queues.reserve(worker_count + 1);
+    for (std::size_t i = 0; i < worker_count + 1; ++i)
+        queues.push_back(std::make_unique<task_queue>());
+    workers.reserve(worker_count);
+    for (std::size_t i = 0; i < worker_count; ++i)
+        workers.emplace_back([this, i](std::stop_token stop){worker_loop(i + 1, stop);});
+}
+
+thread_pool::~thread_pool(){
+    for (auto &worker: workers)
+        worker.request_stop();
+    {
+        auto lock = std::lock_guard{sleep_mutex};
+        wake_up.notify_all();
+    }
+    workers.clear(); // joins
+}
+
+void thread_pool::submit(unique_task task){
+    auto const queue_index = current_pool == this ? current_queue : 0;
+    {
+        auto &queue = *queues[queue_index];
+        auto lock = std::lock_guard{queue.mutex};
+        queue.tasks.push_back(std::move(task));
+    }
+    pending_tasks.fetch_add(1, std::memory_order_release);
+    auto lock = std::lock_guard{sleep_mutex};
+    wake_up.notify_one();
+}
+
+unique_task thread_pool::take_task(std::size_t preferred_queue, bool waiting){
+    if (pending_tasks.load(std::memory_order_acquire) == 0)
+        return {};
+
+    { // own queue first, newest task
+        auto &queue = *queues[preferred_queue];
+        auto lock = std::lock_guard{queue.mutex};
+        if (not queue.tasks.empty()){
+            auto task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            pending_tasks.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+
+    // steal the oldest task from somebody else, starting with the neighbour
+    for (std::size_t offset = 1; offset < queues.size(); ++offset){
+        auto &queue = *queues[(preferred_queue + offset) % queues.size()];
+        auto lock = waiting ? std::unique_lock{queue.mutex} : std::unique_lock{queue.mutex, std::try_to_lock};
+        if (lock and not queue.tasks.empty()){
+            auto task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            pending_tasks.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    return {};
+}
+
+bool thread_pool::run_pending_task(){
+    auto task = take_task(current_pool == this ? current_queue : 0);
+    if (not task)
+        return false;
+    task();
+    return true;
+}
+
+void thread_pool::worker_loop(std::size_t index, std::stop_token stop){
+    current_pool = this;
+    current_queue = index;
+    while (not stop.stop_requested()){
+        if (auto task = take_task(index)){
+            task();
+            continue;
+        }
+        // the tasks that are left may only be in queues that were busy: wait for their locks rather than spin on them
+        if (auto task = take_task(index, true)){
+            task();
+            continue;
+        }
+        auto lock = std::unique_lock{sleep_mutex};
+        wake_up.wait(lock, stop, [this]{return pending_tasks.load(std::memory_order_acquire) != 0;});
+    }
+}
+
+thread_pool &thread_pool::instance(){
+    static thread_pool pool{default_worker_count()};
+    return pool;
+}
+
+std::size_t thread_pool::default_worker_count(){
+    if (auto const requested = requested_worker_count.load())
+        return requested;
+    return std::max<std::size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+void thread_pool::set_default_worker_count(std::size_t worker_count){
+    requested_worker_count.store(worker_count);
+}
@@ -0,0 +1,145 @@
+#ifndef UTLANG_THREAD_POOL_HPP
+#define UTLANG_THREAD_POOL_HPP
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <chrono>
+#include <condition_variable>
+#include <type_traits>
+#include <utility>
+
+namespace utlang{
+
+
+/*
+    A move-only type-erased void() callable
+    (std::function requires copyable targets, std::packaged_task allocates a shared state)
+*/
+class unique_task{
+    struct callable_base{
+        virtual ~callable_base() = default;
+        virtual void operator()() = 0;
+    };
+
+    template<class F>
+    struct callable: callable_base{
+        F f;
+        callable(F &&f): f(std::move(f)) {}
+        void operator()() override{ f(); }
+    };
+
+    std::unique_ptr<callable_base> target;
+
+    public:
+    unique_task() = default;
+
+    template<class F>
+    requires (std::is_invocable_v<F&> and not std::is_same_v<std::remove_cvref_t<F>, unique_task>)
+    unique_task(F &&f): target(std::make_unique<callable<std::remove_cvref_t<F>>>(std::forward<F>(f))) {}
+
+    explicit operator bool() const{
+        return static_cast<bool>(target);
+    }
+
+    void operator()(){
+        (*target)();
+    }
+};
+
+
+/*
+    A process-wide work-stealing executor
+    Every worker owns a deque: it pushes and pops its own tasks at the back (LIFO, cache-warm)
+    and steals from the front of the other deques (FIFO, oldest work first) when it runs dry.
+    Tasks submitted from outside the pool go to a shared injection queue.
+    Threads waiting for a result through wait() run pending tasks instead of sleeping.
+*/
+class thread_pool{
+    public:
+
+    explicit thread_pool(std::size_t worker_count);
+    thread_pool(thread_pool const &) = delete;
+    thread_pool &operator=(thread_pool const &) = delete;
+    ~thread_pool();
+
+    std::size_t worker_count() const{
+        return workers.size();
+    }
+
+    void submit(unique_task task);
+
+    template<class F>
+    requires (std::is_invocable_v<F&>)
+    auto async(F f){
+        using result_type = std::invoke_result_t<F&>;
+        auto promise = std::promise<result_type>{};
+        auto result = promise.get_future();
+        submit([f = std::move(f), promise = std::move(promise)]() mutable{
+            try{
+                if constexpr (std::is_void_v<result_type>){
+                    f();
+                    promise.set_value();
+                }else
+                    promise.set_value(f());
+            }catch(...){
+                promise.set_exception(std::current_exception());
+            }
+        });
+        return result;
+    }
+
+    // runs one pending task on the calling thread; returns false if there was nothing to run
+    bool run_pending_task();
+
+    // blocks until the future is ready, running pending tasks in the meantime
+    template<class T>
+    void wait(std::future<T> const &future){
+        while (future.wait_for(std::chrono::seconds::zero()) != std::future_status::ready)
+            if (not run_pending_task())
+                future.wait_for(std::chrono::microseconds(50));
+    }
+
+    template<class T>
+    T get(std::future<T> &future){
+        wait(future);
+        return future.get();
+    }
+
+    // the shared executor; created on first use with default_worker_count() workers
+    static thread_pool &instance();
+
+    // hardware concurrency unless changed with set_default_worker_count()
+    static std::size_t default_worker_count();
+
+    // only has an effect before the first call to instance()
+    static void set_default_worker_count(std::size_t worker_count);
+
+    private:
+
+    struct task_queue{
+        std::mutex mutex;
+        std::deque<unique_task> tasks;
+    };
+
+    void worker_loop(std::size_t index, std::stop_token stop);
+    // waiting: take the locks of the other queues instead of skipping the ones that are busy
+    unique_task take_task(std::size_t preferred_queue, bool waiting = false);
+
+    // queues[0] is the injection queue, queues[i + 1] belongs to worker i
+    std::vector<std::unique_ptr<task_queue>> queues;
+    std::vector<std::jthread> workers;
+
+    std::atomic<std::size_t> pending_tasks{0};
+    std::mutex sleep_mutex;
+    std::condition_variable_any wake_up;
+};
+
+
+}
+
+#endif
@@ -2,8 +2,12 @@
 #include <algorithm>
 #include <functional>
 #include <numeric>
+#include <iterator>
+#include <exception>
 #include "compiler_stream.hpp"
 #include "utlang_tokeniser.hpp"
+#include "utlang_lexer.hpp"
+#include "utlang_simd_scan.hpp"
 
 using namespace utlang::tokenisation;
 
@@ -14,32 +18,24 @@ constexpr bool is_general_name_like(const std::string_view input_text){
             not std::isdigit(static_cast<unsigned char>(input_text.front()));
 }
 
-token::token(const std::string_view input_text): token_value(input_text){
-    for (auto [a, b] : reserved_values)
-        this->*a = (input_text == b);
-    
-    is_general_name = is_general_name_like(input_text) and
-                      std::none_of(reserved_name_fields.cbegin(), reserved_name_fields.cend(), [this](const auto b){return this->*b;});
-}
-
-constexpr int token_possibilities_amount(const token &t){
-    // std::transform_reduce(token::reserved_indicators.cbegin(), token::reserved_indicators.cend(), int{}, std::plus<int>{}, [&t](bool token::*p)->int{return t.*p;});
-    int possibilities{};
-    for (auto const p: token::reserved_fields)
-        possibilities += t.*p;
-    return possibilities;
-}
+token::token(const std::string_view input_text): text_begin(input_text.data()), text_length(static_cast<std::uint32_t>(input_text.size())){
+    kinds |= lexer::reserved_kinds_of(input_text);
 
-constexpr bool token::is_not_determined() const{
-    return token_possibilities_amount(*this) == 0;
+    if (is_general_name_like(input_text) and not (kinds & reserved_name_kinds))
+        kinds |= kind_bit(token_kind::general_name);
 }
 
-constexpr bool token::is_uniquely_determined() const{
-    return token_possibilities_amount(*this) == 1;
+line_table::line_table(const std::string_view source_text): source_text(source_text){
+    line_starts.push_back(0);
+    for (std::size_t i = 0; i < source_text.size(); ++i)
+        if (source_text[i] == '\n')
+            line_starts.push_back(static_cast<std::uint32_t>(i + 1));
 }
 
-constexpr bool token::is_nonuniquely_determined() const{
-    return token_possibilities_amount(*this) > 1;
+source_location line_table::locate(char const *position) const{
+    auto const offset = static_cast<std::uint32_t>(position - source_text.data());
+    auto const line = std::upper_bound(line_starts.cbegin(), line_starts.cend(), offset) - 1;
+    return source_location{.line = static_cast<std::uint32_t>(line - line_starts.cbegin() + 1), .column = offset - *line + 1};
 }
 
 
@@ -81,37 +77,55 @@ bool symbol_is_token_like(char c){
 
 namespace utlang::tokenisation{
 
-// returns text between comments
+enum class comment_state{code, block_comment};
+
+// emits text between comments
 // Anything that LOOKS LIKE the start of a comment IS a start if a comment
-auto text_to_code_portions(std::string_view input_text){
-    auto pipeline = object_pipeline<std::string_view>{};
+// returns whether the text ends inside an unfinished block comment
+template<class E>
+comment_state for_each_code_portion(std::string_view input_text, E &&emit, comment_state state = comment_state::code){
+    auto const text_end = input_text.data() + input_text.size();
+    auto skip_block_comment = [&]{ // after its start; returns false if it is not closed
+        auto const comment_end = simd::find_block_comment_end(input_text.data(), text_end);
+        if (comment_end == text_end)
+            return false;
+        input_text.remove_prefix(comment_end - input_text.data() + token::block_comment_end.length());
+        return true;
+    };
+
+    if (state == comment_state::block_comment and not skip_block_comment()) // the text starts inside a comment
+        return comment_state::block_comment;
 
     while(not input_text.empty()){ // if file ends on a comment, don't push empty portion
-        auto const single_line_comment_position   = input_text.find(token::single_line_comment_identifier);
-        auto const block_comment_position         = input_text.find(token::block_comment_start);
+        auto const comment_start = simd::find_comment_start(input_text.data(), text_end); // whichever of // and /* comes first
+        auto const comment_position = static_cast<std::size_t>(comment_start - input_text.data());
 
-        if (single_line_comment_position == std::string_view::npos and block_comment_position == std::string_view::npos){ // no comments left
-            pipeline << input_text;
+        if (comment_start == text_end){ // no comments left
+            emit(input_text);
             break;
-        }else if (single_line_comment_position < block_comment_position){ // single-line comment appears first
-            if (single_line_comment_position)
-                pipeline << input_text.substr(0, single_line_comment_position);
-            input_text.remove_prefix(single_line_comment_position + token::single_line_comment_identifier.length());
-            auto const end_of_comment = std::find_if(input_text.cbegin(), input_text.cend(), symbol_is_new_line_like);
-            if (end_of_comment == input_text.cend()) // coment ends at the end-of-file [ok]
+        }
+        if (comment_position)
+            emit(input_text.substr(0, comment_position));
+        if (comment_start[1] == token::single_line_comment_identifier[1]){ // single-line comment
+            input_text.remove_prefix(comment_position + token::single_line_comment_identifier.length());
+            auto const end_of_comment = simd::find_new_line(input_text.data(), text_end);
+            if (end_of_comment == text_end) // coment ends at the end-of-file [ok]
                 break;
-            input_text.remove_prefix(end_of_comment - input_text.cbegin() + 1);
-        }else{ // multi-line comment appears first
-            if (block_comment_position)
-                pipeline << input_text.substr(0, block_comment_position);
-            input_text.remove_prefix(block_comment_position + token::block_comment_start.length());
-            auto const comment_length = input_text.find(token::block_comment_end);
-            if (comment_length == input_text.length())  // coment is not closed [bad]
-                throw 0;
-            input_text.remove_prefix(comment_length + token::block_comment_end.length());
+            input_text.remove_prefix(end_of_comment - input_text.data() + 1);
+        }else{ // multi-line comment
+            input_text.remove_prefix(comment_position + token::block_comment_start.length());
+            if (not skip_block_comment())  // coment is not closed (yet)
+                return comment_state::block_comment;
         }
     }
+    return comment_state::code;
+}
 
+// returns text between comments
+auto text_to_code_portions(std::string_view input_text){
+    auto pipeline = object_pipeline<std::string_view>{};
+    if (for_each_code_portion(input_text, [&](std::string_view portion){pipeline << portion;}) != comment_state::code)
+        throw 0; // coment is not closed [bad]
     return pipeline;
 }
 
@@ -121,31 +135,34 @@ class token_cluster{
         enum class cluster_type{name_like, operator_like} type;
 };
 
-auto code_portion_to_token_clusters(std::string_view code_portion){
-    auto pipeline = object_pipeline<token_cluster>{};
-
+template<class E>
+void for_each_token_cluster(std::string_view code_portion, E &&emit){
+    auto const portion_end = code_portion.data() + code_portion.size();
     while (true){
-        auto const current_token_position = std::find_if(code_portion.cbegin(), code_portion.cend(), symbol_is_token_like);
-        if (current_token_position == code_portion.cend())
+        auto const current_token_position = simd::find_token_like(code_portion.data(), portion_end);
+        if (current_token_position == portion_end)
             break;
-        code_portion.remove_prefix(current_token_position - code_portion.cbegin());  
+        code_portion.remove_prefix(current_token_position - code_portion.data());  
 
-        auto const search_function = symbol_is_name_like(code_portion.front()) ? symbol_is_name_like : symbol_is_operator_like;
-        auto const cluster_type    = symbol_is_name_like(code_portion.front()) ? token_cluster::cluster_type::name_like : token_cluster::cluster_type::operator_like;
+        auto const name_like       = symbol_is_name_like(code_portion.front());
+        auto const cluster_type    = name_like ? token_cluster::cluster_type::name_like : token_cluster::cluster_type::operator_like;
 
-        auto const current_token_end = std::find_if_not(code_portion.cbegin(), code_portion.cend(), search_function);
-        pipeline << token_cluster{code_portion.substr(0, current_token_end - code_portion.cbegin()), cluster_type};
-        code_portion.remove_prefix(current_token_end - code_portion.cbegin());
+        auto const current_token_end = name_like ? simd::find_not_name_like(code_portion.data(), portion_end) : simd::find_not_operator_like(code_portion.data(), portion_end);
+        emit(token_cluster{code_portion.substr(0, current_token_end - code_portion.data()), cluster_type});
+        code_portion.remove_prefix(current_token_end - code_portion.data());
     }
+}
 
+auto code_portion_to_token_clusters(std::string_view code_portion){
+    auto pipeline = object_pipeline<token_cluster>{};
+    for_each_token_cluster(code_portion, [&](token_cluster cluster){pipeline << cluster;});
     return pipeline;
 }
 
-auto split_cluster_into_tokens(token_cluster const &cluster){
-    auto pipeline = object_pipeline<token>{};
-
+template<class E>
+void for_each_token(token_cluster const &cluster, E &&emit){
     if (cluster.type == token_cluster::cluster_type::name_like)
-        pipeline << token{cluster.token_cluster_text};
+        emit(token{cluster.token_cluster_text});
     else{
         auto token_text = cluster.token_cluster_text; // may contain multiple tokens like ;;;
 
@@ -157,17 +174,30 @@ auto split_cluster_into_tokens(token_cluster const &cluster){
                 possible_token = token{possible_operator_text};
             }
 
-            pipeline << std::move(possible_token);
             if (possible_token.is_not_determined())[[unlikely]] // return the broken token anyway
                 throw 0;
+            emit(std::move(possible_token));
             
             token_text.remove_prefix(possible_operator_text.length());
         }
     }
+}
 
+auto split_cluster_into_tokens(token_cluster const &cluster){
+    auto pipeline = object_pipeline<token>{};
+    for_each_token(cluster, [&](token t){pipeline << std::move(t);});
     return pipeline;
 }
 
+// tokenises a piece of text on the calling thread, appending to tokens
+comment_state tokenise_chunk(std::string_view chunk, comment_state entry_state, std::vector<token> &tokens){
+    return for_each_code_portion(chunk, [&](std::string_view portion){
+        for_each_token_cluster(portion, [&](token_cluster const &cluster){
+            for_each_token(cluster, [&](token t){tokens.push_back(std::move(t));});
+        });
+    }, entry_state);
+}
+
 /*
                     (next symbol)   abc         ->;             ' '         '\n'
     (current_token) 
@@ -180,6 +210,99 @@ auto split_cluster_into_tokens(token_cluster const &cluster){
 
 std::vector<token> tokenise(const std::string_view input_text){
     return text_to_code_portions(input_text).transform_and_combine(code_portion_to_token_clusters).transform_and_combine(split_cluster_into_tokens).get();
+}
+
+void tokenise_streaming(const std::string_view input_text, std::function<void(token)> const &consumer, std::size_t queue_capacity){
+    auto portions = streaming_pipeline<std::string_view>{[input_text](auto &emit){
+        if (for_each_code_portion(input_text, emit) != comment_state::code)
+            throw 0; // coment is not closed [bad]
+    }, queue_capacity};
+    auto clusters = std::move(portions).transform_and_combine<token_cluster>([](std::string_view portion, auto &emit){for_each_token_cluster(portion, emit);}, queue_capacity);
+    auto tokens   = std::move(clusters).transform_and_combine<token>([](token_cluster const &cluster, auto &emit){for_each_token(cluster, emit);}, queue_capacity);
+    std::move(tokens).for_each(consumer);
+}
+
+/*
+    Chunks end right after a '\n', so no token, comment marker or single-line comment crosses a chunk edge:
+    the only state carried from one chunk to the next is whether a block comment is still open
+    1. every chunk is tokenised in parallel, assuming it starts outside a comment; its exit state is recorded
+    2. a serial prefix pass over the chunks finds their real entry states
+       (only chunks starting inside a comment need to be scanned again here)
+    3. those chunks are tokenised again in parallel, and all token vectors are concatenated in order
+*/
+std::vector<token> tokenise_parallel(const std::string_view input_text, std::size_t chunk_size){
+    auto &pool = thread_pool::instance();
+    if (chunk_size == 0)
+        chunk_size = std::max<std::size_t>(input_text.size() / (pool.worker_count() * 4), 1 << 18);
+
+    auto chunks = std::vector<std::string_view>{};
+    for (auto rest = input_text; not rest.empty();){
+        auto const end_of_line = rest.size() > chunk_size ? rest.find('\n', chunk_size - 1) : std::string_view::npos;
+        auto const length = end_of_line == std::string_view::npos ? rest.size() : end_of_line + 1;
+        chunks.push_back(rest.substr(0, length));
+        rest.remove_prefix(length);
+    }
+
+    struct chunk_result{
+        std::vector<token> tokens;
+        comment_state exit_state;
+        std::exception_ptr error; // only matters if the guessed entry state was right
+    };
+    auto tokenise_async = [&](std::string_view chunk, comment_state entry_state){
+        return pool.async([chunk, entry_state]{
+            auto result = chunk_result{};
+            try{
+                result.exit_state = tokenise_chunk(chunk, entry_state, result.tokens);
+            }catch(...){
+                result.error = std::current_exception();
+            }
+            return result;
+        });
+    };
+
+    auto speculative = std::vector<std::future<chunk_result>>{};
+    speculative.reserve(chunks.size());
+    for (auto const chunk: chunks)
+        speculative.push_back(tokenise_async(chunk, comment_state::code));
+    auto results = std::vector<chunk_result>{};
+    results.reserve(chunks.size());
+    for (auto &future: speculative)
+        results.push_back(pool.get(future));
+
+    auto retokenised = std::vector<std::pair<std::size_t, std::future<chunk_result>>>{};
+    auto state = comment_state::code;
+    for (std::size_t i = 0; i < chunks.size(); ++i){
+        if (state == comment_state::code){
+            if (results[i].error)
+                std::rethrow_exception(results[i].error);
+            state = results[i].exit_state;
+            continue;
+        }
+        retokenised.emplace_back(i, tokenise_async(chunks[i], comment_state::block_comment));
+        state = for_each_code_portion(chunks[i], [](std::string_view){}, comment_state::block_comment);
+    }
+    if (state != comment_state::code)
+        throw 0; // coment is not closed [bad]
+    for (auto &[i, future]: retokenised){
+        results[i] = pool.get(future);
+        if (results[i].error)
+            std::rethrow_exception(results[i].error);
+    }
+
+    auto token_count = std::size_t{};
+    for (auto const &result: results)
+        token_count += result.tokens.size();
+    auto token_stream = std::vector<token>{};
+    token_stream.reserve(token_count);
+    for (auto &result: results)
+        std::move(result.tokens.begin(), result.tokens.end(), std::back_inserter(token_stream));
+    return token_stream;
+}
+
+std::vector<token> tokenise_streaming(const std::string_view input_text, std::size_t queue_capacity){
+    auto token_stream = std::vector<token>{};
+    tokenise_streaming(input_text, [&](token t){token_stream.push_back(std::move(t));}, queue_capacity);
+    return token_stream;
     /*
     // characters: 1. spaces; 2. graphical; 3. controles[bad]
     // tokens: 1. names (a-z, A-Z, 0-9, _) 2. special operators
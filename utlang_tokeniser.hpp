@@ -10,6 +10,10 @@
 #include <string>
 #include <string_view>
 #include <algorithm>
+#include <functional>
+#include <numeric>
+#include <cstdint>
+#include <bit>
 
 
 template<class T, typename std::array<T, 1>::size_type N, typename std::array<T, 1>::size_type M>
@@ -33,88 +37,194 @@ namespace utlang::tokenisation{
 
     using namespace std::string_view_literals;
 
+    enum class token_kind: std::uint8_t{
+        // name-like tokens
+        general_name,
+        ignored_name,
+        type_identifier,
+        variable_identifier,
+        match_expression_identifier,
+        match_case_identifier,
+        namespace_identifier,
+        import_identifier,
+
+        // operator-like tokens
+        namespace_resolution_operator,
+        match_case_introduction,
+        function_type_builder,
+        type_constructor_list_separator,
+        lambda_expression_identifier,
+        lambda_expression_introduction,
+        type_annotation,
+        definition_operator,
+        grouping_bracket_left,
+        grouping_bracket_right,
+        block_bracket_left,
+        block_bracket_right,
+        statement_separator,
+
+        kinds_amount
+    };
+
+    // a set of token_kind (some texts like "->" and ":" have more than one meaning)
+    using token_kind_set = std::uint32_t;
+    static_assert(static_cast<std::size_t>(token_kind::kinds_amount) <= sizeof(token_kind_set) * 8);
+
+    constexpr token_kind_set kind_bit(token_kind kind){
+        return token_kind_set{1} << static_cast<unsigned>(kind);
+    }
+
+    /*
+        A token is a view into the source text plus the set of things it can mean
+        The source text must outlive its tokens
+    */
     class token{
+        private:
+            char const *text_begin = nullptr;
+            std::uint32_t text_length = 0;
+            token_kind_set kinds = 0;
+
         public:
-            std::string token_value;
+            token(const std::string_view input_text);
+
+            // for lexers that have already classified the text
+            token(const std::string_view input_text, token_kind_set kinds):
+                text_begin(input_text.data()), text_length(static_cast<std::uint32_t>(input_text.size())), kinds(kinds) {}
+
+            std::string_view token_value() const{
+                return {text_begin, text_length};
+            }
+
+            // position of the token in the text it was taken from
+            std::size_t offset_in(const std::string_view source_text) const{
+                return static_cast<std::size_t>(text_begin - source_text.data());
+            }
+
+            token_kind_set kind_set() const{
+                return kinds;
+            }
+
+            bool is(token_kind kind) const{
+                return kinds & kind_bit(kind);
+            }
 
             // name-like tokens
-            bool is_general_name                    = false;
-            bool is_ignored_name                    = false;
-            bool is_type_identifier                 = false;
-            bool is_variable_identifier             = false;
-            bool is_match_expression_identifier     = false;
-            bool is_match_case_identifier           = false;
-            bool is_namespace_identifier            = false;
-            bool is_import_identifier               = false;
+            bool is_general_name() const                    {return is(token_kind::general_name);}
+            bool is_ignored_name() const                    {return is(token_kind::ignored_name);}
+            bool is_type_identifier() const                 {return is(token_kind::type_identifier);}
+            bool is_variable_identifier() const             {return is(token_kind::variable_identifier);}
+            bool is_match_expression_identifier() const     {return is(token_kind::match_expression_identifier);}
+            bool is_match_case_identifier() const           {return is(token_kind::match_case_identifier);}
+            bool is_namespace_identifier() const            {return is(token_kind::namespace_identifier);}
+            bool is_import_identifier() const               {return is(token_kind::import_identifier);}
 
             // operator-like tokens
-            bool is_namespace_resolution_operator   = false;
-            bool is_match_case_introduction         = false;
-            bool is_function_type_builder           = false;
-            bool is_type_constructor_list_separator = false;
-            bool is_lambda_expression_identifier    = false;
-            bool is_lambda_expression_introduction  = false;
-            bool is_type_annotation                 = false;
-            bool is_definition_operator             = false;
-            bool is_grouping_bracket_left           = false;
-            bool is_grouping_bracket_right          = false;
-            bool is_block_bracket_left              = false;
-            bool is_block_bracket_right             = false;
-            bool is_statement_separator             = false;
-
-            // // comment token
-            // bool is_single_line_comment_identifier  = false;
-            // bool is_block_comment_start             = false;
-            // bool is_block_comment_end               = false;
+            bool is_namespace_resolution_operator() const   {return is(token_kind::namespace_resolution_operator);}
+            bool is_match_case_introduction() const         {return is(token_kind::match_case_introduction);}
+            bool is_function_type_builder() const           {return is(token_kind::function_type_builder);}
+            bool is_type_constructor_list_separator() const {return is(token_kind::type_constructor_list_separator);}
+            bool is_lambda_expression_identifier() const    {return is(token_kind::lambda_expression_identifier);}
+            bool is_lambda_expression_introduction() const  {return is(token_kind::lambda_expression_introduction);}
+            bool is_type_annotation() const                 {return is(token_kind::type_annotation);}
+            bool is_definition_operator() const             {return is(token_kind::definition_operator);}
+            bool is_grouping_bracket_left() const           {return is(token_kind::grouping_bracket_left);}
+            bool is_grouping_bracket_right() const          {return is(token_kind::grouping_bracket_right);}
+            bool is_block_bracket_left() const              {return is(token_kind::block_bracket_left);}
+            bool is_block_bracket_right() const             {return is(token_kind::block_bracket_right);}
+            bool is_statement_separator() const             {return is(token_kind::statement_separator);}
+
+            bool is_not_determined() const{
+                return std::popcount(kinds & reserved_kinds) == 0;
+            }
+
+            bool is_uniquely_determined() const{
+                return std::popcount(kinds & reserved_kinds) == 1;
+            }
+
+            bool is_nonuniquely_determined() const{
+                return std::popcount(kinds & reserved_kinds) > 1;
+            }
 
-        public:
-            token(const std::string_view input_text);
-            constexpr bool is_not_determined() const;
-            constexpr bool is_uniquely_determined() const;
-            constexpr bool is_nonuniquely_determined() const;
-        
         public:
             static constexpr std::array reserved_name_values = {
-                std::make_pair(&token::is_ignored_name,                 "_"sv),
-                std::make_pair(&token::is_type_identifier,              "type"sv),
-                std::make_pair(&token::is_variable_identifier,          "let"sv),
-                std::make_pair(&token::is_match_expression_identifier,  "match"sv),
-                std::make_pair(&token::is_match_case_identifier,        "case"sv),
-                std::make_pair(&token::is_namespace_identifier,         "namespace"sv),
-                std::make_pair(&token::is_import_identifier,            "import"sv)
+                std::make_pair(token_kind::ignored_name,                 "_"sv),
+                std::make_pair(token_kind::type_identifier,              "type"sv),
+                std::make_pair(token_kind::variable_identifier,          "let"sv),
+                std::make_pair(token_kind::variable_identifier,          "val"sv),
+                std::make_pair(token_kind::match_expression_identifier,  "match"sv),
+                std::make_pair(token_kind::match_case_identifier,        "case"sv),
+                std::make_pair(token_kind::namespace_identifier,         "namespace"sv),
+                std::make_pair(token_kind::import_identifier,            "import"sv)
             };
             static constexpr std::array reserved_name_fields = member_fields_only(reserved_name_values);
             
             static constexpr std::array reserved_operator_values = {
-                std::make_pair(&token::is_namespace_resolution_operator,    "::"sv),
-                std::make_pair(&token::is_match_case_introduction,          ":"sv),
-                std::make_pair(&token::is_function_type_builder,            "->"sv),
-                std::make_pair(&token::is_type_constructor_list_separator,  "|"sv),
-                std::make_pair(&token::is_lambda_expression_identifier,     "\\"sv),
-                std::make_pair(&token::is_lambda_expression_introduction,   "->"sv),
-                std::make_pair(&token::is_type_annotation,                  ":"sv),
-                std::make_pair(&token::is_definition_operator,              "="sv),
-                std::make_pair(&token::is_grouping_bracket_left,            "("sv),
-                std::make_pair(&token::is_grouping_bracket_right,           ")"sv),
-                std::make_pair(&token::is_block_bracket_left,               "{"sv),
-                std::make_pair(&token::is_block_bracket_right,              "}"sv),
-                std::make_pair(&token::is_statement_separator,              ";"sv),
-
-                // std::make_pair(&token::is_single_line_comment_identifier,   single_line_comment_identifier),
-                // std::make_pair(&token::is_block_comment_start,              block_comment_start),
-                // std::make_pair(&token::is_block_comment_end,                block_comment_end)
+                std::make_pair(token_kind::namespace_resolution_operator,    "::"sv),
+                std::make_pair(token_kind::match_case_introduction,          ":"sv),
+                std::make_pair(token_kind::function_type_builder,            "->"sv),
+                std::make_pair(token_kind::type_constructor_list_separator,  "|"sv),
+                std::make_pair(token_kind::lambda_expression_identifier,     "\\"sv),
+                std::make_pair(token_kind::lambda_expression_introduction,   "->"sv),
+                std::make_pair(token_kind::type_annotation,                  ":"sv),
+                std::make_pair(token_kind::definition_operator,              "="sv),
+                std::make_pair(token_kind::grouping_bracket_left,            "("sv),
+                std::make_pair(token_kind::grouping_bracket_right,           ")"sv),
+                std::make_pair(token_kind::block_bracket_left,               "{"sv),
+                std::make_pair(token_kind::block_bracket_right,              "}"sv),
+                std::make_pair(token_kind::statement_separator,              ";"sv),
             };
             static constexpr std::array reserved_operator_fields = member_fields_only(reserved_operator_values);
 
             static constexpr std::array reserved_values = combine_arrays(reserved_name_values, reserved_operator_values);
             static constexpr std::array reserved_fields = member_fields_only(reserved_values);
 
+            static constexpr token_kind_set reserved_name_kinds = std::accumulate(reserved_name_fields.cbegin(), reserved_name_fields.cend(), token_kind_set{},
+                                                                                 [](token_kind_set set, token_kind kind){return set | kind_bit(kind);});
+            static constexpr token_kind_set reserved_kinds = std::accumulate(reserved_fields.cbegin(), reserved_fields.cend(), token_kind_set{},
+                                                                             [](token_kind_set set, token_kind kind){return set | kind_bit(kind);});
+
             constexpr static auto single_line_comment_identifier    = "//"sv;
             constexpr static auto block_comment_start               = "/*"sv;
             constexpr static auto block_comment_end                 = "*/"sv;
     };
 
+    struct source_location{
+        std::uint32_t line;   // from 1
+        std::uint32_t column; // from 1, in bytes
+    };
+
+    // finds lines and columns of tokens (and other pointers into the text) in O(log(lines))
+    class line_table{
+        public:
+            explicit line_table(const std::string_view source_text);
+            source_location locate(char const *position) const;
+            source_location locate(token const &t) const{
+                return locate(t.token_value().data());
+            }
+
+        private:
+            std::string_view source_text;
+            std::vector<std::uint32_t> line_starts;
+    };
+
     std::vector<token> tokenise(const std::string_view input_text);
+
+    // same tokens, but the comment/cluster/token stages run concurrently and are connected by queues of
+    // at most queue_capacity objects, so intermediate results never pile up for the whole input
+    // tokens are passed to the consumer in order as soon as they are found
+    void tokenise_streaming(const std::string_view input_text, std::function<void(token)> const &consumer, std::size_t queue_capacity = 4096);
+    std::vector<token> tokenise_streaming(const std::string_view input_text, std::size_t queue_capacity = 4096);
+
+    // same tokens, for large inputs: the text is split into chunks of about chunk_size bytes (0 - pick one)
+    // at line ends and the chunks are tokenised in parallel
+    std::vector<token> tokenise_parallel(const std::string_view input_text, std::size_t chunk_size = 0);
+
+    // same tokens, found by a single table-driven pass over the text on the calling thread (see utlang_lexer.hpp)
+    std::vector<token> tokenise_single_pass(const std::string_view input_text);
+
+    // the single-pass lexer from position on (which must not be inside a comment), for tools that lex a part of a text again:
+    // tokens are passed to consumer until it returns false; returns where the refused token starts, or the size of the text
+    std::size_t tokenise_from(const std::string_view input_text, std::size_t position, std::function<bool(token const &)> const &consumer);
 }
 
 #endif
@@ -0,0 +1,914 @@
+#include <deque>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+#include "utlang_type_checker.hpp"
+#include "utlang_name_resolution.hpp"
+
+using namespace utlang::syntax;
+
+namespace utlang::typing{
+
+namespace{
+    template<class... F>
+    struct overloaded: F...{
+        using F::operator()...;
+    };
+
+    constexpr std::uint32_t no_name = std::numeric_limits<std::uint32_t>::max();
+    constexpr std::uint32_t generic_level = std::numeric_limits<std::uint32_t>::max();
+    constexpr std::uint32_t function_type = 0; // the head of  a -> b
+
+    // abandons the definition or statement being checked
+    struct type_failure{
+        source_position position;
+        std::string message;
+    };
+
+    enum class term_kind: std::uint8_t{
+        variable,   // stands for the term it is linked to, or for anything while it links to itself
+        rigid,      // a type variable of an annotation, while the annotated definition is checked: only equal to itself
+        application // a type constructor applied to types
+    };
+
+    struct term{
+        term_kind kind;
+        std::uint32_t level; // variables and rigid ones: the let depth they were made at, generic_level in type schemes
+        std::uint32_t link;  // variables
+        std::uint32_t head;  // applications: the type constructor; variables and rigid ones: the name they had in an annotation, or no_name
+        std::uint32_t first_argument = 0;
+        std::uint32_t argument_count = 0;
+        std::uint32_t mark = 0; // the last traversal that saw the term
+        std::uint32_t copy = 0; // what the last instantiation made of the term
+    };
+
+    struct type_constructor{
+        std::string name;
+        std::uint32_t arity;
+        std::uint32_t nullary_term = no_name; // made once for types without arguments
+        std::vector<symbol_id> path;
+        bool imported = false;                // declared by the interface of a module; its path is whole already
+    };
+
+    enum class value_state: std::uint8_t{unchecked, checking, checked};
+
+    struct global_value{
+        std::string name;
+        Variable_definition const *definition = nullptr; // none for constructors
+        std::uint32_t type = 0;  // a type scheme; while its group is inferred, the type it has so far
+        bool annotated = false;
+        bool declared = false;   // by the interface of a module: the type is made from the annotation where first used
+        value_state state = value_state::unchecked;
+        std::uint32_t stack_index = 0; // in the stack of definitions being inferred
+        std::uint32_t low = 0;         // the lowest stack index it depends on (Tarjan's strongly connected components)
+        source_position statement_position = 0; // of the top-level statement it is defined in
+    };
+
+    // found by their number (see resolve_names()), counted from the start of the top-level item
+    struct local_value{
+        std::uint32_t type;
+        bool polymorphic; // bound by a let, so instantiated where used
+    };
+
+    // a top-level definition or expression, in source order
+    struct statement_item{
+        global_value *definition;
+        Expression const *expression;
+        std::vector<symbol_id> const *namespace_path;
+        source_position statement_position; // positions in the nodes count from it
+    };
+
+    struct type_definition_item{
+        Type_definition const *definition;
+        std::vector<symbol_id> const *namespace_path;
+        source_position statement_position;
+        bool imported;
+    };
+
+    source_position position_of(Expression expression){
+        return std::visit(overloaded{
+            [](Variable const *variable){return variable->position;},
+            [](Application const *application){return position_of(application->arguments.front());},
+            [](auto const *node){return node->position;}
+        }, expression.expr);
+    }
+
+    source_position position_of(Type type){
+        return std::visit(overloaded{
+            [](Simple_Type const *simple){return simple->position;},
+            [](Function_Type const *function){return position_of(function->argument_type);},
+            [](Type_Application const *application){return position_of(application->types.front());}
+        }, type.type);
+    }
+
+    // definitions in source code are named by their last part within their namespace,
+    // declarations of imported modules by their whole name (see type_checker::declare)
+    std::vector<symbol_id> definition_path(std::vector<symbol_id> const &namespace_path, scoped_name_type name, bool imported){
+        if (imported)
+            return {name.parts().begin(), name.parts().end()};
+        auto path = namespace_path;
+        path.push_back(name.back());
+        return path;
+    }
+
+    bool has_annotation(Variable_definition const &definition){
+        auto const simple = std::get_if<Simple_Type *>(&definition.type.type);
+        return not simple or *simple;
+    }
+
+    class type_checker{
+        public:
+            explicit type_checker(symbol_table &symbols): symbols(symbols), ignored_name(symbols.intern("_")){
+                type_constructors.push_back(type_constructor{"->", 2, no_name, {}});
+                namespace_paths.emplace_back();
+            }
+
+            check_result check(Program_AST const &program, std::span<const Program_AST *const> imports, std::span<const Program_AST *const> dependencies,
+                               std::span<const symbol_id> module_path, bool make_interface);
+
+        private:
+            // type variables by name: the parameters of a type definition, or the ones an annotation has used so far
+            struct type_variables{
+                std::vector<std::pair<symbol_id, std::uint32_t>> bound;
+                bool implicit;    // a name that is not a type makes a new one
+                bool whole_names; // in an imported declaration: names are looked up from the top, not bound by resolve_names()
+            };
+
+            struct type_name{
+                std::uint32_t variable = no_name;
+                std::uint32_t constructor = no_name;
+            };
+
+            [[noreturn]] static void fail(source_position position, std::string message){
+                throw type_failure{position, std::move(message)};
+            }
+
+            std::string path_name(std::span<const symbol_id> path) const;
+            void collect(node_list<Statement const> statements, std::vector<symbol_id> const &namespace_path,
+                         std::span<const std::uint32_t> top_level_positions, source_position statement_position);
+            void declare(Program_AST const &interface, bool with_values);
+            Program_AST interface_of(std::span<const symbol_id> module_path);
+            Type to_syntax(std::uint32_t type, std::span<const symbol_id> module_path, std::unordered_map<std::uint32_t, symbol_id> &variable_names, arena &nodes);
+            void report(type_failure const &failure, source_position statement_position){
+                errors.push_back(type_error{statement_position + failure.position, failure.message});
+            }
+            global_value &add_value(std::vector<symbol_id> path, void const *definition);
+            void add_type(Type_definition const &definition, std::vector<symbol_id> const &namespace_path, source_position statement_position, bool imported);
+            void define_constructors(type_definition_item const &item);
+
+            std::uint32_t new_term(term_kind kind, std::uint32_t level, std::uint32_t head);
+            std::uint32_t make_application(std::uint32_t head, std::span<const std::uint32_t> type_arguments);
+            std::uint32_t make_function(std::uint32_t argument, std::uint32_t result){
+                std::uint32_t const parts[] = {argument, result};
+                return make_application(function_type, parts);
+            }
+            std::uint32_t fresh_variable(){
+                return new_term(term_kind::variable, current_level, no_name);
+            }
+            std::uint32_t argument(std::uint32_t application, std::uint32_t i) const{
+                return arguments[terms[application].first_argument + i];
+            }
+
+            std::uint32_t find(std::uint32_t t);
+            void unify(std::uint32_t found, std::uint32_t expected, source_position position);
+            void bind(std::uint32_t variable, std::uint32_t bound, source_position position);
+            void generalise(std::uint32_t type);
+            std::uint32_t instantiate(std::uint32_t scheme, bool rigid = false);
+            std::uint32_t copy_generic(std::uint32_t t, bool rigid);
+            std::string to_string(std::uint32_t type);
+
+            type_name resolve_type(Simple_Type const &simple, std::size_t argument_count, type_variables &variables);
+            std::uint32_t convert(Type type, type_variables &variables);
+            std::uint32_t annotation_scheme(Variable_definition const &definition, bool whole_names = false);
+
+            std::uint32_t infer(Expression expression);
+            std::uint32_t infer_variable(Variable const &variable);
+            std::uint32_t infer_match(Match const &match);
+            std::uint32_t infer_block(Block const &block);
+            void infer_pattern(Case_pattern pattern, std::uint32_t expected);
+            std::uint32_t infer_let(Variable_definition const &definition, std::uint32_t const *annotation);
+            void infer_global(global_value &value);
+
+            symbol_table &symbols;
+            symbol_id const ignored_name;
+            std::vector<term> terms;
+            std::vector<std::uint32_t> arguments;
+            std::uint32_t stamp = 0;
+            std::uint32_t current_level = 0;
+            std::vector<std::pair<std::uint32_t, std::uint32_t>> unify_pending;
+            std::vector<std::uint32_t> traversal;
+
+            resolution::program_names names;
+            std::vector<type_constructor> type_constructors;
+            std::vector<std::uint32_t> type_of;   // by the number of the definition (see resolve_names())
+            std::deque<global_value> values;
+            std::vector<global_value *> value_of; // the same
+            std::deque<std::vector<symbol_id>> namespace_paths;
+            std::vector<type_definition_item> type_definitions;
+            std::vector<statement_item> items;
+            std::vector<Import_declaration const *> imported_modules;
+
+            std::vector<local_value> locals;
+            std::size_t locals_base = 0;          // the locals below belong to a definition whose inference was interrupted
+            std::vector<global_value *> group_stack;
+            global_value *inferring = nullptr;    // the unannotated definition being inferred, if any
+
+            std::vector<type_error> errors;
+    };
+
+    std::string type_checker::path_name(std::span<const symbol_id> path) const{
+        auto name = std::string{};
+        for (auto const id: path){
+            if (not name.empty())
+                name += "::";
+            name += symbols.name(id);
+        }
+        return name;
+    }
+
+    global_value &type_checker::add_value(std::vector<symbol_id> path, void const *definition){
+        auto &value = values.emplace_back();
+        value.name = path_name(path);
+        value_of[names.definition_of(definition)] = &value;
+        return value;
+    }
+
+    // top_level_positions: of the statements, when they are top-level ones; otherwise they are all in the statement at statement_position
+    void type_checker::collect(node_list<Statement const> statements, std::vector<symbol_id> const &namespace_path,
+                               std::span<const std::uint32_t> top_level_positions, source_position statement_position){
+        for (std::size_t i = 0; i < statements.size(); ++i){
+            if (not top_level_positions.empty())
+                statement_position = top_level_positions[i];
+            std::visit(overloaded{
+                [&](Type_definition const *definition){
+                    add_type(*definition, namespace_path, statement_position, false);
+                },
+                [&](Variable_definition const *definition){
+                    auto &value = add_value(definition_path(namespace_path, definition->name.name, false), definition);
+                    value.definition = definition;
+                    value.statement_position = statement_position;
+                    items.push_back(statement_item{&value, nullptr, &namespace_path, statement_position});
+                },
+                [&](Namespace_definition const *definition){
+                    auto &inner = namespace_paths.emplace_back(namespace_path);
+                    inner.push_back(definition->name);
+                    collect(definition->content.statement_list, inner, {}, statement_position);
+                },
+                [&](Expression const *expression){
+                    items.push_back(statement_item{nullptr, expression, &namespace_path, statement_position});
+                },
+                [&](Block const *block){
+                    collect(block->statement_list, namespace_path, {}, statement_position);
+                },
+                [&](Import_declaration const *declaration){ // its interface is given to check_module()
+                    imported_modules.push_back(declaration);
+                }
+            }, statements[i].st);
+        }
+    }
+
+    void type_checker::add_type(Type_definition const &definition, std::vector<symbol_id> const &namespace_path, source_position statement_position, bool imported){
+        auto path = definition_path(namespace_path, definition.type.name, imported);
+        type_of[names.definition_of(&definition)] = static_cast<std::uint32_t>(type_constructors.size());
+        type_constructors.push_back(type_constructor{.name = path_name(path), .arity = static_cast<std::uint32_t>(definition.parameter_types.size()),
+                                                     .nullary_term = no_name, .path = path, .imported = imported});
+        type_definitions.push_back(type_definition_item{&definition, &namespace_path, statement_position, imported});
+        for (auto const &constructor: definition.constructors)
+            add_value(definition_path(namespace_path, constructor.name.name, imported), &constructor);
+    }
+
+    // the names in an interface are whole, so its declarations are resolved from the top namespace
+    void type_checker::declare(Program_AST const &interface, bool with_values){
+        auto const &top = namespace_paths.front();
+        for (auto const &statement: interface.code.statement_list)
+            std::visit(overloaded{
+                [&](Type_definition const *definition){
+                    add_type(*definition, top, 0, true);
+                },
+                [&](Variable_definition const *definition){
+                    if (not with_values)
+                        return;
+                    auto &value = add_value(definition_path(top, definition->name.name, true), definition);
+                    value.definition = definition;
+                    value.annotated = value.declared = true;
+                },
+                [](auto const *){}
+            }, statement.st);
+    }
+
+    // C t1 t2 ... of  type T a b ...  has the type scheme  t1 -> t2 -> ... -> T a b ...
+    void type_checker::define_constructors(type_definition_item const &item){
+        auto const &definition = *item.definition;
+        auto variables = type_variables{{}, false, item.imported};
+        auto parameters = std::vector<std::uint32_t>{};
+        for (auto const &parameter: definition.parameter_types){
+            if (std::ranges::any_of(variables.bound, [&](auto const &bound){return bound.first == parameter.name.back();}))
+                fail(parameter.position, "type parameter " + std::string(symbols.name(parameter.name.back())) + " appears twice");
+            parameters.push_back(new_term(term_kind::variable, generic_level, parameter.name.back()));
+            variables.bound.emplace_back(parameter.name.back(), parameters.back());
+        }
+        auto const result = make_application(type_of[names.definition_of(&definition)], parameters);
+
+        for (auto const &constructor: definition.constructors){
+            auto type = result;
+            for (auto field = constructor.field_types.size(); field-- > 0;)
+                type = make_function(convert(constructor.field_types[field], variables), type);
+            auto &value = *value_of[names.definition_of(&constructor)];
+            value.type = type;
+            value.state = value_state::checked;
+        }
+    }
+
+    std::uint32_t type_checker::new_term(term_kind kind, std::uint32_t level, std::uint32_t head){
+        auto const index = static_cast<std::uint32_t>(terms.size());
+        terms.push_back(term{kind, level, index, head});
+        return index;
+    }
+
+    std::uint32_t type_checker::make_application(std::uint32_t head, std::span<const std::uint32_t> type_arguments){
+        if (type_arguments.empty() and type_constructors[head].nullary_term != no_name)
+            return type_constructors[head].nullary_term;
+        auto const index = new_term(term_kind::application, 0, head);
+        terms[index].first_argument = static_cast<std::uint32_t>(arguments.size());
+        terms[index].argument_count = static_cast<std::uint32_t>(type_arguments.size());
+        arguments.insert(arguments.end(), type_arguments.begin(), type_arguments.end());
+        if (type_arguments.empty())
+            type_constructors[head].nullary_term = index;
+        return index;
+    }
+
+    std::uint32_t type_checker::find(std::uint32_t t){
+        auto root = t;
+        while (terms[root].kind == term_kind::variable and terms[root].link != root)
+            root = terms[root].link;
+        while (t != root)
+            t = std::exchange(terms[t].link, root);
+        return root;
+    }
+
+    // found is the type something has, expected the type its place needs
+    void type_checker::unify(std::uint32_t found, std::uint32_t expected, source_position position){
+        unify_pending.clear();
+        unify_pending.emplace_back(found, expected);
+        while (not unify_pending.empty()){
+            auto const [a, b] = unify_pending.back();
+            unify_pending.pop_back();
+            auto const x = find(a);
+            auto const y = find(b);
+            if (x == y)
+                continue;
+            if (terms[x].kind == term_kind::variable)
+                bind(x, y, position);
+            else if (terms[y].kind == term_kind::variable)
+                bind(y, x, position);
+            else if (terms[x].kind == term_kind::application and terms[y].kind == term_kind::application and terms[x].head == terms[y].head){
+                for (std::uint32_t i = 0; i < terms[x].argument_count; ++i)
+                    unify_pending.emplace_back(argument(x, i), argument(y, i));
+            }else{
+                auto message = "expected " + to_string(y) + ", found " + to_string(x);
+                if (x != find(found) or y != find(expected))
+                    message += ", in " + to_string(expected);
+                fail(position, std::move(message));
+            }
+        }
+    }
+
+    // the occurs check also lowers the levels in the bound type to that of the variable: they are now as old as it is
+    void type_checker::bind(std::uint32_t variable, std::uint32_t bound, source_position position){
+        auto const level = terms[variable].level;
+        ++stamp;
+        traversal.assign(1, bound);
+        while (not traversal.empty()){
+            auto const t = find(traversal.back());
+            traversal.pop_back();
+            if (terms[t].mark == stamp)
+                continue;
+            terms[t].mark = stamp;
+            if (t == variable){
+                auto const variable_text = to_string(variable);
+                fail(position, "infinite type: " + variable_text + " would have to be " + to_string(bound));
+            }
+            switch (terms[t].kind){
+                case term_kind::variable:
+                    terms[t].level = std::min(terms[t].level, level);
+                    break;
+                case term_kind::rigid:
+                    if (terms[t].level > level)
+                        fail(position, "type variable " + to_string(t) + " of an annotation would escape it");
+                    break;
+                case term_kind::application:
+                    for (std::uint32_t i = 0; i < terms[t].argument_count; ++i)
+                        traversal.push_back(argument(t, i));
+                    break;
+            }
+        }
+        terms[variable].link = bound;
+    }
+
+    // the variables made deeper than the current level are not used anywhere outside: they become generic
+    void type_checker::generalise(std::uint32_t type){
+        ++stamp;
+        traversal.assign(1, type);
+        while (not traversal.empty()){
+            auto const t = find(traversal.back());
+            traversal.pop_back();
+            if (terms[t].mark == stamp)
+                continue;
+            terms[t].mark = stamp;
+            if (terms[t].kind == term_kind::variable and terms[t].level > current_level)
+                terms[t].level = generic_level;
+            else if (terms[t].kind == term_kind::application)
+                for (std::uint32_t i = 0; i < terms[t].argument_count; ++i)
+                    traversal.push_back(argument(t, i));
+        }
+    }
+
+    // a copy of the scheme with new variables (rigid ones, to check an annotation, keep their names) for its generic ones;
+    // the parts without generic variables are shared, not copied
+    std::uint32_t type_checker::instantiate(std::uint32_t scheme, bool rigid){
+        ++stamp;
+        return copy_generic(scheme, rigid);
+    }
+
+    std::uint32_t type_checker::copy_generic(std::uint32_t t, bool rigid){
+        t = find(t);
+        if (terms[t].mark == stamp)
+            return terms[t].copy;
+        auto result = t;
+        if (terms[t].kind == term_kind::variable and terms[t].level == generic_level)
+            result = rigid ? new_term(term_kind::rigid, current_level, terms[t].head) : fresh_variable();
+        else if (terms[t].kind == term_kind::application and terms[t].argument_count > 0){
+            auto copied = std::vector<std::uint32_t>(terms[t].argument_count);
+            auto changed = false;
+            for (std::uint32_t i = 0; i < copied.size(); ++i){
+                copied[i] = copy_generic(argument(t, i), rigid);
+                changed = changed or copied[i] != find(argument(t, i));
+            }
+            if (changed)
+                result = make_application(terms[t].head, copied);
+        }
+        terms[t].mark = stamp;
+        terms[t].copy = result;
+        return result;
+    }
+
+    // variables keep the names they had in annotations; the others are called a, b, ...
+    std::string type_checker::to_string(std::uint32_t type){
+        auto variable_names = std::unordered_map<std::uint32_t, std::string>{};
+        auto taken = std::vector<std::string>{};
+        auto next_letter = std::size_t{0};
+        auto name_of = [&](std::uint32_t t) -> std::string const &{
+            if (auto const found = variable_names.find(t); found != variable_names.end())
+                return found->second;
+            auto name = terms[t].head != no_name ? std::string(symbols.name(terms[t].head)) : std::string{};
+            for (auto suffix = 1; name.empty() or std::ranges::find(taken, name) != taken.end(); ++suffix){
+                if (terms[t].head != no_name)
+                    name = std::string(symbols.name(terms[t].head)) + std::to_string(suffix);
+                else{
+                    name = std::string(1, static_cast<char>('a' + next_letter % 26));
+                    if (next_letter >= 26)
+                        name += std::to_string(next_letter / 26);
+                    ++next_letter;
+                }
+            }
+            taken.push_back(name);
+            return variable_names.emplace(t, std::move(name)).first->second;
+        };
+        // 0: anywhere, 1: the argument of a function, 2: an argument of a type constructor
+        auto print = [&](auto &self, std::uint32_t t, int precedence, std::string &output) -> void{
+            t = find(t);
+            if (terms[t].kind != term_kind::application){
+                output += name_of(t);
+                return;
+            }
+            auto const &info = terms[t];
+            auto const parenthesised = info.head == function_type ? precedence >= 1 : precedence >= 2 and info.argument_count > 0;
+            if (parenthesised)
+                output += '(';
+            if (info.head == function_type){
+                self(self, argument(t, 0), 1, output);
+                output += " -> ";
+                self(self, argument(t, 1), 0, output);
+            }else{
+                output += type_constructors[info.head].name;
+                for (std::uint32_t i = 0; i < info.argument_count; ++i){
+                    output += ' ';
+                    self(self, argument(t, i), 2, output);
+                }
+            }
+            if (parenthesised)
+                output += ')';
+        };
+        auto output = std::string{};
+        print(print, type, 0, output);
+        return output;
+    }
+
+    // a type variable, or a type constructor taking argument_count types
+    type_checker::type_name type_checker::resolve_type(Simple_Type const &simple, std::size_t argument_count, type_variables &variables){
+        auto const &name = simple.name;
+        if (name.size() == 1)
+            for (auto const &[id, variable]: variables.bound)
+                if (id == name.back()){
+                    if (argument_count > 0)
+                        fail(simple.position, "type variable " + std::string(symbols.name(id)) + " cannot take type arguments");
+                    return type_name{.variable = variable};
+                }
+        if (auto const found = variables.whole_names ? names.find_type(name.parts()) : names.of(&simple); found.kind == resolution::binding_kind::type){
+            auto const constructor = type_of[found.index];
+            auto const &info = type_constructors[constructor];
+            if (info.arity != argument_count)
+                fail(simple.position, info.name + " takes " + std::to_string(info.arity) + " type argument(s), not " + std::to_string(argument_count));
+            return type_name{.constructor = constructor};
+        }
+        if (not variables.implicit or name.size() != 1 or argument_count > 0)
+            fail(simple.position, "unknown type " + path_name(name.parts()));
+        auto const variable = new_term(term_kind::variable, generic_level, name.back());
+        variables.bound.emplace_back(name.back(), variable);
+        return type_name{.variable = variable};
+    }
+
+    std::uint32_t type_checker::convert(Type type, type_variables &variables){
+        return std::visit(overloaded{
+            [&](Simple_Type const *simple){
+                auto const found = resolve_type(*simple, 0, variables);
+                return found.variable != no_name ? found.variable : make_application(found.constructor, {});
+            },
+            [&](Function_Type const *function){
+                auto const argument_type = convert(function->argument_type, variables);
+                return make_function(argument_type, convert(function->result_type, variables));
+            },
+            [&](Type_Application const *application){
+                auto const head = std::get_if<Simple_Type *>(&application->types.front().type);
+                if (not head)
+                    fail(position_of(application->types.front()), "only a type name can take type arguments");
+                auto const found = resolve_type(**head, application->types.size() - 1, variables);
+                auto type_arguments = std::vector<std::uint32_t>{};
+                for (auto const &type_argument: application->types.subspan(1))
+                    type_arguments.push_back(convert(type_argument, variables));
+                return make_application(found.constructor, type_arguments);
+            }
+        }, type.type);
+    }
+
+    std::uint32_t type_checker::annotation_scheme(Variable_definition const &definition, bool whole_names){
+        auto variables = type_variables{{}, true, whole_names};
+        return convert(definition.type, variables);
+    }
+
+    std::uint32_t type_checker::infer(Expression expression){
+        return std::visit(overloaded{
+            [&](Variable const *variable){
+                return infer_variable(*variable);
+            },
+            [&](Application const *application){
+                auto function = infer(application->arguments.front());
+                for (auto const argument_expression: application->arguments.subspan(1)){
+                    auto const argument_type = infer(argument_expression);
+                    auto const f = find(function);
+                    if (terms[f].kind == term_kind::application and terms[f].head == function_type){
+                        unify(argument_type, argument(f, 0), position_of(argument_expression));
+                        function = argument(f, 1);
+                    }else if (terms[f].kind == term_kind::variable){
+                        auto const result = fresh_variable();
+                        unify(f, make_function(argument_type, result), position_of(argument_expression));
+                        function = result;
+                    }else
+                        fail(position_of(application->arguments.front()), "not a function, its type is " + to_string(f));
+                }
+                return function;
+            },
+            [&](Match const *match){
+                return infer_match(*match);
+            },
+            [&](Lambda const *lambda){
+                auto const argument_type = fresh_variable();
+                auto const bound = lambda->binder.name.back() != ignored_name;
+                if (bound)
+                    locals.push_back(local_value{argument_type, false});
+                auto const result = infer(lambda->body);
+                if (bound)
+                    locals.pop_back();
+                return make_function(argument_type, result);
+            },
+            [&](Block const *block){
+                return infer_block(*block);
+            }
+        }, expression.expr);
+    }
+
+    std::uint32_t type_checker::infer_variable(Variable const &variable){
+        auto const bound = names.of(&variable);
+        if (bound.kind == resolution::binding_kind::local){
+            auto const &local = locals[locals_base + bound.index];
+            return local.polymorphic ? instantiate(local.type) : local.type;
+        }
+        if (bound.kind == resolution::binding_kind::unbound)
+            fail(variable.position, "unbound name " + path_name(variable.name.parts()));
+        auto &value = *value_of[bound.index];
+        if (value.declared and value.state == value_state::unchecked){
+            try{
+                value.type = annotation_scheme(*value.definition, true);
+            }catch(type_failure const &failure){ // an interface that does not belong with the others
+                fail(variable.position, "the declaration of " + value.name + " in its module's interface: " + failure.message);
+            }
+            value.state = value_state::checked;
+        }
+        if (value.definition and not value.annotated){
+            if (value.state == value_state::unchecked)
+                infer_global(value);
+            if (value.state == value_state::checking){ // in the group being inferred: not generalised yet
+                inferring->low = std::min(inferring->low, value.stack_index);
+                return value.type;
+            }
+        }
+        return instantiate(value.type);
+    }
+
+    // the scrutinee has the type of every pattern, the match that of every case
+    std::uint32_t type_checker::infer_match(Match const &match){
+        auto const scrutinee = infer(match.scrutinee);
+        auto const result = fresh_variable();
+        for (auto const &match_case: match.cases){
+            auto const outer_locals = locals.size();
+            infer_pattern(match_case.match_expr, scrutinee);
+            unify(infer(match_case.result_expr), result, position_of(match_case.result_expr));
+            locals.resize(outer_locals);
+        }
+        return result;
+    }
+
+    void type_checker::infer_pattern(Case_pattern pattern, std::uint32_t expected){
+        if (auto const variable = std::get_if<Variable *>(&pattern.expr)){
+            if ((*variable)->name.back() != ignored_name)
+                locals.push_back(local_value{expected, false});
+            return;
+        }
+        auto const &application = *std::get<Case_pattern_application *>(pattern.expr);
+        auto const bound = names.of(&application.cons);
+        if (bound.kind != resolution::binding_kind::constructor)
+            fail(application.cons.position, path_name(application.cons.name.parts()) + " is not a constructor");
+        auto const &constructor = *value_of[bound.index];
+        auto type = instantiate(constructor.type);
+        auto fields = std::vector<std::uint32_t>{};
+        for (auto t = find(type); terms[t].kind == term_kind::application and terms[t].head == function_type; t = find(type)){
+            fields.push_back(argument(t, 0));
+            type = argument(t, 1);
+        }
+        if (fields.size() != application.args.size())
+            fail(application.cons.position, constructor.name + " has " + std::to_string(fields.size()) + " field(s), the pattern gives " + std::to_string(application.args.size()));
+        unify(type, expected, application.cons.position);
+        for (std::size_t i = 0; i < fields.size(); ++i)
+            infer_pattern(application.args[i], fields[i]);
+    }
+
+    // local definitions are seen by the statements after them; the value is that of the last expression
+    std::uint32_t type_checker::infer_block(Block const &block){
+        auto const outer_locals = locals.size();
+        auto result = no_name;
+        for (auto const &statement: block.statement_list){
+            if (auto const definition = std::get_if<Variable_definition *>(&statement.st)){
+                auto annotation = std::uint32_t{};
+                auto const annotated = has_annotation(**definition);
+                if (annotated)
+                    annotation = annotation_scheme(**definition);
+                auto const type = infer_let(**definition, annotated ? &annotation : nullptr);
+                locals.push_back(local_value{type, true});
+            }else if (auto const e = std::get_if<Expression *>(&statement.st))
+                result = infer(**e);
+            else
+                fail(block.position, "only definitions and expressions can be in a block");
+        }
+        locals.resize(outer_locals);
+        if (result == no_name)
+            fail(block.position, "block without a value");
+        return result;
+    }
+
+    // the type scheme of  let x: T = e  or  let x = e, defined at the current level
+    std::uint32_t type_checker::infer_let(Variable_definition const &definition, std::uint32_t const *annotation){
+        ++current_level;
+        auto const expected = annotation ? instantiate(*annotation, true) : no_name;
+        auto const found = infer(definition.value);
+        if (annotation)
+            unify(found, expected, position_of(definition.value));
+        --current_level;
+        if (annotation)
+            return *annotation;
+        generalise(found);
+        return found;
+    }
+
+    /*
+        An unannotated top-level definition is inferred where it is first used, at the level of the top
+        Definitions that use each other are found as strongly connected components (Tarjan's algorithm,
+        the inference being the depth-first search): they are used as they are within the component,
+        and generalised together when its first definition is done
+    */
+    void type_checker::infer_global(global_value &value){
+        auto const saved_level = std::exchange(current_level, 0);
+        auto const saved_base = std::exchange(locals_base, locals.size());
+        auto const saved_inferring = std::exchange(inferring, &value);
+        auto const stack_index = static_cast<std::uint32_t>(group_stack.size());
+        value.state = value_state::checking;
+        value.stack_index = value.low = stack_index;
+        group_stack.push_back(&value);
+        try{
+            ++current_level;
+            value.type = fresh_variable();
+            unify(infer(value.definition->value), value.type, position_of(value.definition->value));
+            --current_level;
+            if (value.low == stack_index){
+                for (auto const member: std::span{group_stack}.subspan(stack_index)){
+                    generalise(member->type);
+                    member->state = value_state::checked;
+                }
+                group_stack.resize(stack_index);
+            }
+        }catch(type_failure const &failure){
+            report(failure, value.statement_position);
+            // the group is given up; its definitions can have any type, so that their uses report nothing more
+            current_level = 0;
+            for (auto const member: std::span{group_stack}.subspan(stack_index)){
+                member->type = new_term(term_kind::variable, generic_level, no_name);
+                member->state = value_state::checked;
+            }
+            group_stack.resize(stack_index);
+            locals.resize(saved_base);
+        }
+        current_level = saved_level;
+        locals_base = saved_base;
+        inferring = saved_inferring;
+        if (inferring and value.state == value_state::checking)
+            inferring->low = std::min(inferring->low, value.low);
+    }
+
+    check_result type_checker::check(Program_AST const &program, std::span<const Program_AST *const> imports, std::span<const Program_AST *const> dependencies,
+                                     std::span<const symbol_id> module_path, bool make_interface){
+        names = resolution::resolve_names(program, imports, dependencies, symbols);
+        type_of.resize(names.definition_count());
+        value_of.resize(names.definition_count());
+        for (auto const interface: imports)
+            declare(*interface, true);
+        for (auto const interface: dependencies)
+            declare(*interface, false);
+        collect(program.code.statement_list, namespace_paths.front(), program.statement_positions, 0);
+        for (auto const &item: type_definitions){
+            try{
+                define_constructors(item);
+            }catch(type_failure const &failure){
+                report(failure, item.statement_position);
+                for (auto const &constructor: item.definition->constructors){
+                    auto &value = *value_of[names.definition_of(&constructor)];
+                    value.type = new_term(term_kind::variable, generic_level, no_name);
+                    value.state = value_state::checked;
+                }
+            }
+        }
+        for (auto &item: items){
+            if (not item.definition or not has_annotation(*item.definition->definition))
+                continue;
+            try{
+                item.definition->type = annotation_scheme(*item.definition->definition);
+                item.definition->annotated = true;
+            }catch(type_failure const &failure){
+                report(failure, item.statement_position);
+            }
+        }
+
+        for (auto const &item: items){
+            try{
+                if (item.expression){
+                    current_level = 1;
+                    infer(*item.expression);
+                }else if (item.definition->annotated){
+                    current_level = 0;
+                    infer_let(*item.definition->definition, &item.definition->type);
+                    item.definition->state = value_state::checked;
+                }else if (item.definition->state == value_state::unchecked)
+                    infer_global(*item.definition);
+            }catch(type_failure const &failure){
+                report(failure, item.statement_position);
+                locals.clear();
+            }
+            current_level = 0;
+        }
+
+        auto result = check_result{};
+        for (auto const &item: items)
+            if (item.definition)
+                result.definitions.push_back(definition_type{item.definition->name, to_string(item.definition->type)});
+        std::ranges::stable_sort(errors, {}, &type_error::position);
+        result.errors = std::move(errors);
+        if (make_interface and result.errors.empty())
+            result.interface = interface_of(module_path);
+        return result;
+    }
+
+    Program_AST type_checker::interface_of(std::span<const symbol_id> module_path){
+        auto interface = Program_AST{.code = {}, .nodes = std::make_unique<arena>(), .statement_positions = {}};
+        auto &nodes = *interface.nodes;
+        // so that a precompiled interface brings the ones its types refer to
+        auto statements = std::vector<Statement>{};
+        for (auto const declaration: imported_modules)
+            statements.push_back(Statement{nodes.make<Import_declaration>(Import_declaration{scoped_name_type{declaration->module.parts(), nodes}})});
+        auto whole_name = [&](std::vector<symbol_id> const &namespace_path, symbol_id name){
+            auto parts = std::vector<symbol_id>(module_path.begin(), module_path.end());
+            parts.insert(parts.end(), namespace_path.begin(), namespace_path.end());
+            parts.push_back(name);
+            return scoped_name_type{parts, nodes};
+        };
+
+        for (auto const &item: type_definitions){
+            if (item.imported)
+                continue;
+            auto const &definition = *item.definition;
+            // a constructor's type is  t1 -> ... -> T a b ..., where a b ... are the parameters
+            auto variable_names = std::unordered_map<std::uint32_t, symbol_id>{};
+            auto constructors = std::vector<Constructor_definition>{};
+            for (auto const &constructor: definition.constructors){
+                auto field_types = std::vector<std::uint32_t>{};
+                auto type = value_of[names.definition_of(&constructor)]->type;
+                for (std::size_t field = 0; field < constructor.field_types.size(); ++field){
+                    field_types.push_back(argument(find(type), 0));
+                    type = argument(find(type), 1);
+                }
+                for (std::size_t i = 0; i < definition.parameter_types.size(); ++i)
+                    variable_names[find(argument(find(type), static_cast<std::uint32_t>(i)))] = definition.parameter_types[i].name.back();
+                auto fields = std::vector<Type>{};
+                for (auto const field_type: field_types)
+                    fields.push_back(to_syntax(field_type, module_path, variable_names, nodes));
+                constructors.push_back(Constructor_definition{Constructor{whole_name(*item.namespace_path, constructor.name.name.back()), 0}, nodes.copy(fields)});
+            }
+            auto parameters = std::vector<Simple_Type>{};
+            for (auto const &parameter: definition.parameter_types)
+                parameters.push_back(Simple_Type{parameter.name, 0});
+            statements.push_back(Statement{nodes.make<Type_definition>(Type_definition{
+                Simple_Type{whole_name(*item.namespace_path, definition.type.name.back()), 0}, nodes.copy(parameters), nodes.copy(constructors)})});
+        }
+        for (auto const &item: items){
+            if (not item.definition)
+                continue;
+            auto const name = whole_name(*item.namespace_path, item.definition->definition->name.name.back());
+            auto variable_names = std::unordered_map<std::uint32_t, symbol_id>{};
+            statements.push_back(Statement{nodes.make<Variable_definition>(Variable_definition{
+                Variable{name, 0}, to_syntax(item.definition->type, module_path, variable_names, nodes), Expression{nodes.make<Variable>(Variable{name, 0})}})});
+        }
+        interface.code.statement_list = nodes.copy(statements);
+        interface.statement_positions.assign(statements.size(), 0);
+        return interface;
+    }
+
+    // variables not in variable_names are called 'a, 'b, ... in order
+    Type type_checker::to_syntax(std::uint32_t type, std::span<const symbol_id> module_path, std::unordered_map<std::uint32_t, symbol_id> &variable_names, arena &nodes){
+        auto simple = [&](std::span<const symbol_id> name){
+            return Type{nodes.make<Simple_Type>(Simple_Type{scoped_name_type{name, nodes}, 0})};
+        };
+        type = find(type);
+        if (terms[type].kind != term_kind::application){
+            auto found = variable_names.find(type);
+            if (found == variable_names.end()){
+                auto const count = variable_names.size();
+                auto name = "'" + std::string(1, static_cast<char>('a' + count % 26));
+                if (count >= 26)
+                    name += std::to_string(count / 26);
+                found = variable_names.emplace(type, symbols.intern(name)).first;
+            }
+            return simple({&found->second, 1});
+        }
+        auto const head = terms[type].head;
+        auto const argument_count = terms[type].argument_count;
+        if (head == function_type){
+            auto const argument_type = to_syntax(argument(type, 0), module_path, variable_names, nodes);
+            return Type{nodes.make<Function_Type>(Function_Type{argument_type, to_syntax(argument(type, 1), module_path, variable_names, nodes)})};
+        }
+        auto const &constructor = type_constructors[head];
+        auto path = constructor.imported ? std::vector<symbol_id>{} : std::vector<symbol_id>(module_path.begin(), module_path.end());
+        path.insert(path.end(), constructor.path.begin(), constructor.path.end());
+        if (argument_count == 0)
+            return simple(path);
+        auto types = std::vector<Type>{simple(path)};
+        for (std::uint32_t i = 0; i < argument_count; ++i)
+            types.push_back(to_syntax(argument(type, i), module_path, variable_names, nodes));
+        return Type{nodes.make<Type_Application>(Type_Application{nodes.copy(types)})};
+    }
+}
+
+check_result check_types(Program_AST const &program, symbol_table &symbols){
+    return type_checker{symbols}.check(program, {}, {}, {}, false);
+}
+
+check_result check_module(Program_AST const &program, std::span<const Program_AST *const> imports, std::span<const Program_AST *const> dependencies,
+                          std::span<const symbol_id> module_path, symbol_table &symbols){
+    return type_checker{symbols}.check(program, imports, dependencies, module_path, true);
+}
+
+std::string line_and_column(std::span<const tokenisation::token> tokens, std::string_view source_text, source_position position){
+    auto const offset = position < tokens.size() ? tokens[position].offset_in(source_text) : source_text.size();
+    auto const before = source_text.substr(0, offset);
+    auto const line_start = before.rfind('\n');
+    auto const column = line_start == std::string_view::npos ? offset : offset - line_start - 1;
+    return std::to_string(std::ranges::count(before, '\n') + 1) + ":" + std::to_string(column + 1);
+}
+
+}
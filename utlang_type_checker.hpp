@@ -0,0 +1,59 @@
+#ifndef UTLANG_TYPE_CHECKER_HPP
+#define UTLANG_TYPE_CHECKER_HPP
+
+#include <span>
+#include <string>
+#include <vector>
+#include <string_view>
+#include "utlang_tokeniser.hpp"
+#include "utlang_syntax_tree_builder.hpp"
+#include "utlang_symbol_table.hpp"
+
+/*
+    Hindley-Milner type inference over Program_AST
+    Types are terms in one array; a type variable is bound by linking it to another term (union-find with path compression),
+    so nothing is ever substituted through environments or other types
+    Every variable remembers the let depth (level) it was made at, and binding it lowers the levels of what it is bound to:
+    generalising a let only looks at its own type, the variables deeper than the let are the ones to generalise
+    Annotations are checked, not trusted: names in them that are not types (A in  List A -> Int) are type variables,
+    rigid while the definition is checked, and instantiated freely where it is used
+    Definitions without an annotation are inferred when first used; mutually recursive ones are inferred together
+    A module is a program that others import (import a::b;): they see its types, constructors and definitions under
+    its module path (a::b::f), through its interface rather than its code
+*/
+namespace utlang::typing{
+
+    struct type_error{
+        syntax::source_position position;
+        std::string message;
+    };
+
+    struct definition_type{
+        std::string name; // with its namespaces
+        std::string type;
+    };
+
+    struct check_result{
+        std::vector<definition_type> definitions; // top-level ones, in source order
+        std::vector<type_error> errors;           // at most one for each definition or statement, in source order
+        syntax::Program_AST interface;            // check_module(), when there are no errors
+    };
+
+    check_result check_types(syntax::Program_AST const &program, symbol_table &symbols = symbol_table::global());
+
+    /*
+        Checks a program that imports modules, and makes its interface as the module at module_path
+        imports: the interfaces of the modules it imports; dependencies: those of the modules they import in turn,
+        of which only the types (and their constructors) are seen, for the types in the imported declarations
+        An interface is a program of declarations with whole names (a::b::List, a::b::f): the module's imports, its type
+        definitions, and every let with its type and its own name for a value; type variables in it are 'a, 'b, ..., which no source can use
+    */
+    check_result check_module(syntax::Program_AST const &program, std::span<const syntax::Program_AST *const> imports,
+                              std::span<const syntax::Program_AST *const> dependencies, std::span<const symbol_id> module_path,
+                              symbol_table &symbols = symbol_table::global());
+
+    // "line:column" (both from 1) of the token at the position
+    std::string line_and_column(std::span<const tokenisation::token> tokens, std::string_view source_text, syntax::source_position position);
+}
+
+#endif
@@ -0,0 +1,316 @@
+#include <chrono>
+#include <utility>
+#include <algorithm>
+#include "utlang_value_heap.hpp"
+
+namespace utlang::evaluation{
+
+namespace{
+    constexpr std::size_t initial_interned_slots = 1024;
+
+    std::byte *allocate_chunk(std::size_t size){
+        return static_cast<std::byte *>(::operator new(size));
+    }
+
+    // passes every value and cell the object refers to
+    void trace(cell *object, root_visitor &visit){
+        switch (object->kind){
+            case cell_kind::constructed:
+                for (auto &field: static_cast<constructed *>(object)->fields())
+                    visit(field);
+                break;
+            case cell_kind::closure:
+                visit(static_cast<closure *>(object)->captured.locals);
+                break;
+            case cell_kind::partial_constructor:
+                for (auto &field: static_cast<partial_constructor *>(object)->fields())
+                    visit(field);
+                break;
+            case cell_kind::compiled_closure:
+                for (auto &capture: static_cast<compiled_closure *>(object)->captures())
+                    visit(capture);
+                break;
+            case cell_kind::binding:{
+                auto const b = static_cast<binding *>(object);
+                visit(b->bound);
+                visit(b->next);
+            } break;
+        }
+    }
+
+    // fields are hashed by what does not change when cells move
+    std::uint64_t content_hash(std::uint32_t constructor, std::span<value const> fields){
+        auto hash = (std::uint64_t{constructor} + 1) * 0x9e3779b97f4a7c15u;
+        for (auto const &field: fields){
+            auto part = std::uint64_t{static_cast<std::uint8_t>(field.kind())};
+            if (field.is_natural())
+                part = field.number().count * 0xc2b2ae3d27d4eb4fu + field.number().type;
+            else if (auto const object = field.as<constructed>())
+                part = object->serial * 0x165667b19e3779f9u + 7;
+            hash = (hash ^ part) * 0x9e3779b97f4a7c15u;
+        }
+        return hash ^ (hash >> 29);
+    }
+
+    void add_pause(double &total, double &longest, std::chrono::steady_clock::time_point start){
+        std::chrono::duration<double> const pause = std::chrono::steady_clock::now() - start;
+        total += pause.count();
+        longest = std::max(longest, pause.count());
+    }
+}
+
+value_heap::value_heap():
+    nursery(allocate_chunk(nursery_size)), nursery_current(nursery), nursery_end(nursery + nursery_size),
+    old_chunks{chunk{allocate_chunk(old_chunk_size), old_chunk_size}}, interned_slots(initial_interned_slots, interned{0, nullptr}) {}
+
+value_heap::~value_heap(){
+    ::operator delete(nursery);
+    for (auto const overflow: overflow_chunks)
+        ::operator delete(overflow);
+    for (auto const &c: old_chunks)
+        ::operator delete(c.start);
+}
+
+void value_heap::overflow_nursery(std::size_t size){
+    auto const capacity = std::max(nursery_size, size);
+    nursery_current = overflow_chunks.emplace_back(allocate_chunk(capacity));
+    nursery_end = nursery_current + capacity;
+    nursery_overflowed = true;
+}
+
+constructed *value_heap::make_interned(std::uint32_t constructor, std::span<value const> fields){
+    auto const hash = content_hash(constructor, fields);
+    auto const mask = interned_slots.size() - 1;
+    for (auto slot = hash & mask; interned_slots[slot].object; slot = (slot + 1) & mask){
+        auto const existing = interned_slots[slot].object;
+        if (interned_slots[slot].hash == hash and existing->constructor == constructor and std::ranges::equal(existing->fields(), fields))
+            return existing;
+    }
+    auto const object = make_constructed(constructor, fields, false);
+    insert_interned(interned{hash, object});
+    young_interned.push_back(interned{hash, object});
+    return object;
+}
+
+std::size_t value_heap::find_interned(std::uint64_t hash, constructed const *object) const{
+    auto const mask = interned_slots.size() - 1;
+    auto slot = hash & mask;
+    while (interned_slots[slot].object != object)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+void value_heap::insert_interned(interned entry){
+    if ((interned_size + 1) * 2 > interned_slots.size()){
+        auto const old = std::exchange(interned_slots, std::vector<interned>(interned_slots.size() * 2, interned{0, nullptr}));
+        interned_size = 0;
+        for (auto const &e: old)
+            if (e.object)
+                insert_interned(e);
+    }
+    auto const mask = interned_slots.size() - 1;
+    auto slot = entry.hash & mask;
+    while (interned_slots[slot].object)
+        slot = (slot + 1) & mask;
+    interned_slots[slot] = entry;
+    ++interned_size;
+}
+
+// the entries after it that would not be found past the hole move back (linear probing without tombstones)
+void value_heap::erase_interned(std::size_t slot){
+    auto const mask = interned_slots.size() - 1;
+    auto hole = slot;
+    for (auto next = (hole + 1) & mask; interned_slots[next].object; next = (next + 1) & mask){
+        auto const home = interned_slots[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)){
+            interned_slots[hole] = interned_slots[next];
+            hole = next;
+        }
+    }
+    interned_slots[hole].object = nullptr;
+    --interned_size;
+}
+
+std::byte *value_heap::allocate_old(std::size_t size){
+    for (;;){
+        auto &current = old_chunks[old_current];
+        if (current.capacity - current.used >= size){
+            auto const result = current.start + current.used;
+            current.used += size;
+            statistics.old_bytes += size;
+            statistics.peak_old_bytes = std::max(statistics.peak_old_bytes, statistics.old_bytes);
+            return result;
+        }
+        // the chunks after the current one are empty
+        auto const next = old_chunks.begin() + static_cast<std::ptrdiff_t>(old_current + 1);
+        if (next == old_chunks.end() or next->capacity < size){
+            auto const capacity = std::max(old_chunk_size, size);
+            old_chunks.insert(next, chunk{allocate_chunk(capacity), capacity});
+        }
+        ++old_current;
+    }
+}
+
+void value_heap::collect(std::function<void(root_visitor &)> const &roots){
+    auto start = std::chrono::steady_clock::now();
+    collect_minor(roots);
+    ++statistics.minor_collections;
+    add_pause(statistics.minor_pause_seconds, statistics.longest_minor_pause_seconds, start);
+    if (statistics.old_bytes <= major_threshold)
+        return;
+    start = std::chrono::steady_clock::now();
+    collect_major(roots);
+    ++statistics.major_collections;
+    add_pause(statistics.major_pause_seconds, statistics.longest_major_pause_seconds, start);
+}
+
+// everything reachable in the nursery is copied to the end of the old generation, which is then scanned like Cheney's to-space
+void value_heap::collect_minor(std::function<void(root_visitor &)> const &roots){
+    struct promoter final: root_visitor{
+        value_heap &heap;
+
+        explicit promoter(value_heap &heap): root_visitor(true), heap(heap) {}
+
+        void visit(cell *&object) override{
+            if (not (object->flags & young))
+                return;
+            if (not (object->flags & forwarded)){
+                auto const copy = reinterpret_cast<cell *>(heap.allocate_old(object->size));
+                std::memcpy(static_cast<void *>(copy), object, object->size);
+                copy->flags = 0;
+                object->flags |= forwarded;
+                object->forwarding = copy;
+                heap.statistics.promoted_bytes += object->size;
+            }
+            object = object->forwarding;
+        }
+    };
+
+    auto promote = promoter{*this};
+    auto scanned_chunk = old_current;
+    auto scanned = old_chunks[old_current].used;
+    roots(promote);
+    for (;;){
+        if (scanned == old_chunks[scanned_chunk].used){
+            if (scanned_chunk == old_current)
+                break;
+            ++scanned_chunk;
+            scanned = 0;
+            continue;
+        }
+        auto const object = reinterpret_cast<cell *>(old_chunks[scanned_chunk].start + scanned);
+        trace(object, promote);
+        scanned += object->size;
+    }
+
+    // the table does not keep cells alive: the ones left behind are dead
+    for (auto const &entry: young_interned){
+        auto const slot = find_interned(entry.hash, entry.object);
+        if (entry.object->flags & forwarded)
+            interned_slots[slot].object = static_cast<constructed *>(entry.object->forwarding);
+        else
+            erase_interned(slot);
+    }
+    young_interned.clear();
+
+    for (auto const overflow: overflow_chunks)
+        ::operator delete(overflow);
+    overflow_chunks.clear();
+    nursery_current = nursery;
+    nursery_end = nursery + nursery_size;
+    nursery_overflowed = false;
+}
+
+/*
+    Lisp 2: the reachable cells are marked, each is given the address it slides down to (in the same order),
+    every reference is changed to that address, then the cells are moved
+    Runs right after a minor collection, so there is nothing in the nursery
+*/
+void value_heap::collect_major(std::function<void(root_visitor &)> const &roots){
+    struct marker final: root_visitor{
+        std::vector<cell *> pending;
+
+        marker(): root_visitor(false) {}
+
+        void visit(cell *&object) override{
+            if (not (object->flags & marked)){
+                object->flags |= marked;
+                pending.push_back(object);
+            }
+        }
+    };
+    struct updater final: root_visitor{
+        updater(): root_visitor(false) {}
+
+        void visit(cell *&object) override{
+            object = object->forwarding;
+        }
+    };
+    auto for_each_cell = [this](auto &&f){
+        for (std::size_t c = 0; c <= old_current; ++c)
+            for (std::size_t offset = 0; offset < old_chunks[c].used;){
+                auto const object = reinterpret_cast<cell *>(old_chunks[c].start + offset);
+                offset += object->size; // before f, which may move it
+                f(object);
+            }
+    };
+
+    auto mark = marker{};
+    roots(mark);
+    while (not mark.pending.empty()){
+        auto const object = mark.pending.back();
+        mark.pending.pop_back();
+        trace(object, mark);
+    }
+
+    auto used = std::vector<std::size_t>(old_current + 1, 0);
+    std::size_t destination = 0;
+    for_each_cell([&](cell *object){
+        if (not (object->flags & marked))
+            return;
+        while (old_chunks[destination].capacity - used[destination] < object->size)
+            ++destination;
+        object->forwarding = reinterpret_cast<cell *>(old_chunks[destination].start + used[destination]);
+        used[destination] += object->size;
+    });
+
+    auto update = updater{};
+    roots(update);
+    for_each_cell([&](cell *object){
+        if (object->flags & marked)
+            trace(object, update);
+    });
+    auto survivors = std::vector<interned>{};
+    for (auto const &entry: interned_slots)
+        if (entry.object and (entry.object->flags & marked))
+            survivors.push_back(interned{entry.hash, static_cast<constructed *>(entry.object->forwarding)});
+    std::ranges::fill(interned_slots, interned{0, nullptr});
+    interned_size = 0;
+    for (auto const &entry: survivors)
+        insert_interned(entry);
+
+    for_each_cell([](cell *object){
+        if (not (object->flags & marked))
+            return;
+        auto const moved = object->forwarding;
+        std::memmove(static_cast<void *>(moved), object, object->size);
+        moved->flags &= ~marked;
+    });
+
+    auto live = std::size_t{0};
+    for (std::size_t c = 0; c <= old_current; ++c){
+        old_chunks[c].used = used[c];
+        live += used[c];
+    }
+    old_current = destination;
+    // one empty chunk is kept for what the next minor collections promote
+    while (old_chunks.size() > old_current + 2){
+        ::operator delete(old_chunks.back().start);
+        old_chunks.pop_back();
+    }
+    statistics.compacted_bytes += statistics.old_bytes - live;
+    statistics.old_bytes = live;
+    major_threshold = std::max(least_major_threshold, 2 * live);
+}
+
+}
@@ -0,0 +1,366 @@
+#ifndef UTLANG_VALUE_HEAP_HPP
+#define UTLANG_VALUE_HEAP_HPP
+
+#include <new>
+#include <span>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+#include "utlang_symbol_table.hpp"
+
+namespace utlang::syntax{
+    struct Lambda;
+}
+
+namespace utlang::evaluation{
+
+    struct heap_statistics{
+        std::size_t allocations = 0;
+        std::size_t allocated_bytes = 0;
+        std::size_t minor_collections = 0;
+        std::size_t major_collections = 0;
+        std::size_t promoted_bytes = 0;  // copied out of the nursery into the old generation
+        std::size_t compacted_bytes = 0; // freed in the old generation by major collections
+        std::size_t old_bytes = 0;       // in the old generation now
+        std::size_t peak_old_bytes = 0;
+        double minor_pause_seconds = 0;  // in all minor collections together
+        double longest_minor_pause_seconds = 0;
+        double major_pause_seconds = 0;
+        double longest_major_pause_seconds = 0;
+    };
+
+    // a value of a natural-shaped type: the number of S around the Z
+    struct natural{
+        std::uint32_t type;
+        std::uint64_t count;
+
+        friend bool operator==(natural const &, natural const &) = default;
+    };
+
+    enum class cell_kind: std::uint8_t{constructed, closure, partial_constructor, compiled_closure, binding};
+
+    // the header of every object in a value_heap; what follows it depends on the kind
+    struct cell{
+        std::uint32_t size; // in bytes, with the header
+        cell_kind kind;
+        std::uint8_t flags = 0;
+        cell *forwarding = nullptr; // where a collection moved it
+    };
+
+    struct constructed;
+    struct closure;
+    struct partial_constructor;
+    struct compiled_closure;
+    struct binding;
+
+    /*
+        A natural number kept in place, or a handle to a cell in the value_heap of an evaluator
+        Handles are plain addresses: collections move cells, and update the roots they are given and the cells they keep
+    */
+    class value{
+        public:
+            enum class kind_type: std::uint8_t{natural, constructed, closure, partial_constructor, compiled_closure};
+
+            value(): value(natural{0, 0}) {}
+            value(natural number): count(number.count), type(number.type), tag(kind_type::natural) {}
+            value(constructed *object);
+            value(closure *object);
+            value(partial_constructor *object);
+            value(compiled_closure *object);
+
+            kind_type kind() const{
+                return tag;
+            }
+
+            bool is_natural() const{
+                return tag == kind_type::natural;
+            }
+
+            natural number() const{
+                return natural{type, count};
+            }
+
+            // the cell of the kind of T, nullptr for a value of any other kind
+            template<class T>
+            T *as() const{
+                return tag == T::value_kind ? static_cast<T *>(object) : nullptr;
+            }
+
+            cell *referenced() const{
+                return is_natural() ? nullptr : object;
+            }
+
+            // by identity; with hash-consing equal data values are the same cell, so this is structural
+            friend bool operator==(value const &a, value const &b){
+                return a.tag == b.tag and (a.is_natural() ? a.count == b.count and a.type == b.type : a.object == b.object);
+            }
+
+        private:
+            union{
+                std::uint64_t count;
+                cell *object;
+            };
+            std::uint32_t type = 0;
+            kind_type tag;
+
+            friend class root_visitor;
+    };
+
+    struct constructed: cell{
+        static constexpr auto value_kind = value::kind_type::constructed;
+        std::uint32_t constructor;
+        std::uint32_t field_count;
+        std::uint64_t serial; // in the order of making; hash-consing hashes by it, since the address changes
+
+        std::span<value> fields(){
+            return {reinterpret_cast<value *>(this + 1), field_count};
+        }
+    };
+
+    // local variables of the tree walker, innermost first
+    struct binding: cell{
+        symbol_id name;
+        binding *next;
+        value bound;
+    };
+
+    // where an expression is evaluated
+    struct scope{
+        binding *locals; // globals are bound before evaluation (see resolve_names())
+    };
+
+    struct closure: cell{
+        static constexpr auto value_kind = value::kind_type::closure;
+        syntax::Lambda const *lambda;
+        scope captured;
+    };
+
+    // a constructor that still waits for some of its fields
+    struct partial_constructor: cell{
+        static constexpr auto value_kind = value::kind_type::partial_constructor;
+        std::uint32_t constructor;
+        std::uint32_t field_count;
+
+        std::span<value> fields(){
+            return {reinterpret_cast<value *>(this + 1), field_count};
+        }
+    };
+
+    // a lambda lowered to bytecode, with the values of the variables it uses from outside
+    struct compiled_closure: cell{
+        static constexpr auto value_kind = value::kind_type::compiled_closure;
+        std::uint32_t function;
+        std::uint32_t capture_count;
+
+        std::span<value> captures(){
+            return {reinterpret_cast<value *>(this + 1), capture_count};
+        }
+    };
+
+    inline value::value(constructed *object): object(object), tag(kind_type::constructed) {}
+    inline value::value(closure *object): object(object), tag(kind_type::closure) {}
+    inline value::value(partial_constructor *object): object(object), tag(kind_type::partial_constructor) {}
+    inline value::value(compiled_closure *object): object(object), tag(kind_type::compiled_closure) {}
+
+    // what value_heap::collect() hands every root to: the root is changed to where its cell is now
+    class root_visitor{
+        public:
+            // a minor collection: roots that refer to no young cell (nothing made since the last collection) may be left out
+            bool const young_only;
+
+            virtual void visit(cell *&object) = 0;
+
+            void operator()(value &v){
+                if (not v.is_natural())
+                    visit(v.object);
+            }
+
+            template<class T>
+            void operator()(T *&object){
+                if (not object)
+                    return;
+                auto moved = static_cast<cell *>(object);
+                visit(moved);
+                object = static_cast<T *>(moved);
+            }
+
+        protected:
+            explicit root_visitor(bool young_only): young_only(young_only) {}
+            ~root_visitor() = default;
+    };
+
+    /*
+        A generational, tracing, moving heap for the values of one evaluator
+        Cells are bump-allocated in a nursery; a minor collection copies the ones still reachable into the old generation
+        (breadth first, Cheney's way), so the nursery is empty again and most cells die without being looked at
+        When the old generation has doubled since the last major collection, it is marked and compacted in place (sliding, in address order)
+        Cells are immutable once made, so nothing in the old generation refers into the nursery and no write barrier is needed
+        Allocating never collects: the owner calls collect() at safe points, when every value it uses is reachable from the roots
+        it passes; wants_collection() says when the nursery is full (allocation goes on in overflow chunks until then)
+        Hash-consed constructed values are in a table that does not keep them alive
+        Not thread-safe; the values of an evaluator stay on its thread
+    */
+    class value_heap{
+        public:
+            static constexpr std::size_t nursery_size = 1024 * 1024;
+
+            value_heap();
+            value_heap(value_heap const &) = delete;
+            value_heap &operator=(value_heap const &) = delete;
+            ~value_heap();
+
+            // hash_consed: made through the table, so the cell that already has these fields is returned if there is one
+            constructed *make_constructed(std::uint32_t constructor, std::span<value const> fields, bool hash_consed){
+                if (hash_consed)
+                    return make_interned(constructor, fields);
+                auto const object = allocate_with_values<constructed>(fields);
+                object->constructor = constructor;
+                object->field_count = static_cast<std::uint32_t>(fields.size());
+                object->serial = next_serial++;
+                return object;
+            }
+
+            partial_constructor *make_partial_constructor(std::uint32_t constructor, std::span<value const> fields){
+                auto const object = allocate_with_values<partial_constructor>(fields);
+                object->constructor = constructor;
+                object->field_count = static_cast<std::uint32_t>(fields.size());
+                return object;
+            }
+
+            compiled_closure *make_compiled_closure(std::uint32_t function, std::span<value const> captures){
+                auto const object = allocate_with_values<compiled_closure>(captures);
+                object->function = function;
+                object->capture_count = static_cast<std::uint32_t>(captures.size());
+                return object;
+            }
+
+            closure *make_closure(syntax::Lambda const *lambda, scope captured){
+                auto const object = allocate_cell<closure>(sizeof(closure));
+                object->lambda = lambda;
+                object->captured = captured;
+                return object;
+            }
+
+            binding *make_binding(symbol_id name, value bound, binding *next){
+                auto const object = allocate_cell<binding>(sizeof(binding));
+                object->name = name;
+                object->next = next;
+                object->bound = bound;
+                return object;
+            }
+
+            bool wants_collection() const{
+                return nursery_overflowed;
+            }
+
+            // roots(visitor) passes every value and environment the owner still uses to the visitor, and may be called more than once
+            void collect(std::function<void(root_visitor &)> const &roots);
+
+            // the number of hash-consed values in the table
+            std::size_t interned_count() const{
+                return interned_size;
+            }
+
+            heap_statistics const &stats() const{
+                return statistics;
+            }
+
+        private:
+            static constexpr std::size_t granularity = alignof(value);
+            static constexpr std::size_t old_chunk_size = 1024 * 1024;
+            static constexpr std::size_t least_major_threshold = 8 * 1024 * 1024;
+
+            enum flag: std::uint8_t{
+                young = 1,     // in the nursery
+                forwarded = 2, // copied out of the nursery by the current minor collection
+                marked = 4     // reached by the current major collection
+            };
+
+            struct chunk{
+                std::byte *start;
+                std::size_t capacity;
+                std::size_t used = 0;
+            };
+
+            struct interned{
+                std::uint64_t hash;
+                constructed *object; // nullptr in a free slot
+            };
+
+            void *allocate(std::size_t size){
+                if (static_cast<std::size_t>(nursery_end - nursery_current) < size)[[unlikely]]
+                    overflow_nursery(size);
+                auto const result = nursery_current;
+                nursery_current += size;
+                ++statistics.allocations;
+                statistics.allocated_bytes += size;
+                return result;
+            }
+
+            template<class T>
+            T *allocate_cell(std::size_t size){
+                size = (size + granularity - 1) & ~(granularity - 1);
+                auto const object = new (allocate(size)) T;
+                object->size = static_cast<std::uint32_t>(size);
+                object->kind = kind_of<T>();
+                object->flags = young;
+                return object;
+            }
+
+            template<class T>
+            T *allocate_with_values(std::span<value const> values){
+                auto const object = allocate_cell<T>(sizeof(T) + values.size_bytes());
+                if (not values.empty())
+                    std::memcpy(static_cast<void *>(object + 1), values.data(), values.size_bytes());
+                return object;
+            }
+
+            template<class T>
+            static constexpr cell_kind kind_of(){
+                if constexpr (std::is_same_v<T, constructed>)
+                    return cell_kind::constructed;
+                else if constexpr (std::is_same_v<T, closure>)
+                    return cell_kind::closure;
+                else if constexpr (std::is_same_v<T, partial_constructor>)
+                    return cell_kind::partial_constructor;
+                else if constexpr (std::is_same_v<T, compiled_closure>)
+                    return cell_kind::compiled_closure;
+                else
+                    return cell_kind::binding;
+            }
+
+            void overflow_nursery(std::size_t size);
+            constructed *make_interned(std::uint32_t constructor, std::span<value const> fields);
+
+            // to an object the old generation has room for, at the end
+            std::byte *allocate_old(std::size_t size);
+            void collect_minor(std::function<void(root_visitor &)> const &roots);
+            void collect_major(std::function<void(root_visitor &)> const &roots);
+
+            std::size_t find_interned(std::uint64_t hash, constructed const *object) const;
+            void insert_interned(interned entry);
+            void erase_interned(std::size_t slot);
+
+            std::byte *nursery = nullptr;
+            std::byte *nursery_current = nullptr;
+            std::byte *nursery_end = nullptr;
+            std::vector<std::byte *> overflow_chunks; // of the nursery, freed by the next minor collection
+            bool nursery_overflowed = false;
+
+            std::vector<chunk> old_chunks; // only the ones up to old_current have cells
+            std::size_t old_current = 0;
+            std::size_t major_threshold = least_major_threshold;
+
+            std::vector<interned> interned_slots; // open addressing, a power of two long
+            std::size_t interned_size = 0;
+            std::vector<interned> young_interned; // in the table and in the nursery
+            std::uint64_t next_serial = 0;
+
+            heap_statistics statistics;
+    };
+}
+
+#endif